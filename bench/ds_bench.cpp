@@ -0,0 +1,563 @@
+/**
+ * @file ds_bench.cpp
+ * @author zishu (zishuzy@gmail.com)
+ * @brief Run the same workloads against the ordered containers of the repo.
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Usage: ds_bench [-n sizes] [-b backends] [-w workloads] [-o file]
+ *     -n  Comma separated sizes, e.g. "1e3,1e4,1e5". Default: 1e3,1e4,1e5,1e6.
+ *     -b  Comma separated backends, default: all.
+ *     -w  Comma separated workloads, default: all.
+ *     -o  Write the JSON report to the file instead of stdout.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "tree/avl_tree/c/avl_tree.h"
+#include "tree/binary_search_tree/c/bs_tree.h"
+#include "tree/rb_tree/rb_tree.h"
+#include "tree/rb_tree/rb_tree_cpp.hpp"
+#include "tree/rb_tree/rb_tree_typed.h"
+
+RBTREE_DEFINE(bench_u64map, uint64_t, uint64_t, RBTREE_CMP_NUM)
+
+namespace bench
+{
+
+constexpr size_t kMaxSamples = 1 << 20; // 单个用例最多保存的延迟样本数
+constexpr size_t kBstreeSeqMax = 10000; // 顺序插入会让二叉搜索树退化成链表，只测小规模
+constexpr size_t kBatchSize = 128;      // batch_read 每批查找的 key 数
+constexpr size_t kCacheSize = 4096;     // rbtree_cache 的热点 key 缓存项数
+
+enum EWorkload {
+    WL_SEQ_INSERT,
+    WL_RAND_INSERT,
+    WL_RAND_READ,
+    WL_ZIPF_READ,
+    WL_DELETE_HEAVY,
+    WL_BATCH_READ
+};
+
+const char *g_arrWorkloadName[] = {"seq_insert", "rand_insert", "rand_read", "zipf_read",
+                                   "delete_heavy", "batch_read"};
+
+struct SResult {
+    std::string strBackend;
+    std::string strWorkload;
+    size_t nSize;
+    size_t nOps;
+    double dSeconds;
+    uint64_t nP50;
+    uint64_t nP99;
+    uint64_t nP999;
+    std::string strSkipped;
+};
+
+// splitmix64 的终结函数是一个双射，i 不同则 key 不同，用来生成不重复的随机 key
+inline uint64_t Mix64(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return (x ^ (x >> 31)) >> 1; // 最高位清零，当作 long 比较时也是正数
+}
+
+class CRandom
+{
+public:
+    explicit CRandom(uint64_t seed) : m_nState(seed) {}
+    uint64_t Next()
+    {
+        m_nState = Mix64(m_nState);
+        return m_nState;
+    }
+    double NextDouble() { return (double)(Next() >> 11) / (double)(1ULL << 52); }
+
+private:
+    uint64_t m_nState;
+};
+
+// Gray et al. "Quickly Generating Billion-Record Synthetic Databases" 中的 Zipfian 生成器
+class CZipfian
+{
+public:
+    CZipfian(uint64_t n, double theta, uint64_t seed) : m_nItems(n), m_dTheta(theta), m_rand(seed)
+    {
+        double zeta2 = 0;
+        m_dZetaN = 0;
+        for (uint64_t i = 1; i <= n; i++) {
+            m_dZetaN += 1.0 / std::pow((double)i, theta);
+            if (i == 2) {
+                zeta2 = m_dZetaN;
+            }
+        }
+        m_dAlpha = 1.0 / (1.0 - theta);
+        m_dEta = (1 - std::pow(2.0 / (double)n, 1 - theta)) / (1 - zeta2 / m_dZetaN);
+    }
+
+    uint64_t Next()
+    {
+        double u = m_rand.NextDouble();
+        double uz = u * m_dZetaN;
+        if (uz < 1.0) {
+            return 0;
+        }
+        if (uz < 1.0 + std::pow(0.5, m_dTheta)) {
+            return 1;
+        }
+        uint64_t r = (uint64_t)((double)m_nItems * std::pow(m_dEta * u - m_dEta + 1, m_dAlpha));
+        return r < m_nItems ? r : m_nItems - 1;
+    }
+
+private:
+    uint64_t m_nItems;
+    double m_dTheta;
+    double m_dZetaN;
+    double m_dAlpha;
+    double m_dEta;
+    CRandom m_rand;
+};
+
+// ------------------------------ backends ------------------------------
+
+class CRBTreeC
+{
+public:
+    static constexpr bool kCanErase = true;
+    static constexpr bool kCanBatch = true;
+    explicit CRBTreeC(bool b_pool, size_t cache_size = 0)
+    {
+        struct rbtree_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        arg.use_node_pool = b_pool;
+        arg.cache_size = cache_size;
+        m_pRoot = rbtree_init(arg);
+    }
+    ~CRBTreeC() { rbtree_destroy(m_pRoot); }
+    void Insert(uint64_t key) { rbtree_insert(m_pRoot, (void *)key, (void *)key, false, false); }
+    bool Find(uint64_t key) { return rbtree_is_exist(m_pRoot, (void *)key); }
+    void Erase(uint64_t key) { rbtree_delete(m_pRoot, (void *)key); }
+    size_t FindBatch(uint64_t *keys, size_t n)
+    {
+        void *arrValue[kBatchSize];
+        return rbtree_search_batch(m_pRoot, (void **)keys, n, arrValue);
+    }
+
+private:
+    struct rbtree_root *m_pRoot;
+};
+
+// 查找前先查热点 key 缓存，用于对比 zipf_read 下缓存的效果
+class CRBTreeCached : public CRBTreeC
+{
+public:
+    explicit CRBTreeCached(bool b_pool) : CRBTreeC(b_pool, kCacheSize) {}
+};
+
+// RBTREE_DEFINE 生成的类型特化红黑树，key 内联存放，比较内联展开
+class CRBTreeTyped
+{
+public:
+    static constexpr bool kCanErase = true;
+    static constexpr bool kCanBatch = false;
+    explicit CRBTreeTyped(bool) { bench_u64map_init(&m_tree); }
+    ~CRBTreeTyped() { bench_u64map_destroy(&m_tree); }
+    void Insert(uint64_t key) { bench_u64map_insert(&m_tree, key, key); }
+    bool Find(uint64_t key) { return bench_u64map_find(&m_tree, key) != nullptr; }
+    void Erase(uint64_t key) { bench_u64map_erase(&m_tree, key, nullptr); }
+
+private:
+    struct bench_u64map m_tree;
+};
+
+class CRBTreeCpp
+{
+public:
+    static constexpr bool kCanErase = true;
+    static constexpr bool kCanBatch = false;
+    explicit CRBTreeCpp(bool) {}
+    void Insert(uint64_t key) { m_tree.Insert(key, key); }
+    bool Find(uint64_t key) { return m_tree.SearchIterative(key) != nullptr; }
+    void Erase(uint64_t key)
+    {
+        uint64_t value;
+        m_tree.Remove(key, value);
+    }
+
+private:
+    tree::CRBTree<uint64_t, uint64_t> m_tree;
+};
+
+// 节点从 CRBTreeNodePool 分配的 CRBTree，与 crbtree 对比逐节点 new/delete 的开销
+class CRBTreeCppPool
+{
+public:
+    static constexpr bool kCanErase = true;
+    static constexpr bool kCanBatch = false;
+    explicit CRBTreeCppPool(bool) : m_tree(&m_pool) {}
+    void Insert(uint64_t key) { m_tree.Insert(key, key); }
+    bool Find(uint64_t key) { return m_tree.SearchIterative(key) != nullptr; }
+    void Erase(uint64_t key)
+    {
+        uint64_t value;
+        m_tree.Remove(key, value);
+    }
+
+private:
+    tree::CRBTreeNodePool<uint64_t, uint64_t> m_pool; // 先于 m_tree 构造、后于其析构
+    tree::pmr::CRBTree<uint64_t, uint64_t> m_tree;
+};
+
+inline int LessU64(void *left_key, uint32_t, void *right_key, uint32_t)
+{
+    return (uint64_t)left_key < (uint64_t)right_key;
+}
+
+class CAVLTree
+{
+public:
+    static constexpr bool kCanErase = false;
+    static constexpr bool kCanBatch = false;
+    explicit CAVLTree(bool) {}
+    ~CAVLTree() { avltree_destroy(m_pRoot, nullptr, nullptr); }
+    void Insert(uint64_t key)
+    {
+        avltree_node_t *root = avltree_insert(m_pRoot, (void *)key, 0, (void *)key, 0, LessU64);
+        if (root) {
+            m_pRoot = root;
+        }
+    }
+    bool Find(uint64_t key) { return avltree_find(m_pRoot, (void *)key, 0, LessU64) != nullptr; }
+    void Erase(uint64_t) {}
+
+private:
+    avltree_node_t *m_pRoot = nullptr;
+};
+
+class CBSTree
+{
+public:
+    static constexpr bool kCanErase = false;
+    static constexpr bool kCanBatch = false;
+    explicit CBSTree(bool) {}
+    ~CBSTree() { bstree_destroy(m_pRoot, nullptr, nullptr); }
+    void Insert(uint64_t key)
+    {
+        bstree_node_t *node = bstree_insert(m_pRoot, (void *)key, 0, (void *)key, 0, LessU64);
+        if (!m_pRoot) {
+            m_pRoot = node;
+        }
+    }
+    bool Find(uint64_t key) { return bstree_find(m_pRoot, (void *)key, 0, LessU64) != nullptr; }
+    void Erase(uint64_t) {}
+
+private:
+    bstree_node_t *m_pRoot = nullptr;
+};
+
+class CStdMap
+{
+public:
+    static constexpr bool kCanErase = true;
+    static constexpr bool kCanBatch = false;
+    explicit CStdMap(bool) {}
+    void Insert(uint64_t key) { m_map[key] = key; }
+    bool Find(uint64_t key) { return m_map.find(key) != m_map.end(); }
+    void Erase(uint64_t key) { m_map.erase(key); }
+
+private:
+    std::map<uint64_t, uint64_t> m_map;
+};
+
+// ------------------------------ runner ------------------------------
+
+class CLatency
+{
+public:
+    explicit CLatency(size_t n_ops) : m_nStride(std::max<size_t>(1, n_ops / kMaxSamples))
+    {
+        m_vecSample.reserve(std::min(n_ops, kMaxSamples) + 1);
+    }
+
+    template <typename F>
+    void Measure(size_t i, F &&func)
+    {
+        if (i % m_nStride != 0) {
+            func();
+            return;
+        }
+        auto begin = std::chrono::steady_clock::now();
+        func();
+        auto end = std::chrono::steady_clock::now();
+        m_vecSample.push_back(
+            (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+    }
+
+    void Fill(SResult &result)
+    {
+        if (m_vecSample.empty()) {
+            return;
+        }
+        std::sort(m_vecSample.begin(), m_vecSample.end());
+        result.nP50 = Percentile(0.5);
+        result.nP99 = Percentile(0.99);
+        result.nP999 = Percentile(0.999);
+    }
+
+private:
+    uint64_t Percentile(double p)
+    {
+        size_t idx = (size_t)(p * (double)(m_vecSample.size() - 1));
+        return m_vecSample[idx];
+    }
+
+    size_t m_nStride;
+    std::vector<uint64_t> m_vecSample;
+};
+
+template <typename Backend>
+SResult Run(const char *sz_backend, bool b_pool, EWorkload workload, size_t n)
+{
+    SResult result{sz_backend, g_arrWorkloadName[workload], n, 0, 0, 0, 0, 0, ""};
+
+    if (!Backend::kCanErase && workload == WL_DELETE_HEAVY) {
+        result.strSkipped = "backend has no delete";
+        return result;
+    }
+    if (!Backend::kCanBatch && workload == WL_BATCH_READ) {
+        result.strSkipped = "backend has no batch lookup";
+        return result;
+    }
+    if (std::strcmp(sz_backend, "bstree") == 0 && workload == WL_SEQ_INSERT &&
+        n > kBstreeSeqMax) {
+        result.strSkipped = "degenerates to a list";
+        return result;
+    }
+
+    Backend backend(b_pool);
+    CLatency latency(n);
+    size_t ops = n;
+    volatile size_t found = 0;
+
+    // 读和删除类的负载先建好一棵包含 n 个随机 key 的树，建树时间不计入
+    if (workload != WL_SEQ_INSERT && workload != WL_RAND_INSERT) {
+        for (size_t i = 0; i < n; i++) {
+            backend.Insert(Mix64(i));
+        }
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    switch (workload) {
+    case WL_SEQ_INSERT:
+        for (size_t i = 0; i < ops; i++) {
+            latency.Measure(i, [&] { backend.Insert(i); });
+        }
+        break;
+    case WL_RAND_INSERT:
+        for (size_t i = 0; i < ops; i++) {
+            latency.Measure(i, [&] { backend.Insert(Mix64(i)); });
+        }
+        break;
+    case WL_RAND_READ: {
+        CRandom rand(n);
+        for (size_t i = 0; i < ops; i++) {
+            uint64_t key = Mix64(rand.Next() % n);
+            latency.Measure(i, [&] { found = found + backend.Find(key); });
+        }
+        break;
+    }
+    case WL_ZIPF_READ: {
+        CZipfian zipf(n, 0.99, n);
+        for (size_t i = 0; i < ops; i++) {
+            uint64_t key = Mix64(zipf.Next());
+            latency.Measure(i, [&] { found = found + backend.Find(key); });
+        }
+        break;
+    }
+    case WL_BATCH_READ: {
+        // 与 rand_read 相同的 key 序列，每 kBatchSize 个一批，延迟按批统计
+        CRandom rand(n);
+        uint64_t arrKey[kBatchSize];
+        for (size_t i = 0; i < ops; i += kBatchSize) {
+            size_t batch = std::min(kBatchSize, ops - i);
+            for (size_t j = 0; j < batch; j++) {
+                arrKey[j] = Mix64(rand.Next() % n);
+            }
+            latency.Measure(i / kBatchSize, [&] {
+                if constexpr (Backend::kCanBatch) {
+                    found = found + backend.FindBatch(arrKey, batch);
+                }
+            });
+        }
+        break;
+    }
+    case WL_DELETE_HEAVY: {
+        // 45% 删除最老的 key，45% 插入新 key，10% 随机读
+        size_t next_del = 0;
+        size_t next_ins = n;
+        CRandom rand(n);
+        for (size_t i = 0; i < ops; i++) {
+            size_t r = i % 20;
+            if (r < 18 && (r & 1) == 0) {
+                uint64_t key = Mix64(next_del++);
+                latency.Measure(i, [&] { backend.Erase(key); });
+            } else if (r < 18) {
+                uint64_t key = Mix64(next_ins++);
+                latency.Measure(i, [&] { backend.Insert(key); });
+            } else {
+                uint64_t key = Mix64(next_del + rand.Next() % (next_ins - next_del));
+                latency.Measure(i, [&] { found = found + backend.Find(key); });
+            }
+        }
+        break;
+    }
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    result.nOps = ops;
+    result.dSeconds = std::chrono::duration<double>(end - begin).count();
+    latency.Fill(result);
+    return result;
+}
+
+struct SBackend {
+    const char *szName;
+    SResult (*pfnRun)(const char *sz_backend, bool b_pool, EWorkload workload, size_t n);
+    bool bPool;
+};
+
+const SBackend g_arrBackend[] = {
+    {"rbtree", Run<CRBTreeC>, false},       {"rbtree_pool", Run<CRBTreeC>, true},
+    {"rbtree_cache", Run<CRBTreeCached>, false}, {"rbtree_typed", Run<CRBTreeTyped>, false},
+    {"crbtree", Run<CRBTreeCpp>, false},  {"crbtree_pool", Run<CRBTreeCppPool>, true},
+    {"avltree", Run<CAVLTree>, false},      {"bstree", Run<CBSTree>, false},
+    {"std_map", Run<CStdMap>, false},
+};
+
+std::vector<std::string> Split(const char *sz_list)
+{
+    std::vector<std::string> vecOut;
+    std::string strItem;
+    for (const char *p = sz_list; *p; p++) {
+        if (*p == ',') {
+            vecOut.push_back(strItem);
+            strItem.clear();
+        } else {
+            strItem.push_back(*p);
+        }
+    }
+    if (!strItem.empty()) {
+        vecOut.push_back(strItem);
+    }
+    return vecOut;
+}
+
+bool Selected(const std::vector<std::string> &vec_filter, const char *sz_name)
+{
+    return vec_filter.empty() ||
+           std::find(vec_filter.begin(), vec_filter.end(), sz_name) != vec_filter.end();
+}
+
+void PrintResult(FILE *fp, const SResult &result, bool b_last)
+{
+    std::fprintf(fp, "    {\"backend\": \"%s\", \"workload\": \"%s\", \"n\": %zu",
+                 result.strBackend.c_str(), result.strWorkload.c_str(), result.nSize);
+    if (!result.strSkipped.empty()) {
+        std::fprintf(fp, ", \"skipped\": \"%s\"}%s\n", result.strSkipped.c_str(),
+                     b_last ? "" : ",");
+        return;
+    }
+    std::fprintf(fp,
+                 ", \"ops\": %zu, \"seconds\": %.6f, \"ops_per_sec\": %.1f, \"p50_ns\": %lu, "
+                 "\"p99_ns\": %lu, \"p999_ns\": %lu}%s\n",
+                 result.nOps, result.dSeconds,
+                 result.dSeconds > 0 ? (double)result.nOps / result.dSeconds : 0.0,
+                 (unsigned long)result.nP50, (unsigned long)result.nP99,
+                 (unsigned long)result.nP999, b_last ? "" : ",");
+}
+
+} // namespace bench
+
+int main(int argc, char *argv[])
+{
+    using namespace bench;
+    std::vector<size_t> vecSize = {1000, 10000, 100000, 1000000};
+    std::vector<std::string> vecBackend;
+    std::vector<std::string> vecWorkload;
+    std::vector<SResult> vecResult;
+    FILE *fp = stdout;
+
+    for (int i = 1; i < argc; i += 2) {
+        if (i + 1 == argc) {
+            std::fprintf(stderr, "missing value for option %s\n", argv[i]);
+            return 1;
+        }
+        if (std::strcmp(argv[i], "-n") == 0) {
+            vecSize.clear();
+            for (const auto &strSize : Split(argv[i + 1])) {
+                // 负载按 key % n 取值，n 为 0 时会除零
+                char *pEnd = nullptr;
+                double dSize = std::strtod(strSize.c_str(), &pEnd);
+                if (pEnd == strSize.c_str() || *pEnd != '\0' || !(dSize >= 1)) {
+                    std::fprintf(stderr, "invalid size %s, must be a number >= 1\n",
+                                 strSize.c_str());
+                    return 1;
+                }
+                vecSize.push_back((size_t)dSize);
+            }
+            if (vecSize.empty()) {
+                std::fprintf(stderr, "no size given for -n\n");
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "-b") == 0) {
+            vecBackend = Split(argv[i + 1]);
+        } else if (std::strcmp(argv[i], "-w") == 0) {
+            vecWorkload = Split(argv[i + 1]);
+        } else if (std::strcmp(argv[i], "-o") == 0) {
+            fp = std::fopen(argv[i + 1], "w");
+            if (!fp) {
+                std::fprintf(stderr, "failed to open %s\n", argv[i + 1]);
+                return 1;
+            }
+        } else {
+            std::fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    for (size_t n : vecSize) {
+        for (const auto &backend : g_arrBackend) {
+            if (!Selected(vecBackend, backend.szName)) {
+                continue;
+            }
+            for (int w = WL_SEQ_INSERT; w <= WL_BATCH_READ; w++) {
+                if (!Selected(vecWorkload, g_arrWorkloadName[w])) {
+                    continue;
+                }
+                vecResult.push_back(backend.pfnRun(backend.szName, backend.bPool, (EWorkload)w, n));
+                std::fprintf(stderr, "%s %s %zu done\n", backend.szName, g_arrWorkloadName[w], n);
+            }
+        }
+    }
+
+    std::fprintf(fp, "{\n  \"benchmark\": \"ds_bench\",\n  \"results\": [\n");
+    for (size_t i = 0; i < vecResult.size(); i++) {
+        PrintResult(fp, vecResult[i], i + 1 == vecResult.size());
+    }
+    std::fprintf(fp, "  ]\n}\n");
+    if (fp != stdout) {
+        std::fclose(fp);
+    }
+    return 0;
+}
@@ -0,0 +1,249 @@
+/**
+ * @file lock_bench.cpp
+ * @author zishu (zishuzy@gmail.com)
+ * @brief Throughput of a thread-safe rbtree under each lock policy as threads are added.
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Usage: lock_bench [-n size] [-t threads] [-r read_percents] [-p policies] [-d ms] [-o file]
+ *     -n  Number of keys in the tree. Default: 100000.
+ *     -t  Comma separated thread counts. Default: 1,2,4,8,16,32,64.
+ *     -r  Comma separated percentages of lookups, the rest are inserts and deletes in equal
+ *         parts. Default: 100,99,90,50.
+ *     -p  Comma separated policies: rwlock, brlock, queued. Default: all.
+ *     -d  Duration of each run in milliseconds. Default: 200.
+ *     -o  Write the JSON report to the file instead of stdout.
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tree/rb_tree/rb_tree.h"
+
+namespace bench
+{
+
+struct SPolicy {
+    const char *szName;
+    int nPolicy;
+};
+
+const SPolicy g_arrPolicy[] = {
+    {"rwlock", RBTREE_LOCK_RWLOCK},
+    {"brlock", RBTREE_LOCK_BRLOCK},
+    {"queued", RBTREE_LOCK_QUEUED},
+};
+
+struct SResult {
+    std::string strPolicy;
+    int nThreads;
+    int nReadPercent;
+    uint64_t nOps;
+    uint64_t nWrites;
+    double dSeconds;
+};
+
+// 每个线程各用一个 xorshift64*，互不共享状态
+inline uint64_t NextRandom(uint64_t &state)
+{
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545f4914f6cdd1dULL;
+}
+
+// 每个线程的计数放在各自的缓存行上，统计本身不制造争用
+struct alignas(64) SCounter {
+    uint64_t nOps = 0;
+    uint64_t nWrites = 0;
+};
+
+SResult Run(const SPolicy &policy, size_t n, int threads, int read_percent,
+            std::chrono::milliseconds duration)
+{
+    struct rbtree_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.is_thread_safe = 1;
+    arg.use_node_pool = 1;
+    arg.lock_policy = policy.nPolicy;
+    struct rbtree_root *root = rbtree_init(arg);
+
+    // key 取 [0, 2n) 中的偶数，写操作在 [0, 2n) 中随机插入或删除，树的大小保持在 n 附近
+    for (size_t i = 0; i < n; i++) {
+        rbtree_insert(root, (void *)(uintptr_t)(i * 2), (void *)(uintptr_t)i, false, false);
+    }
+
+    std::atomic<bool> bStart{false};
+    std::atomic<bool> bStop{false};
+    std::vector<SCounter> vecCounter(threads);
+    std::vector<std::thread> vecThread;
+    for (int t = 0; t < threads; t++) {
+        vecThread.emplace_back([&, t] {
+            uint64_t state = 0x9e3779b97f4a7c15ULL * (t + 1);
+            SCounter &counter = vecCounter[t];
+            while (!bStart.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            while (!bStop.load(std::memory_order_relaxed)) {
+                uint64_t r = NextRandom(state);
+                void *key = (void *)(uintptr_t)((r >> 8) % (2 * n));
+                if ((int)(r & 0xff) * 100 < read_percent * 256) {
+                    rbtree_is_exist(root, key);
+                } else {
+                    if (r & 0x100000000ULL) {
+                        rbtree_insert(root, key, key, false, false);
+                    } else {
+                        rbtree_delete(root, key);
+                    }
+                    counter.nWrites++;
+                }
+                counter.nOps++;
+            }
+        });
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    bStart.store(true, std::memory_order_release);
+    std::this_thread::sleep_for(duration);
+    bStop.store(true, std::memory_order_relaxed);
+    for (auto &thread : vecThread) {
+        thread.join();
+    }
+    auto end = std::chrono::steady_clock::now();
+    rbtree_destroy(root);
+
+    SResult result{policy.szName, threads, read_percent, 0, 0, 0.0};
+    for (const auto &counter : vecCounter) {
+        result.nOps += counter.nOps;
+        result.nWrites += counter.nWrites;
+    }
+    result.dSeconds = std::chrono::duration<double>(end - begin).count();
+    return result;
+}
+
+std::vector<std::string> Split(const char *sz_list)
+{
+    std::vector<std::string> vecOut;
+    std::string strItem;
+    for (const char *p = sz_list; *p; p++) {
+        if (*p == ',') {
+            vecOut.push_back(strItem);
+            strItem.clear();
+        } else {
+            strItem.push_back(*p);
+        }
+    }
+    if (!strItem.empty()) {
+        vecOut.push_back(strItem);
+    }
+    return vecOut;
+}
+
+std::vector<int> SplitInt(const char *sz_list)
+{
+    std::vector<int> vecOut;
+    for (const auto &strItem : Split(sz_list)) {
+        vecOut.push_back(std::atoi(strItem.c_str()));
+    }
+    return vecOut;
+}
+
+bool Selected(const std::vector<std::string> &vec_filter, const char *sz_name)
+{
+    return vec_filter.empty() ||
+           std::find(vec_filter.begin(), vec_filter.end(), sz_name) != vec_filter.end();
+}
+
+void PrintResult(FILE *fp, const SResult &result, bool b_last)
+{
+    std::fprintf(fp,
+                 "    {\"policy\": \"%s\", \"threads\": %d, \"read_percent\": %d, \"ops\": %lu, "
+                 "\"writes\": %lu, \"seconds\": %.6f, \"ops_per_sec\": %.1f}%s\n",
+                 result.strPolicy.c_str(), result.nThreads, result.nReadPercent,
+                 (unsigned long)result.nOps, (unsigned long)result.nWrites, result.dSeconds,
+                 result.dSeconds > 0 ? (double)result.nOps / result.dSeconds : 0.0,
+                 b_last ? "" : ",");
+}
+
+} // namespace bench
+
+int main(int argc, char *argv[])
+{
+    using namespace bench;
+    size_t n = 100000;
+    std::vector<int> vecThreads = {1, 2, 4, 8, 16, 32, 64};
+    std::vector<int> vecReadPercent = {100, 99, 90, 50};
+    std::vector<std::string> vecPolicy;
+    std::chrono::milliseconds duration(200);
+    std::vector<SResult> vecResult;
+    FILE *fp = stdout;
+
+    for (int i = 1; i < argc; i += 2) {
+        if (i + 1 == argc) {
+            std::fprintf(stderr, "missing value for option %s\n", argv[i]);
+            return 1;
+        }
+        if (std::strcmp(argv[i], "-n") == 0) {
+            char *pEnd = nullptr;
+            double dSize = std::strtod(argv[i + 1], &pEnd);
+            if (pEnd == argv[i + 1] || *pEnd != '\0' || !(dSize >= 1)) {
+                std::fprintf(stderr, "invalid size %s, must be a number >= 1\n", argv[i + 1]);
+                return 1;
+            }
+            n = (size_t)dSize;
+        } else if (std::strcmp(argv[i], "-t") == 0) {
+            vecThreads = SplitInt(argv[i + 1]);
+        } else if (std::strcmp(argv[i], "-r") == 0) {
+            vecReadPercent = SplitInt(argv[i + 1]);
+        } else if (std::strcmp(argv[i], "-p") == 0) {
+            vecPolicy = Split(argv[i + 1]);
+        } else if (std::strcmp(argv[i], "-d") == 0) {
+            duration = std::chrono::milliseconds(std::atoi(argv[i + 1]));
+        } else if (std::strcmp(argv[i], "-o") == 0) {
+            fp = std::fopen(argv[i + 1], "w");
+            if (!fp) {
+                std::fprintf(stderr, "failed to open %s\n", argv[i + 1]);
+                return 1;
+            }
+        } else {
+            std::fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    for (int read_percent : vecReadPercent) {
+        for (const auto &policy : g_arrPolicy) {
+            if (!Selected(vecPolicy, policy.szName)) {
+                continue;
+            }
+            for (int threads : vecThreads) {
+                if (threads < 1) {
+                    continue;
+                }
+                vecResult.push_back(Run(policy, n, threads, read_percent, duration));
+                std::fprintf(stderr, "%s %d threads %d%% read done\n", policy.szName, threads,
+                             read_percent);
+            }
+        }
+    }
+
+    std::fprintf(fp, "{\n  \"benchmark\": \"lock_bench\",\n  \"size\": %zu,\n  \"results\": [\n",
+                 n);
+    for (size_t i = 0; i < vecResult.size(); i++) {
+        PrintResult(fp, vecResult[i], i + 1 == vecResult.size());
+    }
+    std::fprintf(fp, "  ]\n}\n");
+    if (fp != stdout) {
+        std::fclose(fp);
+    }
+    return 0;
+}
@@ -0,0 +1,311 @@
+/**
+ * @file slab.c
+ * @author zishu (zishuzy@gmail.com)
+ * @brief Fixed-size object pool (slab allocator).
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#include "slab.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#define SLAB_ALIGN       16
+#define SLAB_CHUNK_MIN   (64 * 1024)       // The first chunk, small pools stay small.
+#define SLAB_CHUNK_MAX   (2 * 1024 * 1024) // Chunks double up to this size.
+#define SLAB_CACHE_SIZE  64                // Objects cached per thread.
+#define SLAB_CACHE_BATCH (SLAB_CACHE_SIZE / 2)
+
+#define SLAB_ROUND_UP(x, a) (((x) + (a) - 1) & ~((size_t)(a) - 1))
+#define SLAB_CHUNK_HDR      SLAB_ROUND_UP(sizeof(struct slab_chunk), SLAB_ALIGN)
+
+struct slab_chunk {
+    struct slab_chunk *next;
+    size_t size;
+};
+
+struct slab_free_obj {
+    struct slab_free_obj *next;
+};
+
+struct slab_cache {
+    slab_pool_t *pool;
+    struct slab_cache *prev;
+    struct slab_cache *next;
+    uint32_t count;
+    void *objs[SLAB_CACHE_SIZE];
+};
+
+struct slab_pool {
+    size_t obj_size;
+    uint32_t flags;
+    pthread_mutex_t mutex;
+    struct slab_free_obj *free_list;
+    struct slab_chunk *chunks;
+    char *cursor; // Objects in the current chunk are carved from [cursor, limit).
+    char *limit;
+    size_t chunk_size;
+    size_t mapped;
+    pthread_key_t cache_key;
+    struct slab_cache *caches;
+};
+
+static int slab_grow_(slab_pool_t *pool)
+{
+    struct slab_chunk *chunk;
+    size_t size = pool->chunk_size;
+
+    if (size < SLAB_CHUNK_HDR + pool->obj_size) {
+        size = SLAB_CHUNK_HDR + pool->obj_size;
+    }
+    chunk = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (chunk == MAP_FAILED) {
+        return -1;
+    }
+    chunk->size = size;
+    chunk->next = pool->chunks;
+    pool->chunks = chunk;
+    pool->cursor = (char *)chunk + SLAB_CHUNK_HDR;
+    pool->limit = (char *)chunk + size;
+    pool->mapped += size;
+    if (pool->chunk_size < SLAB_CHUNK_MAX) {
+        pool->chunk_size <<= 1;
+    }
+    return 0;
+}
+
+static void *slab_alloc_locked_(slab_pool_t *pool)
+{
+    void *obj;
+
+    if (pool->free_list) {
+        obj = pool->free_list;
+        pool->free_list = pool->free_list->next;
+        return obj;
+    }
+    if (pool->cursor + pool->obj_size > pool->limit && slab_grow_(pool) < 0) {
+        return NULL;
+    }
+    obj = pool->cursor;
+    pool->cursor += pool->obj_size;
+    return obj;
+}
+
+static void slab_free_locked_(slab_pool_t *pool, void *obj)
+{
+    struct slab_free_obj *fobj = obj;
+    fobj->next = pool->free_list;
+    pool->free_list = fobj;
+}
+
+static inline void slab_lock_(slab_pool_t *pool)
+{
+    if (pool->flags & SLAB_THREAD_SAFE) {
+        pthread_mutex_lock(&pool->mutex);
+    }
+}
+
+static inline void slab_unlock_(slab_pool_t *pool)
+{
+    if (pool->flags & SLAB_THREAD_SAFE) {
+        pthread_mutex_unlock(&pool->mutex);
+    }
+}
+
+// Give the cached objects back to the pool when the thread exits.
+static void slab_cache_release_(void *arg)
+{
+    struct slab_cache *cache = arg;
+    slab_pool_t *pool = cache->pool;
+    uint32_t i;
+
+    pthread_mutex_lock(&pool->mutex);
+    for (i = 0; i < cache->count; i++) {
+        slab_free_locked_(pool, cache->objs[i]);
+    }
+    if (cache->prev) {
+        cache->prev->next = cache->next;
+    } else {
+        pool->caches = cache->next;
+    }
+    if (cache->next) {
+        cache->next->prev = cache->prev;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    free(cache);
+}
+
+static struct slab_cache *slab_cache_get_(slab_pool_t *pool)
+{
+    struct slab_cache *cache = pthread_getspecific(pool->cache_key);
+    if (cache) {
+        return cache;
+    }
+
+    cache = calloc(1, sizeof(struct slab_cache));
+    if (!cache) {
+        return NULL;
+    }
+    if (pthread_setspecific(pool->cache_key, cache) != 0) {
+        free(cache);
+        return NULL;
+    }
+    cache->pool = pool;
+    pthread_mutex_lock(&pool->mutex);
+    cache->next = pool->caches;
+    if (pool->caches) {
+        pool->caches->prev = cache;
+    }
+    pool->caches = cache;
+    pthread_mutex_unlock(&pool->mutex);
+    return cache;
+}
+
+slab_pool_t *slab_pool_create(size_t obj_size, uint32_t flags)
+{
+    slab_pool_t *pool;
+
+    if (obj_size == 0) {
+        return NULL;
+    }
+    if (flags & SLAB_THREAD_CACHE) {
+        flags |= SLAB_THREAD_SAFE;
+    }
+
+    pool = calloc(1, sizeof(slab_pool_t));
+    if (!pool) {
+        return NULL;
+    }
+    if (obj_size < sizeof(struct slab_free_obj)) {
+        obj_size = sizeof(struct slab_free_obj);
+    }
+    pool->obj_size = SLAB_ROUND_UP(obj_size, obj_size >= SLAB_ALIGN ? SLAB_ALIGN : sizeof(void *));
+    pool->flags = flags;
+    pool->chunk_size = SLAB_CHUNK_MIN;
+
+    if (flags & SLAB_THREAD_SAFE) {
+        if (pthread_mutex_init(&pool->mutex, NULL) != 0) {
+            goto err0;
+        }
+    }
+    if (flags & SLAB_THREAD_CACHE) {
+        if (pthread_key_create(&pool->cache_key, slab_cache_release_) != 0) {
+            goto err1;
+        }
+    }
+
+    return pool;
+err1:
+    pthread_mutex_destroy(&pool->mutex);
+err0:
+    free(pool);
+    return NULL;
+}
+
+void slab_pool_destroy(slab_pool_t *pool)
+{
+    struct slab_chunk *chunk;
+    struct slab_cache *cache;
+
+    if (!pool) {
+        return;
+    }
+
+    if (pool->flags & SLAB_THREAD_CACHE) {
+        // The destructor must not run for this key any more, the caches are released here.
+        pthread_key_delete(pool->cache_key);
+        while ((cache = pool->caches) != NULL) {
+            pool->caches = cache->next;
+            free(cache);
+        }
+    }
+    while ((chunk = pool->chunks) != NULL) {
+        pool->chunks = chunk->next;
+        munmap(chunk, chunk->size);
+    }
+    if (pool->flags & SLAB_THREAD_SAFE) {
+        pthread_mutex_destroy(&pool->mutex);
+    }
+    free(pool);
+}
+
+void *slab_alloc(slab_pool_t *pool)
+{
+    struct slab_cache *cache;
+    void *obj;
+
+    if (!pool) {
+        return NULL;
+    }
+
+    if ((pool->flags & SLAB_THREAD_CACHE) && (cache = slab_cache_get_(pool)) != NULL) {
+        if (cache->count == 0) {
+            // Refill half of the cache at once, so the mutex is taken once per batch.
+            pthread_mutex_lock(&pool->mutex);
+            while (cache->count < SLAB_CACHE_BATCH) {
+                obj = slab_alloc_locked_(pool);
+                if (!obj) {
+                    break;
+                }
+                cache->objs[cache->count++] = obj;
+            }
+            pthread_mutex_unlock(&pool->mutex);
+            if (cache->count == 0) {
+                return NULL;
+            }
+        }
+        return cache->objs[--cache->count];
+    }
+
+    slab_lock_(pool);
+    obj = slab_alloc_locked_(pool);
+    slab_unlock_(pool);
+    return obj;
+}
+
+void slab_free(slab_pool_t *pool, void *obj)
+{
+    struct slab_cache *cache;
+
+    if (!pool || !obj) {
+        return;
+    }
+
+    if ((pool->flags & SLAB_THREAD_CACHE) && (cache = slab_cache_get_(pool)) != NULL) {
+        if (cache->count == SLAB_CACHE_SIZE) {
+            pthread_mutex_lock(&pool->mutex);
+            while (cache->count > SLAB_CACHE_BATCH) {
+                slab_free_locked_(pool, cache->objs[--cache->count]);
+            }
+            pthread_mutex_unlock(&pool->mutex);
+        }
+        cache->objs[cache->count++] = obj;
+        return;
+    }
+
+    slab_lock_(pool);
+    slab_free_locked_(pool, obj);
+    slab_unlock_(pool);
+}
+
+size_t slab_obj_size(slab_pool_t *pool)
+{
+    return pool ? pool->obj_size : 0;
+}
+
+size_t slab_mapped_bytes(slab_pool_t *pool)
+{
+    size_t mapped;
+
+    if (!pool) {
+        return 0;
+    }
+    slab_lock_(pool);
+    mapped = pool->mapped;
+    slab_unlock_(pool);
+    return mapped;
+}
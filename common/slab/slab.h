@@ -0,0 +1,84 @@
+/**
+ * @file slab.h
+ * @author zishu (zishuzy@gmail.com)
+ * @brief Fixed-size object pool (slab allocator).
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#ifndef COMMON_SLAB
+#define COMMON_SLAB
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SLAB_THREAD_SAFE  0x1 // The pool is shared by threads, it is protected by a mutex.
+#define SLAB_THREAD_CACHE 0x2 // Every thread caches some free objects, implies SLAB_THREAD_SAFE.
+
+typedef struct slab_pool slab_pool_t;
+
+/**
+ * @brief Create a pool for objects of "obj_size" bytes.
+ *
+ * The memory is taken from the system in large chunks with mmap, objects are carved from the
+ * chunks and recycled through a free list. Destroying the pool releases every chunk at once,
+ * no matter whether the objects in it were freed or not.
+ *
+ * @param obj_size
+ * @param flags SLAB_THREAD_SAFE, SLAB_THREAD_CACHE or 0.
+ * @return slab_pool_t* On success, the pool is returned. On error, NULL is returned.
+ */
+slab_pool_t *slab_pool_create(size_t obj_size, uint32_t flags);
+
+/**
+ * @brief Destroy the pool and release all the memory of it.
+ *
+ * The pool must not be used by any thread during or after the call.
+ *
+ * @param pool
+ */
+void slab_pool_destroy(slab_pool_t *pool);
+
+/**
+ * @brief Allocate an object from the pool, the content of the object is undefined.
+ *
+ * @param pool
+ * @return void* On success, the object is returned. On error, NULL is returned.
+ */
+void *slab_alloc(slab_pool_t *pool);
+
+/**
+ * @brief Return an object to the pool.
+ *
+ * @param pool
+ * @param obj Must be allocated by slab_alloc from the same pool.
+ */
+void slab_free(slab_pool_t *pool, void *obj);
+
+/**
+ * @brief Get the size of an object of the pool, including the alignment padding.
+ *
+ * @param pool
+ * @return size_t
+ */
+size_t slab_obj_size(slab_pool_t *pool);
+
+/**
+ * @brief Get the number of bytes mapped by the pool.
+ *
+ * @param pool
+ * @return size_t
+ */
+size_t slab_mapped_bytes(slab_pool_t *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COMMON_SLAB */
@@ -0,0 +1,338 @@
+/**
+ * @file epoch.c
+ * @author zishu (zishuzy@gmail.com)
+ * @brief Epoch based memory reclamation for lock-free readers.
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#include "epoch.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EPOCH_CACHELINE     64
+#define EPOCH_NR_LIMBO      3  // Objects retired in epoch e are freed when the epoch reaches e + 2.
+#define EPOCH_RECLAIM_BATCH 64 // Try to advance the epoch once per this many retired objects.
+
+#define EPOCH_REC_DOMAIN 1u // The record is on the list of a live domain.
+#define EPOCH_REC_HELD   2u // A thread uses the record. It is freed when both bits are clear.
+
+// Every reader thread owns one record, it is on its own cache line so readers never share one.
+struct epoch_record {
+    uint64_t state; // (epoch << 1) | active, written by the owner and read by the reclaimer.
+    uint32_t nest;
+    uint32_t flags; // EPOCH_REC_*
+    struct epoch_record *next;
+} __attribute__((aligned(EPOCH_CACHELINE)));
+
+// The records of one thread, one entry per domain it has entered. All domains share a single
+// pthread key whose destructor releases the entries, so the number of domains is not bounded
+// by PTHREAD_KEYS_MAX.
+struct epoch_entry {
+    epoch_domain_t *domain;
+    struct epoch_record *rec;
+    struct epoch_entry *next;
+};
+
+struct epoch_retired {
+    void *ptr;
+    void (*free_fn)(void *ptr, void *ctx);
+    void *ctx;
+};
+
+struct epoch_limbo {
+    struct epoch_retired *objs;
+    size_t count;
+    size_t cap;
+};
+
+struct epoch_domain {
+    uint64_t epoch __attribute__((aligned(EPOCH_CACHELINE)));
+    pthread_mutex_t mutex; // Protects the record list.
+    struct epoch_record *records;
+    struct epoch_limbo limbo[EPOCH_NR_LIMBO];
+    size_t nr_pending;
+    size_t nr_retired; // Retired since the last reclaim.
+};
+
+static pthread_key_t epoch_key_;
+static pthread_once_t epoch_key_once_ = PTHREAD_ONCE_INIT;
+static int epoch_key_err_;
+static __thread struct epoch_entry *epoch_entries_; // The entries of the calling thread.
+static __thread struct epoch_entry *epoch_last_;    // The entry used last, checked first.
+
+// Give up a record, it may then be taken over by another thread or freed with its domain.
+static void epoch_record_release_(struct epoch_record *rec)
+{
+    __atomic_store_n(&rec->state, 0, __ATOMIC_RELEASE);
+    rec->nest = 0;
+    if (!(__atomic_fetch_and(&rec->flags, ~EPOCH_REC_HELD, __ATOMIC_ACQ_REL) & EPOCH_REC_DOMAIN)) {
+        free(rec);
+    }
+}
+
+// The thread exits, release every record it holds.
+static void epoch_thread_exit_(void *arg)
+{
+    struct epoch_entry *entry = arg;
+    struct epoch_entry *next;
+
+    for (; entry; entry = next) {
+        next = entry->next;
+        epoch_record_release_(entry->rec);
+        free(entry);
+    }
+    epoch_entries_ = NULL;
+    epoch_last_ = NULL;
+}
+
+static void epoch_key_init_(void)
+{
+    epoch_key_err_ = pthread_key_create(&epoch_key_, epoch_thread_exit_);
+}
+
+// A record whose domain was destroyed is released here. A domain created later at the same
+// address therefore never matches a stale entry.
+static inline bool epoch_entry_live_(struct epoch_entry *entry)
+{
+    return __atomic_load_n(&entry->rec->flags, __ATOMIC_ACQUIRE) & EPOCH_REC_DOMAIN;
+}
+
+// Find the record of the calling thread in the domain, NULL if it has none yet.
+static struct epoch_record *epoch_record_find_(epoch_domain_t *domain)
+{
+    struct epoch_entry **link = &epoch_entries_;
+    struct epoch_entry *entry;
+
+    if (epoch_last_ && epoch_last_->domain == domain && epoch_entry_live_(epoch_last_)) {
+        return epoch_last_->rec;
+    }
+    epoch_last_ = NULL;
+    while ((entry = *link) != NULL) {
+        if (!epoch_entry_live_(entry)) {
+            *link = entry->next;
+            epoch_record_release_(entry->rec);
+            free(entry);
+            continue;
+        }
+        if (entry->domain == domain) {
+            epoch_last_ = entry;
+            return entry->rec;
+        }
+        link = &entry->next;
+    }
+    return NULL;
+}
+
+static struct epoch_record *epoch_record_get_(epoch_domain_t *domain)
+{
+    struct epoch_record *rec = epoch_record_find_(domain);
+    struct epoch_entry *entry;
+    uint32_t flags;
+
+    if (rec) {
+        return rec;
+    }
+    entry = malloc(sizeof(struct epoch_entry));
+    if (!entry) {
+        return NULL;
+    }
+    if (pthread_setspecific(epoch_key_, entry) != 0) {
+        free(entry);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&domain->mutex);
+    for (rec = domain->records; rec; rec = rec->next) {
+        flags = EPOCH_REC_DOMAIN;
+        if (__atomic_compare_exchange_n(&rec->flags, &flags, EPOCH_REC_DOMAIN | EPOCH_REC_HELD,
+                                        false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+    if (!rec) {
+        if (posix_memalign((void **)&rec, EPOCH_CACHELINE, sizeof(struct epoch_record)) != 0) {
+            pthread_mutex_unlock(&domain->mutex);
+            pthread_setspecific(epoch_key_, epoch_entries_);
+            free(entry);
+            return NULL;
+        }
+        memset(rec, 0, sizeof(struct epoch_record));
+        rec->flags = EPOCH_REC_DOMAIN | EPOCH_REC_HELD;
+        rec->next = domain->records;
+        domain->records = rec;
+    }
+    pthread_mutex_unlock(&domain->mutex);
+
+    entry->domain = domain;
+    entry->rec = rec;
+    entry->next = epoch_entries_;
+    epoch_entries_ = entry;
+    epoch_last_ = entry;
+    return rec;
+}
+
+static void epoch_limbo_free_(struct epoch_limbo *limbo)
+{
+    size_t i;
+
+    for (i = 0; i < limbo->count; i++) {
+        limbo->objs[i].free_fn(limbo->objs[i].ptr, limbo->objs[i].ctx);
+    }
+    limbo->count = 0;
+}
+
+// The epoch can only move forward when every active reader has observed the current one.
+static bool epoch_try_advance_(epoch_domain_t *domain)
+{
+    struct epoch_record *rec;
+    uint64_t epoch = __atomic_load_n(&domain->epoch, __ATOMIC_RELAXED);
+    uint64_t state;
+    struct epoch_limbo *limbo;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    pthread_mutex_lock(&domain->mutex);
+    for (rec = domain->records; rec; rec = rec->next) {
+        state = __atomic_load_n(&rec->state, __ATOMIC_ACQUIRE);
+        if ((state & 1) && (state >> 1) != epoch) {
+            pthread_mutex_unlock(&domain->mutex);
+            return false;
+        }
+    }
+    pthread_mutex_unlock(&domain->mutex);
+
+    __atomic_store_n(&domain->epoch, epoch + 1, __ATOMIC_RELEASE);
+    // The objects retired two epochs ago are not reachable by any reader now.
+    limbo = &domain->limbo[(epoch + 2) % EPOCH_NR_LIMBO];
+    domain->nr_pending -= limbo->count;
+    epoch_limbo_free_(limbo);
+    return true;
+}
+
+epoch_domain_t *epoch_domain_create(void)
+{
+    epoch_domain_t *domain = NULL;
+
+    if (posix_memalign((void **)&domain, EPOCH_CACHELINE, sizeof(epoch_domain_t)) != 0) {
+        return NULL;
+    }
+    memset(domain, 0, sizeof(epoch_domain_t));
+    if (pthread_once(&epoch_key_once_, epoch_key_init_) != 0 || epoch_key_err_ != 0) {
+        goto err0;
+    }
+    if (pthread_mutex_init(&domain->mutex, NULL) != 0) {
+        goto err0;
+    }
+
+    return domain;
+err0:
+    free(domain);
+    return NULL;
+}
+
+void epoch_domain_destroy(epoch_domain_t *domain)
+{
+    struct epoch_record *rec;
+    int i;
+
+    if (!domain) {
+        return;
+    }
+
+    for (i = 0; i < EPOCH_NR_LIMBO; i++) {
+        epoch_limbo_free_(&domain->limbo[i]);
+        free(domain->limbo[i].objs);
+    }
+    // A record still held by a live thread is freed by that thread, on its next lookup in any
+    // domain or when it exits.
+    while ((rec = domain->records) != NULL) {
+        domain->records = rec->next;
+        if (!(__atomic_fetch_and(&rec->flags, ~EPOCH_REC_DOMAIN, __ATOMIC_ACQ_REL) &
+              EPOCH_REC_HELD)) {
+            free(rec);
+        }
+    }
+    pthread_mutex_destroy(&domain->mutex);
+    free(domain);
+}
+
+int epoch_enter(epoch_domain_t *domain)
+{
+    struct epoch_record *rec = epoch_record_get_(domain);
+    if (!rec) {
+        return -1;
+    }
+
+    if (rec->nest++ == 0) {
+        __atomic_store_n(&rec->state, (__atomic_load_n(&domain->epoch, __ATOMIC_RELAXED) << 1) | 1,
+                         __ATOMIC_RELAXED);
+        // The record must be visible before any shared object is read.
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    }
+    return 0;
+}
+
+void epoch_exit(epoch_domain_t *domain)
+{
+    struct epoch_record *rec = epoch_record_find_(domain);
+    if (!rec || rec->nest == 0) {
+        return;
+    }
+
+    if (--rec->nest == 0) {
+        __atomic_store_n(&rec->state, 0, __ATOMIC_RELEASE);
+    }
+}
+
+int epoch_retire(epoch_domain_t *domain, void *ptr, void (*free_fn)(void *ptr, void *ctx),
+                 void *ctx)
+{
+    uint64_t epoch = __atomic_load_n(&domain->epoch, __ATOMIC_RELAXED);
+    struct epoch_limbo *limbo = &domain->limbo[epoch % EPOCH_NR_LIMBO];
+    struct epoch_retired *objs;
+    size_t cap;
+
+    if (limbo->count == limbo->cap) {
+        cap = limbo->cap ? limbo->cap * 2 : EPOCH_RECLAIM_BATCH;
+        objs = realloc(limbo->objs, cap * sizeof(struct epoch_retired));
+        if (!objs) {
+            // Wait until the readers of the current epoch are gone, then free it here.
+            while (__atomic_load_n(&domain->epoch, __ATOMIC_RELAXED) < epoch + 2) {
+                if (!epoch_try_advance_(domain)) {
+                    sched_yield();
+                }
+            }
+            free_fn(ptr, ctx);
+            return -1;
+        }
+        limbo->objs = objs;
+        limbo->cap = cap;
+    }
+    limbo->objs[limbo->count].ptr = ptr;
+    limbo->objs[limbo->count].free_fn = free_fn;
+    limbo->objs[limbo->count].ctx = ctx;
+    limbo->count++;
+    domain->nr_pending++;
+
+    if (++domain->nr_retired >= EPOCH_RECLAIM_BATCH) {
+        epoch_reclaim(domain);
+    }
+    return 0;
+}
+
+size_t epoch_reclaim(epoch_domain_t *domain)
+{
+    if (!domain) {
+        return 0;
+    }
+
+    domain->nr_retired = 0;
+    epoch_try_advance_(domain);
+    return domain->nr_pending;
+}
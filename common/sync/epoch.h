@@ -0,0 +1,91 @@
+/**
+ * @file epoch.h
+ * @author zishu (zishuzy@gmail.com)
+ * @brief Epoch based memory reclamation for lock-free readers.
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#ifndef COMMON_SYNC_EPOCH
+#define COMMON_SYNC_EPOCH
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct epoch_domain epoch_domain_t;
+
+/**
+ * @brief Create a reclamation domain.
+ *
+ * Readers wrap every access to shared objects with epoch_enter/epoch_exit. Writers unlink an
+ * object first and then hand it to epoch_retire, the object is freed only after every reader
+ * that could still see it has left its critical section.
+ *
+ * @return epoch_domain_t* On success, the domain is returned. On error, NULL is returned.
+ */
+epoch_domain_t *epoch_domain_create(void);
+
+/**
+ * @brief Destroy the domain, every retired object is freed.
+ *
+ * No thread may be inside a critical section of the domain during or after the call.
+ *
+ * @param domain
+ */
+void epoch_domain_destroy(epoch_domain_t *domain);
+
+/**
+ * @brief Enter a read-side critical section, the calls may be nested.
+ *
+ * A thread is registered to the domain on its first call, later calls do not touch any cache
+ * line shared with other readers. The thread must not block on a lock held by a retiring
+ * thread inside the critical section, epoch_retire may wait for it.
+ *
+ * @param domain
+ * @return int 0 on success, -1 if the thread could not be registered.
+ */
+int epoch_enter(epoch_domain_t *domain);
+
+/**
+ * @brief Leave the read-side critical section entered by epoch_enter.
+ *
+ * @param domain
+ */
+void epoch_exit(epoch_domain_t *domain);
+
+/**
+ * @brief Free "ptr" with "free_fn(ptr, ctx)" once no reader can reference it any more.
+ *
+ * The retired objects are reclaimed in batches by the thread calling epoch_retire, so free_fn
+ * runs in the context of a retiring thread (or of epoch_domain_destroy). Calls must be
+ * serialized by the caller, usually by the writer lock of the protected structure.
+ *
+ * @param domain
+ * @param ptr
+ * @param free_fn
+ * @param ctx
+ * @return int 0 on success. If the object could not be queued, -1 is returned after waiting
+ *         for the readers and freeing it synchronously.
+ */
+int epoch_retire(epoch_domain_t *domain, void *ptr, void (*free_fn)(void *ptr, void *ctx),
+                 void *ctx);
+
+/**
+ * @brief Try to advance the global epoch and free the objects that became unreachable.
+ *
+ * @param domain
+ * @return size_t The number of objects still waiting to be freed.
+ */
+size_t epoch_reclaim(epoch_domain_t *domain);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COMMON_SYNC_EPOCH */
@@ -0,0 +1,195 @@
+/**
+ * @file rwlock.c
+ * @author zishu (zishuzy@gmail.com)
+ * @brief Reader-writer locks with selectable policies.
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#include "rwlock.h"
+
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RWLOCK_CACHELINE 64
+#define RWLOCK_NR_SLOTS  64  // Threads beyond this many share reader counters.
+#define RWLOCK_SPINS     128 // Busy wait this many rounds before yielding the CPU.
+
+struct rwlock_slot {
+    uint64_t readers;
+} __attribute__((aligned(RWLOCK_CACHELINE)));
+
+// RWLOCK_QUEUED: every thread takes a ticket from "users". A writer waits until "write" reaches
+// its ticket, a reader until "read" does and then lets the next ticket read as well. Releasing
+// a read lock advances "write", releasing the write lock advances both.
+
+static unsigned rwlock_slot_next_;
+static __thread unsigned rwlock_slot_id_; // 0 before the first read lock of the thread.
+static __thread char rwlock_self_;        // Its address identifies the thread.
+
+static inline void rwlock_pause_(unsigned *spins)
+{
+    if (++*spins < RWLOCK_SPINS) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    } else {
+        *spins = 0;
+        sched_yield();
+    }
+}
+
+static inline struct rwlock_slot *rwlock_slot_(rwlock_t *lock)
+{
+    if (rwlock_slot_id_ == 0) {
+        rwlock_slot_id_ = __atomic_add_fetch(&rwlock_slot_next_, 1, __ATOMIC_RELAXED);
+    }
+    return &lock->slots[rwlock_slot_id_ & (RWLOCK_NR_SLOTS - 1)];
+}
+
+int rwlock_init(rwlock_t *lock, int kind)
+{
+    memset(lock, 0, sizeof(rwlock_t));
+    lock->kind = kind;
+    switch (kind) {
+    case RWLOCK_PTHREAD:
+        return pthread_rwlock_init(&lock->rw, NULL) == 0 ? 0 : -1;
+    case RWLOCK_BRLOCK:
+        if (posix_memalign((void **)&lock->slots, RWLOCK_CACHELINE,
+                           RWLOCK_NR_SLOTS * sizeof(struct rwlock_slot)) != 0) {
+            return -1;
+        }
+        memset(lock->slots, 0, RWLOCK_NR_SLOTS * sizeof(struct rwlock_slot));
+        if (pthread_mutex_init(&lock->wmutex, NULL) != 0) {
+            free(lock->slots);
+            return -1;
+        }
+        return 0;
+    case RWLOCK_QUEUED:
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+void rwlock_destroy(rwlock_t *lock)
+{
+    switch (lock->kind) {
+    case RWLOCK_PTHREAD:
+        pthread_rwlock_destroy(&lock->rw);
+        break;
+    case RWLOCK_BRLOCK:
+        pthread_mutex_destroy(&lock->wmutex);
+        free(lock->slots);
+        break;
+    default:
+        break;
+    }
+}
+
+void rwlock_rdlock(rwlock_t *lock)
+{
+    struct rwlock_slot *slot;
+    unsigned spins = 0;
+    uint16_t me;
+
+    switch (lock->kind) {
+    case RWLOCK_PTHREAD:
+        pthread_rwlock_rdlock(&lock->rw);
+        break;
+    case RWLOCK_BRLOCK:
+        slot = rwlock_slot_(lock);
+        for (;;) {
+            // Pairs with the writer raising the flag and then reading the counters: either the
+            // writer sees this reader or the reader sees the flag.
+            __atomic_fetch_add(&slot->readers, 1, __ATOMIC_SEQ_CST);
+            if (!__atomic_load_n(&lock->writer, __ATOMIC_SEQ_CST)) {
+                break;
+            }
+            __atomic_fetch_sub(&slot->readers, 1, __ATOMIC_RELEASE);
+            while (__atomic_load_n(&lock->writer, __ATOMIC_RELAXED)) {
+                rwlock_pause_(&spins);
+            }
+        }
+        break;
+    case RWLOCK_QUEUED:
+        me = __atomic_fetch_add(&lock->ticket.users, 1, __ATOMIC_RELAXED);
+        while (__atomic_load_n(&lock->ticket.read, __ATOMIC_ACQUIRE) != me) {
+            rwlock_pause_(&spins);
+        }
+        __atomic_fetch_add(&lock->ticket.read, 1, __ATOMIC_RELAXED);
+        break;
+    default:
+        break;
+    }
+}
+
+void rwlock_wrlock(rwlock_t *lock)
+{
+    unsigned spins = 0;
+    uint16_t me;
+    int i;
+
+    switch (lock->kind) {
+    case RWLOCK_PTHREAD:
+        pthread_rwlock_wrlock(&lock->rw);
+        break;
+    case RWLOCK_BRLOCK:
+        pthread_mutex_lock(&lock->wmutex);
+        __atomic_store_n(&lock->writer, 1, __ATOMIC_SEQ_CST);
+        for (i = 0; i < RWLOCK_NR_SLOTS; i++) {
+            while (__atomic_load_n(&lock->slots[i].readers, __ATOMIC_ACQUIRE) != 0) {
+                rwlock_pause_(&spins);
+            }
+        }
+        break;
+    case RWLOCK_QUEUED:
+        me = __atomic_fetch_add(&lock->ticket.users, 1, __ATOMIC_RELAXED);
+        while (__atomic_load_n(&lock->ticket.write, __ATOMIC_ACQUIRE) != me) {
+            rwlock_pause_(&spins);
+        }
+        break;
+    default:
+        return;
+    }
+    __atomic_store_n(&lock->owner, &rwlock_self_, __ATOMIC_RELAXED);
+}
+
+void rwlock_unlock(rwlock_t *lock)
+{
+    // Only the writer itself can see its own address here, readers never hold the lock
+    // together with a writer.
+    int write = __atomic_load_n(&lock->owner, __ATOMIC_RELAXED) == &rwlock_self_;
+
+    if (write) {
+        __atomic_store_n(&lock->owner, NULL, __ATOMIC_RELAXED);
+    }
+    switch (lock->kind) {
+    case RWLOCK_PTHREAD:
+        pthread_rwlock_unlock(&lock->rw);
+        break;
+    case RWLOCK_BRLOCK:
+        if (write) {
+            __atomic_store_n(&lock->writer, 0, __ATOMIC_RELEASE);
+            pthread_mutex_unlock(&lock->wmutex);
+        } else {
+            __atomic_fetch_sub(&rwlock_slot_(lock)->readers, 1, __ATOMIC_RELEASE);
+        }
+        break;
+    case RWLOCK_QUEUED:
+        if (write) {
+            // Readers let in by the first add may also release before the second, "write" only
+            // reaches the next writer's ticket after both.
+            __atomic_fetch_add(&lock->ticket.read, 1, __ATOMIC_RELEASE);
+            __atomic_fetch_add(&lock->ticket.write, 1, __ATOMIC_RELEASE);
+        } else {
+            __atomic_fetch_add(&lock->ticket.write, 1, __ATOMIC_RELEASE);
+        }
+        break;
+    default:
+        break;
+    }
+}
@@ -0,0 +1,93 @@
+/**
+ * @file rwlock.h
+ * @author zishu (zishuzy@gmail.com)
+ * @brief Reader-writer locks with selectable policies.
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#ifndef COMMON_SYNC_RWLOCK
+#define COMMON_SYNC_RWLOCK
+
+#include <pthread.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// pthread_rwlock_t, readers share one word. glibc prefers readers, read locks may nest.
+#define RWLOCK_PTHREAD 0
+// Big-reader lock: every thread counts its readers on a cache line of its own, a read lock
+// never writes a line shared with other readers. Writers are serialized by a mutex, they raise
+// a flag and wait until every counter drains, so writes are expensive and writers go first.
+#define RWLOCK_BRLOCK  1
+// Queued ticket lock: threads are served in arrival order, consecutive readers share a turn.
+// A waiting writer blocks readers arriving after it, so writers are never starved. Waiters
+// spin and then yield; when threads outnumber CPUs the handoff waits for the next thread in line
+// to be scheduled and throughput drops sharply.
+#define RWLOCK_QUEUED  2
+
+struct rwlock_slot;
+
+typedef struct rwlock {
+    int kind;
+    pthread_rwlock_t rw;       // RWLOCK_PTHREAD
+    struct rwlock_slot *slots; // RWLOCK_BRLOCK, one reader counter per slot
+    pthread_mutex_t wmutex;    // RWLOCK_BRLOCK, serializes writers
+    uint32_t writer;           // RWLOCK_BRLOCK, a writer holds or waits for the lock
+    struct {
+        uint16_t write;
+        uint16_t read;
+        uint16_t users;
+    } ticket;                  // RWLOCK_QUEUED, see rwlock.c
+    const void *owner;         // The thread holding the write lock, used by rwlock_unlock.
+} rwlock_t;
+
+/**
+ * @brief Initialize the lock.
+ *
+ * @param lock
+ * @param kind RWLOCK_PTHREAD, RWLOCK_BRLOCK or RWLOCK_QUEUED.
+ * @return int 0 on success, -1 if kind is unknown or out of memory.
+ */
+int rwlock_init(rwlock_t *lock, int kind);
+
+/**
+ * @brief Destroy the lock, it must not be held.
+ *
+ * @param lock
+ */
+void rwlock_destroy(rwlock_t *lock);
+
+/**
+ * @brief Acquire the lock for reading.
+ *
+ * With RWLOCK_BRLOCK and RWLOCK_QUEUED a thread already holding the read lock deadlocks if it
+ * reads again while a writer waits. The lock must be released by the thread that acquired it.
+ *
+ * @param lock
+ */
+void rwlock_rdlock(rwlock_t *lock);
+
+/**
+ * @brief Acquire the lock for writing, not recursive.
+ *
+ * @param lock
+ */
+void rwlock_wrlock(rwlock_t *lock);
+
+/**
+ * @brief Release a read or write lock held by the calling thread.
+ *
+ * @param lock
+ */
+void rwlock_unlock(rwlock_t *lock);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COMMON_SYNC_RWLOCK */
@@ -22,6 +22,23 @@ queue_t *queue_create(void)
     q->size = 0;
     q->front = NULL;
     q->tail = NULL;
+    q->pool = NULL;
+
+    return q;
+}
+
+queue_t *queue_create_pooled(void)
+{
+    queue_t *q = queue_create();
+    if (!q) {
+        return q;
+    }
+
+    q->pool = slab_pool_create(sizeof(queue_node_t), 0);
+    if (!q->pool) {
+        free(q);
+        return NULL;
+    }
 
     return q;
 }
@@ -33,14 +50,17 @@ void queue_free(queue_t *q, void (*cb)(queue_node_t *node, void *ctx), void *ctx
     }
     queue_node_t *head = q->front;
     queue_node_t *node;
-    for (node = head; node != NULL; node = head) {
-
+    // The nodes from the pool are released with the pool, they are only visited for "cb".
+    for (node = head; node != NULL && (cb || !q->pool); node = head) {
         if (cb) {
             cb(node, ctx);
         }
         head = node->next;
-        free(node);
+        if (!q->pool) {
+            free(node);
+        }
     }
+    slab_pool_destroy(q->pool);
     free(q);
 }
 
@@ -65,6 +85,34 @@ void queue_node_free(queue_node_t *node)
     free(node);
 }
 
+queue_node_t *queue_node_alloc(queue_t *q, void *data)
+{
+    queue_node_t *node;
+
+    if (!q || !q->pool) {
+        return queue_node_create(data);
+    }
+
+    node = slab_alloc(q->pool);
+    if (!node) {
+        return node;
+    }
+
+    node->data = data;
+    node->next = NULL;
+
+    return node;
+}
+
+void queue_node_release(queue_t *q, queue_node_t *node)
+{
+    if (!q || !q->pool) {
+        queue_node_free(node);
+        return;
+    }
+    slab_free(q->pool, node);
+}
+
 int queue_enqueue(queue_t *q, queue_node_t *node)
 {
     if (!q || !node) {
@@ -13,6 +13,8 @@
 
 #include <stdint.h>
 
+#include "common/slab/slab.h"
+
 typedef struct queue_node {
     struct queue_node *next;
     void *data;
@@ -22,6 +24,7 @@ typedef struct queue {
     queue_node_t *front;
     queue_node_t *tail;
     uint32_t size;
+    slab_pool_t *pool; // Node pool of the queue, NULL if the nodes are allocated by malloc.
 } queue_t;
 
 /**
@@ -31,6 +34,16 @@ typedef struct queue {
  */
 queue_t *queue_create(void);
 
+/**
+ * @brief Create a queue whose nodes are allocated from a private pool.
+ *
+ * The nodes of the queue must be created by queue_node_alloc and released by queue_node_release,
+ * the nodes still in the queue are released at once by queue_free.
+ *
+ * @return queue_t*
+ */
+queue_t *queue_create_pooled(void);
+
 /**
  * @brief Free the queue.
  *
@@ -55,6 +68,23 @@ queue_node_t *queue_node_create(void *data);
  */
 void queue_node_free(queue_node_t *node);
 
+/**
+ * @brief Create a node for the queue, from the pool of the queue if it has one.
+ *
+ * @param q
+ * @param data
+ * @return queue_node_t*
+ */
+queue_node_t *queue_node_alloc(queue_t *q, void *data);
+
+/**
+ * @brief Release the node created by queue_node_alloc.
+ *
+ * @param q
+ * @param node
+ */
+void queue_node_release(queue_t *q, queue_node_t *node);
+
 /**
  * @brief Enqueue the node into the queue.
  *
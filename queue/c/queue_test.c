@@ -62,5 +62,25 @@ int main(void)
 
     queue_free(q, NULL, NULL);
 
+    q = queue_create_pooled();
+    if (!q) {
+        LOG_ERROR("Failed to create pooled queue!");
+        return 1;
+    }
+    for (i = 0; i < 10; i++) {
+        node = queue_node_alloc(q, (void *)i);
+        if (!node || queue_enqueue(q, node) < 0) {
+            LOG_ERROR("Failed to enqueue node to the pooled queue! i[%ld]", i);
+            queue_node_release(q, node);
+        }
+    }
+    while (queue_size(q) > 5) {
+        node = queue_dequeue(q);
+        LOG_INFO("Dequeue the node from the pooled queue. node->data[%ld]", (long)node->data);
+        queue_node_release(q, node);
+    }
+    // The remaining nodes are released with the pool.
+    queue_free(q, NULL, NULL);
+
     return 0;
 }
\ No newline at end of file
@@ -10,6 +10,7 @@
  */
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "queue/c/queue.h"
 
@@ -41,9 +42,22 @@ static void avltree_print_helper_(avltree_node_t *node, int depth, int *arr_flag
     avltree_print_helper_(node->left, depth + 1, arr_flag, cb_print, ctx);
 }
 
-static int avltree_balance_factor_(avltree_node_t *root)
+static inline uint32_t avltree_height_(avltree_node_t *node)
 {
-    return avltree_depth(root->left) - avltree_depth(root->right);
+    return node ? node->height : 0;
+}
+
+static inline void avltree_update_height_(avltree_node_t *node)
+{
+    uint32_t left_height = avltree_height_(node->left);
+    uint32_t right_height = avltree_height_(node->right);
+
+    node->height = 1 + (left_height > right_height ? left_height : right_height);
+}
+
+static inline int avltree_balance_factor_(avltree_node_t *root)
+{
+    return (int)avltree_height_(root->left) - (int)avltree_height_(root->right);
 }
 
 static avltree_node_t *avltree_rotation_rr_(avltree_node_t *root)
@@ -52,6 +66,8 @@ static avltree_node_t *avltree_rotation_rr_(avltree_node_t *root)
     node = root->right;
     root->right = node->left;
     node->left = root;
+    avltree_update_height_(root); // root 已经成为 node 的子节点，需要先更新
+    avltree_update_height_(node);
     return node;
 }
 
@@ -61,6 +77,8 @@ static avltree_node_t *avltree_rotation_ll_(avltree_node_t *root)
     node = root->left;
     root->left = node->right;
     node->right = root;
+    avltree_update_height_(root); // root 已经成为 node 的子节点，需要先更新
+    avltree_update_height_(node);
     return node;
 }
 
@@ -78,12 +96,15 @@ static avltree_node_t *avltree_rotation_rl_(avltree_node_t *root)
 
 static avltree_node_t *avltree_balance_(avltree_node_t *root)
 {
-    int diff_depth = avltree_balance_factor_(root); // 计算平衡因子（左右子树高度差）
-    if (diff_depth > 1) {                           // 左子树高于右子树
-        if (avltree_balance_factor_(root->left) > 0) { // 左左外侧
-            root = avltree_rotation_ll_(root);         // 右旋
-        } else {                                       // 左右内侧
-            root = avltree_rotation_lr_(root);         // 先左旋后右旋
+    int diff_depth;
+
+    avltree_update_height_(root);                       // 子树已经变化，先刷新缓存的高度
+    diff_depth = avltree_balance_factor_(root);         // 计算平衡因子（左右子树高度差）
+    if (diff_depth > 1) {                               // 左子树高于右子树
+        if (avltree_balance_factor_(root->left) >= 0) { // 左左外侧
+            root = avltree_rotation_ll_(root);          // 右旋
+        } else {                                        // 左右内侧
+            root = avltree_rotation_lr_(root);          // 先左旋后右旋
         }
     } else if (diff_depth < -1) {                       // 右子树高于左子树
         if (avltree_balance_factor_(root->right) > 0) { // 右左内侧
@@ -109,6 +130,7 @@ avltree_node_t *avltree_node_create(void *key, uint32_t key_len, void *val, uint
     node->parent = NULL;
     node->left = NULL;
     node->right = NULL;
+    node->height = 1;
 
     return node;
 }
@@ -234,14 +256,33 @@ avltree_node_t *avltree_find(avltree_node_t *root, void *key, uint32_t key_len,
 
 uint32_t avltree_depth(avltree_node_t *root)
 {
-    uint32_t left_depth, right_depth;
-    if (!root) {
-        return 0;
+    return avltree_height_(root);
+}
+
+static void avltree_stats_helper_(avltree_node_t *node, uint32_t depth,
+                                  size_t (*cb_size)(avltree_node_t *node, void *ctx), void *ctx,
+                                  avltree_stats_t *stats, size_t *depth_sum)
+{
+    if (!node) {
+        return;
     }
-    left_depth = avltree_depth(root->left);
-    right_depth = avltree_depth(root->right);
+    stats->nr_nodes++;
+    *depth_sum += depth;
+    stats->data_bytes += cb_size ? cb_size(node, ctx) : (size_t)node->key_len + node->val_len;
+    avltree_stats_helper_(node->left, depth + 1, cb_size, ctx, stats, depth_sum);
+    avltree_stats_helper_(node->right, depth + 1, cb_size, ctx, stats, depth_sum);
+}
 
-    return 1 + (left_depth > right_depth ? left_depth : right_depth);
+void avltree_stats(avltree_node_t *root, size_t (*cb_size)(avltree_node_t *node, void *ctx),
+                   void *ctx, avltree_stats_t *stats)
+{
+    size_t depth_sum = 0;
+
+    memset(stats, 0, sizeof(avltree_stats_t));
+    avltree_stats_helper_(root, 1, cb_size, ctx, stats, &depth_sum);
+    stats->node_bytes = stats->nr_nodes * sizeof(avltree_node_t);
+    stats->max_depth = avltree_height_(root); // The height is cached in every node.
+    stats->avg_depth = stats->nr_nodes ? (double)depth_sum / stats->nr_nodes : 0.0;
 }
 
 void avltree_preorder(avltree_node_t *root, int (*cb)(avltree_node_t *node, void *ctx), void *ctx)
@@ -291,18 +332,18 @@ void avltree_levelorder(avltree_node_t *root, int (*cb)(avltree_node_t *node, vo
         return;
     }
 
-    q = queue_create();
+    q = queue_create_pooled();
     if (!q) {
         return;
     }
 
     do {
-        qnode = queue_node_create(root);
+        qnode = queue_node_alloc(q, root);
         if (!qnode) {
             break;
         }
         if (queue_enqueue(q, qnode) < 0) {
-            queue_node_free(qnode);
+            queue_node_release(q, qnode);
             break;
         }
 
@@ -312,18 +353,18 @@ void avltree_levelorder(avltree_node_t *root, int (*cb)(avltree_node_t *node, vo
                 continue;
             }
             root = qnode->data;
-            queue_node_free(qnode);
+            queue_node_release(q, qnode);
 
             if (cb(root, ctx)) {
                 break;
             }
 
             if (root->left) {
-                qnode = queue_node_create(root->left);
+                qnode = queue_node_alloc(q, root->left);
                 queue_enqueue(q, qnode);
             }
             if (root->right) {
-                qnode = queue_node_create(root->right);
+                qnode = queue_node_alloc(q, root->right);
                 queue_enqueue(q, qnode);
             }
         }
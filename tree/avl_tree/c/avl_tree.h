@@ -11,8 +11,13 @@
 #ifndef C_AVL_TREE
 #define C_AVL_TREE
 
+#include <stddef.h>
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 typedef struct avltree_node {
     struct avltree_node *parent;
     struct avltree_node *left;
@@ -21,6 +26,7 @@ typedef struct avltree_node {
     uint32_t key_len;
     void *val;
     uint32_t val_len;
+    uint32_t height; // Height of the subtree rooted at this node, a leaf is 1.
 } avltree_node_t;
 
 /**
@@ -113,13 +119,33 @@ avltree_node_t *avltree_find(avltree_node_t *root, void *key, uint32_t key_len,
                                          uint32_t right_len));
 
 /**
- * @brief Get the depth for the avl tree.
+ * @brief Get the depth for the avl tree. The height is cached in every node, so this is O(1).
  *
  * @param root
  * @return uint32_t
  */
 uint32_t avltree_depth(avltree_node_t *root);
 
+typedef struct avltree_stats {
+    size_t nr_nodes;
+    size_t node_bytes;  // Bytes taken by the nodes themselves.
+    size_t data_bytes;  // Bytes taken by the keys and values, see avltree_stats.
+    uint32_t max_depth; // The root is at depth 1.
+    double avg_depth;
+} avltree_stats_t;
+
+/**
+ * @brief Collect the memory usage and shape of the avl tree. The tree is a bare root node with
+ *        no place to keep a count, so every node is visited, O(n).
+ *
+ * @param root
+ * @param cb_size Bytes taken by the key and value of a node. If NULL, key_len + val_len is used.
+ * @param ctx
+ * @param stats
+ */
+void avltree_stats(avltree_node_t *root, size_t (*cb_size)(avltree_node_t *node, void *ctx),
+                   void *ctx, avltree_stats_t *stats);
+
 /**
  * @brief Preorder traverse the avl tree.
  *
@@ -177,4 +203,8 @@ void avltree_levelorder2(avltree_node_t *root,
 void avltree_print(avltree_node_t *root, void (*cb_print)(avltree_node_t *node, void *ctx),
                    void *ctx);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* C_AVL_TREE */
@@ -0,0 +1,101 @@
+/**
+ * @file avl_tree_bench.c
+ * @author zishu (zishuzy@gmail.com)
+ * @brief Insert benchmark for the avl tree implemented in C.
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <math.h>
+
+#include "common/log/log.h"
+
+#include "avl_tree.h"
+
+#define BENCH_MIN_KEYS     1000UL
+#define BENCH_DEFAULT_KEYS 10000000UL
+
+static int less(void *left_key, uint32_t left_len, void *right_key, uint32_t right_len)
+{
+    (void)left_len;
+    (void)right_len;
+    return (long)left_key < (long)right_key;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000UL + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t xorshift64(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+/**
+ * @brief Insert "n" random keys into an empty tree, return the cost of one insert in ns.
+ *
+ * @param n
+ * @param depth Output the depth of the tree.
+ * @return double
+ */
+static double bench_insert(unsigned long n, uint32_t *depth)
+{
+    avltree_node_t *root = NULL;
+    avltree_node_t *node;
+    uint64_t seed = 0x9e3779b97f4a7c15UL;
+    uint64_t begin, end;
+    unsigned long i;
+
+    begin = now_ns();
+    for (i = 0; i < n; i++) {
+        // 最高位清零，保证 key 作为 long 比较时为正数
+        long key = (long)(xorshift64(&seed) >> 1);
+        node = avltree_insert(root, (void *)key, 0, NULL, 0, less);
+        if (node) {
+            root = node;
+        }
+    }
+    end = now_ns();
+
+    *depth = avltree_depth(root);
+    avltree_destroy(root, NULL, NULL);
+
+    return (double)(end - begin) / (double)n;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long max_keys = BENCH_DEFAULT_KEYS;
+    unsigned long n;
+    uint32_t depth;
+    double ns;
+
+    if (argc > 1) {
+        max_keys = strtoul(argv[1], NULL, 10);
+    }
+    if (max_keys < BENCH_MIN_KEYS) {
+        max_keys = BENCH_MIN_KEYS;
+    }
+
+    LOG_INFO("avl tree insert benchmark, keys: [%lu, %lu]", BENCH_MIN_KEYS, max_keys);
+    printf("%12s %8s %14s %16s\n", "keys", "depth", "ns/insert", "ns/insert/log2n");
+    for (n = BENCH_MIN_KEYS; n <= max_keys; n *= 10) {
+        ns = bench_insert(n, &depth);
+        printf("%12lu %8u %14.1f %16.2f\n", n, depth, ns, ns / log2((double)n));
+    }
+
+    return 0;
+}
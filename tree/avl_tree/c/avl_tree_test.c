@@ -41,6 +41,7 @@ int main(void)
     avltree_node_t *root = NULL;
     avltree_node_t *node;
     int result;
+    avltree_stats_t stats;
 
     srand((int)time(NULL));
 
@@ -78,6 +79,10 @@ int main(void)
     node = avltree_find(root, (void *)(tmp + 1), 0, less);
     LOG_INFO("find node key[%ld], node[0x%08lx]", (tmp + 1), (long)node);
 
+    avltree_stats(root, NULL, NULL, &stats);
+    LOG_INFO("nodes[%zu], node bytes[%zu], max depth[%u], avg depth[%.2f]", stats.nr_nodes,
+             stats.node_bytes, stats.max_depth, stats.avg_depth);
+
     avltree_destroy(root, NULL, NULL);
 
     return 0;
@@ -9,6 +9,7 @@
  *
  */
 #include <stdlib.h>
+#include <string.h>
 
 #include "common/log/log.h"
 
@@ -186,6 +187,61 @@ uint32_t bstree_depth(bstree_node_t *root)
     return 1 + (left_depth > right_depth ? left_depth : right_depth);
 }
 
+int bstree_stats(bstree_node_t *root, size_t (*cb_size)(bstree_node_t *node, void *ctx),
+                 void *ctx, bstree_stats_t *stats)
+{
+    struct {
+        bstree_node_t *node;
+        uint32_t depth;
+    } *stack = NULL, *tmp;
+    size_t top = 0, cap = 64, depth_sum = 0;
+    bstree_node_t *node;
+    uint32_t depth;
+
+    memset(stats, 0, sizeof(bstree_stats_t));
+    if (!root) {
+        return 0;
+    }
+    stack = malloc(cap * sizeof(*stack));
+    if (!stack) {
+        return -1;
+    }
+    stack[top].node = root;
+    stack[top++].depth = 1;
+    while (top > 0) {
+        node = stack[--top].node;
+        depth = stack[top].depth;
+        // Walk down the left spine, the right children wait on the stack.
+        for (; node; node = node->left, depth++) {
+            stats->nr_nodes++;
+            depth_sum += depth;
+            if (depth > stats->max_depth) {
+                stats->max_depth = depth;
+            }
+            stats->data_bytes +=
+                cb_size ? cb_size(node, ctx) : (size_t)node->key_len + node->val_len;
+            if (!node->right) {
+                continue;
+            }
+            if (top == cap) {
+                tmp = realloc(stack, 2 * cap * sizeof(*stack));
+                if (!tmp) {
+                    free(stack);
+                    return -1;
+                }
+                stack = tmp;
+                cap *= 2;
+            }
+            stack[top].node = node->right;
+            stack[top++].depth = depth + 1;
+        }
+    }
+    free(stack);
+    stats->node_bytes = stats->nr_nodes * sizeof(bstree_node_t);
+    stats->avg_depth = (double)depth_sum / stats->nr_nodes;
+    return 0;
+}
+
 void bstree_preorder(bstree_node_t *root, int (*cb)(bstree_node_t *node, void *ctx), void *ctx)
 {
     if (!root) {
@@ -233,18 +289,18 @@ void bstree_levelorder(bstree_node_t *root, int (*cb)(bstree_node_t *node, void
         return;
     }
 
-    q = queue_create();
+    q = queue_create_pooled();
     if (!q) {
         return;
     }
 
     do {
-        qnode = queue_node_create(root);
+        qnode = queue_node_alloc(q, root);
         if (!qnode) {
             break;
         }
         if (queue_enqueue(q, qnode) < 0) {
-            queue_node_free(qnode);
+            queue_node_release(q, qnode);
             break;
         }
 
@@ -254,18 +310,18 @@ void bstree_levelorder(bstree_node_t *root, int (*cb)(bstree_node_t *node, void
                 continue;
             }
             root = qnode->data;
-            queue_node_free(qnode);
+            queue_node_release(q, qnode);
 
             if (cb(root, ctx)) {
                 break;
             }
 
             if (root->left) {
-                qnode = queue_node_create(root->left);
+                qnode = queue_node_alloc(q, root->left);
                 queue_enqueue(q, qnode);
             }
             if (root->right) {
-                qnode = queue_node_create(root->right);
+                qnode = queue_node_alloc(q, root->right);
                 queue_enqueue(q, qnode);
             }
         }
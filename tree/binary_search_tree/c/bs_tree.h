@@ -11,8 +11,13 @@
 #ifndef C_BS_TREE
 #define C_BS_TREE
 
+#include <stddef.h>
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 typedef struct bstree_node {
     struct bstree_node *parent;
     struct bstree_node *left;
@@ -119,6 +124,28 @@ bstree_node_t *bstree_find(bstree_node_t *root, void *key, uint32_t key_len,
  */
 uint32_t bstree_depth(bstree_node_t *root);
 
+typedef struct bstree_stats {
+    size_t nr_nodes;
+    size_t node_bytes;  // Bytes taken by the nodes themselves.
+    size_t data_bytes;  // Bytes taken by the keys and values, see bstree_stats.
+    uint32_t max_depth; // The root is at depth 1, equal to nr_nodes for a degenerate tree.
+    double avg_depth;
+} bstree_stats_t;
+
+/**
+ * @brief Collect the memory usage and shape of the binary search tree. The tree is a bare root
+ *        node with no place to keep a count, so every node is visited, O(n). The walk uses a
+ *        heap allocated stack, a degenerate tree does not overflow the call stack.
+ *
+ * @param root
+ * @param cb_size Bytes taken by the key and value of a node. If NULL, key_len + val_len is used.
+ * @param ctx
+ * @param stats
+ * @return int On success, 0 is returned. On error (out of memory), -1 is returned.
+ */
+int bstree_stats(bstree_node_t *root, size_t (*cb_size)(bstree_node_t *node, void *ctx),
+                 void *ctx, bstree_stats_t *stats);
+
 /**
  * @brief Preorder traverse the binary search tree.
  *
@@ -174,4 +201,8 @@ void bstree_levelorder2(bstree_node_t *root, int (*cb)(bstree_node_t *node, int
  */
 void bstree_print(bstree_node_t *root, void (*cb_print)(bstree_node_t *node, void *ctx), void *ctx);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* C_BS_TREE */
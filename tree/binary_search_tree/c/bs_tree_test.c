@@ -41,6 +41,7 @@ int main(void)
     bstree_node_t *root = NULL;
     bstree_node_t *node;
     int result;
+    bstree_stats_t stats;
 
     srand((int)time(NULL));
     for (i = 0; i < 10; i++) {
@@ -81,6 +82,10 @@ int main(void)
     node = bstree_find(root, (void *)(tmp + 1), 0, less);
     LOG_INFO("find node key[%ld], node[0x%08lx]", (tmp + 1), (long)node);
 
+    bstree_stats(root, NULL, NULL, &stats);
+    LOG_INFO("nodes[%zu], node bytes[%zu], max depth[%u], avg depth[%.2f]", stats.nr_nodes,
+             stats.node_bytes, stats.max_depth, stats.avg_depth);
+
     bstree_destroy(root, NULL, NULL);
 
     return 0;
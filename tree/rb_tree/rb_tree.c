@@ -1,79 +1,28 @@
-#include "rb_tree.h"
-#include <pthread.h>
-#include <stdbool.h>
-#include <stdint.h>
+#include "rb_tree_internal.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <memory.h>
 
 // ------------------------ define ------------------------
 
-#define RB_NODE_RED   0 // 红色节点
-#define RB_NODE_BLACK 1 // 黑色节点
-
 #define RB_PRINT_MAX   1024 // 打印红黑数最大深度
 #define RB_PRINT_COLOR 1    // 打印是否显示颜色
 
-// 红黑树的节点
-typedef struct rbtree_node {
-    void *key;
-    void *value;
-    bool key_free_need;
-    bool value_free_need;
-    unsigned char color;
-    struct rbtree_node *left;
-    struct rbtree_node *right;
-    struct rbtree_node *parent;
-} node_t, *rbtree_t;
-
-// 红黑树的根
-typedef struct rbtree_root {
-    node_t *node;
-    int (*cmp_key)(void *key0, void *key1);
-    void *(*copy_key)(void *key);
-    void (*free_key)(void *key);
-    void *(*copy_value)(void *key);
-    void (*free_value)(void *value);
-    bool is_thread_safe;
-    pthread_rwlock_t rwlocker;
-} rbroot_t;
-
-#define KEY_LESS(k0, k1, cmp_key)    (cmp_key(k0, k1) < 0)
-#define KEY_GREATER(k0, k1, cmp_key) (cmp_key(k0, k1) > 0)
-#define KEY_EQUAL(k0, k1, cmp_key)   (cmp_key(k0, k1) == 0)
+#define RB_CACHELINE_SIZE 64 // 根结构按缓存行对齐，不同树的锁不会落在同一个缓存行
+
+#define RB_OPTIMISTIC_DEPTH 128 // 乐观读最多下降的层数，超过说明读到了旋转中途的指针
+#define RB_OPTIMISTIC_RETRY 8   // 乐观读失败的重试次数，超过后退回读锁
+
+#define RB_BATCH_WIDTH 16 // 批量查找时同时进行的查找数，足以让预取在下次访问前完成
+
+#define RB_HINT_MAX_MISS   4  // last_insert 提示连续落空这么多次后不再每次尝试，乱序插入不多做比较
+#define RB_HINT_RETRY_MASK 15 // 暂停期间每 16 个版本重新尝试一次，插入重新变得有序时恢复
 
 // clang-format off
-#define rb_parent(r)       ((r)->parent)
-#define rb_color(r)        ((r)->color)
-#define rb_is_red(r)       ((r)->color == RB_NODE_RED)
-#define rb_is_black(r)     ((r)->color == RB_NODE_BLACK)
-#define rb_set_black(r)    do { (r)->color = RB_NODE_BLACK; } while (0)
-#define rb_set_red(r)      do { (r)->color = RB_NODE_RED; } while (0)
-#define rb_set_parent(r,p) do { (r)->parent = (p); } while (0)
-#define rb_set_color(r,c)  do { (r)->color = (c); } while (0)
-#ifndef swap
-#define swap(a, b) \
-	do { typeof(a) __tmp = (a); (a) = (b); (b) = __tmp; } while (0)
-#endif
 #ifndef ARRAY_SIZE
 #define ARRAY_SIZE(a)      ( (sizeof(a)) / (sizeof(a[0])) )
 #endif
 // clang-format on
-#define LOCK_RBTREE_WR(r)                        \
-    {                                            \
-        if ((r)->is_thread_safe)                 \
-            pthread_rwlock_wrlock(&r->rwlocker); \
-    }
-#define LOCK_RBTREE_RD(r)                        \
-    {                                            \
-        if ((r)->is_thread_safe)                 \
-            pthread_rwlock_rdlock(&r->rwlocker); \
-    }
-#define UNLOCK_RBTREE(r)                         \
-    {                                            \
-        if ((r)->is_thread_safe)                 \
-            pthread_rwlock_unlock(&r->rwlocker); \
-    }
 
 // ------------------------ declaration ------------------------
 static int default_cmp_key(void *key0, void *key1);
@@ -81,35 +30,63 @@ static void *default_copy_key(void *key);
 static void default_free_key(void *key);
 static void *default_copy_val(void *val);
 static void default_free_val(void *val);
-static node_t *rbtree_create_node(void *key, void *value, node_t *parent, node_t *left,
-                                  node_t *right, bool k_copy, bool v_copy,
-                                  void *(*copy_key)(void *key), void *(*copy_val)(void *val),
-                                  void (*free_key)(void *key), void (*free_val)(void *val));
-static void rbtree_left_rotate(rbroot_t *root, node_t *x);
-static void rbtree_right_rotate(rbroot_t *root, node_t *y);
-static void rbtree_insert_node(rbroot_t *root, node_t *node);
-static void rbtree_insert_fixup(rbroot_t *root, node_t *node);
-static void *rbtree_delete_node(rbroot_t *root, node_t *node);
-static void rbtree_delete_fixup(rbroot_t *root, node_t *node, node_t *parent);
+static node_t *rbtree_alloc_node(rbroot_t *root);
+static void rbtree_free_node(rbroot_t *root, node_t *node);
+static void rbtree_reclaim_node(void *ptr, void *ctx);
+static void rbtree_reclaim_value(void *ptr, void *ctx);
+static bool search_optimistic(rbroot_t *root, void *key, node_t **node, void **value);
+static node_t *rbtree_create_node(rbroot_t *root, void *key, void *value, bool k_copy,
+                                  bool v_copy);
+static inline size_t subtree_count(node_t *node);
+static void count_adjust(rbroot_t *root, node_t *node, int delta);
+static const struct rbtree_link_ops *rbtree_link_ops(rbroot_t *root);
+static node_t *rbtree_find_slot(rbroot_t *root, void *key, node_t **parent, int *cmp);
+static bool rbtree_hint_slot(rbroot_t *root, node_t *hint, void *key, node_t **found,
+                             node_t **parent, int *cmp);
+static int rbtree_upsert_at(rbroot_t *root, struct rbtree_cursor *hint, void *key, void *value,
+                            bool key_copy, bool val_copy,
+                            void *(*merge)(void *key, void *old_value, void *new_value, void *ctx),
+                            void *ctx);
+static void rbtree_link_node(rbroot_t *root, node_t *node, node_t *parent, int cmp);
 static void preorder(rbtree_t tree, void (*cb)(void *key, void *value));
 static void inorder(rbtree_t tree, void (*cb)(void *key, void *value));
 static void postorder(rbtree_t tree, void (*cb)(void *key, void *value));
 static void levelorder(rbtree_t tree, void (*cb)(void *key, void *value));
 static node_t *search(rbtree_t x, void *key, int (*cmp_key)(void *key0, void *key1));
 static node_t *search_iterative(rbtree_t x, void *key, int (*cmp_key)(void *key0, void *key1));
+static node_t *cache_search(rbroot_t *root, void *key);
 static node_t *min_node(rbtree_t tree);
 static node_t *max_node(rbtree_t tree);
-static void __rbtree_destroy(rbtree_t tree, void (*free_key)(void *key),
-                             void (*free_val)(void *key));
+static node_t *next_node(node_t *node);
+static node_t *prev_node(node_t *node);
+static node_t *lower_bound_node(rbroot_t *root, void *key);
+static node_t *upper_bound_node(rbroot_t *root, void *key);
+static node_t *build_sorted(rbroot_t *root, char *nodes, void **keys, void **values, size_t lo,
+                            size_t hi, node_t *parent, size_t depth, size_t red_depth);
+static void __rbtree_destroy(rbroot_t *root, rbtree_t tree);
+static size_t node_count(rbroot_t *root);
+static size_t tree_size(node_t *node);
+static void stats_walk(node_t *node, size_t depth, size_t (*size)(void *key, void *value),
+                       struct rbtree_stats *stats, size_t *depth_sum);
 static void print_rbtree_inner(node_t *node, size_t n_deepth, uint8_t *arr_flag);
 
 // ------------------------ public ------------------------
 rbroot_t *rbtree_init(struct rbtree_arg arg)
 {
-    rbroot_t *root = (rbroot_t *)calloc(1, sizeof(rbroot_t));
-    if (!root) {
+    return rbtree_init_ext(arg, 0, 0, NULL);
+}
+
+rbroot_t *rbtree_init_ext(struct rbtree_arg arg, size_t tail_size, size_t key_inline,
+                          void (*augment)(rbroot_t *root, node_t *node))
+{
+    rbroot_t *root = NULL;
+    if (key_inline > tail_size) {
+        return NULL;
+    }
+    if (posix_memalign((void **)&root, RB_CACHELINE_SIZE, sizeof(rbroot_t)) != 0) {
         return NULL;
     }
+    memset(root, 0, sizeof(rbroot_t));
     root->node = NULL;
     root->is_thread_safe = arg.is_thread_safe;
 
@@ -118,14 +95,57 @@ rbroot_t *rbtree_init(struct rbtree_arg arg)
     root->free_key = arg.free_key ? arg.free_key : default_free_key;
     root->copy_value = arg.copy_value ? arg.copy_value : default_copy_val;
     root->free_value = arg.free_value ? arg.free_value : default_free_val;
+    root->serialize_key = arg.serialize_key;
+    root->serialize_value = arg.serialize_value;
+    root->deserialize_key = arg.deserialize_key;
+    root->deserialize_value = arg.deserialize_value;
+    root->order_stat = arg.order_stat;
+    root->tail_offset = sizeof(node_t) + (arg.order_stat ? sizeof(size_t) : 0);
+    // 附加数据之后补齐到指针大小，连续分配的节点（内存池、节点块）保持对齐
+    root->node_size = (root->tail_offset + tail_size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+    root->key_inline = key_inline;
+    root->augment = augment;
 
-    if (root->is_thread_safe) {
-        if (pthread_rwlock_init(&root->rwlocker, NULL) != 0) {
+    if (arg.use_node_pool) {
+        // 节点的增删都在写锁内完成，内存池本身无需加锁
+        root->node_pool = slab_pool_create(root->node_size, 0);
+        if (!root->node_pool) {
             goto err0;
         }
     }
 
+    if (root->is_thread_safe) {
+        if (rwlock_init(&root->rwlocker, arg.lock_policy) != 0) {
+            goto err1;
+        }
+        if (arg.optimistic_read) {
+            root->epoch = epoch_domain_create();
+            if (!root->epoch) {
+                goto err2;
+            }
+        }
+    }
+
+    // 乐观读者不持有读锁，无法保证放入缓存的节点没有同时被删除，此时不启用缓存
+    if (arg.cache_size && !root->epoch) {
+        if (arg.cmp_key && !arg.hash_key) {
+            goto err3;
+        }
+        root->cache = rbtree_cache_create(arg.cache_size, arg.hash_key);
+        if (!root->cache) {
+            goto err3;
+        }
+    }
+
     return root;
+err3:
+    if (!root->is_thread_safe) {
+        goto err1;
+    }
+err2:
+    rwlock_destroy(&root->rwlocker);
+err1:
+    slab_pool_destroy(root->node_pool);
 err0:
     free(root);
     return NULL;
@@ -133,23 +153,48 @@ err0:
 // 销毁红黑数
 void rbtree_destroy(rbroot_t *root)
 {
+    struct rbtree_block *block;
+
     if (root == NULL)
         return;
 
     LOCK_RBTREE_WR(root);
-    __rbtree_destroy(root->node, root->free_key, root->free_value);
+    if (root->nr_heap_nodes || root->nr_owned) {
+        __rbtree_destroy(root, root->node);
+    }
     UNLOCK_RBTREE(root);
+    if (root->is_thread_safe) {
+        rwlock_destroy(&root->rwlocker);
+    }
+    // 释放还在等待读者离开的节点，它们可能来自内存池，所以先于内存池销毁
+    epoch_domain_destroy(root->epoch);
+    rbtree_cache_destroy(root->cache);
+    // 使用内存池时节点随内存池整块释放
+    slab_pool_destroy(root->node_pool);
+    while ((block = root->blocks) != NULL) {
+        root->blocks = block->next;
+        free(block);
+    }
     free(root);
 }
 
 bool rbtree_is_exist(rbroot_t *root, void *key)
 {
     bool rc = false;
+    node_t *node;
+    void *value;
     if (root == NULL) {
         return false;
     }
+    if (root->epoch && search_optimistic(root, key, &node, &value)) {
+        return node ? true : false;
+    }
     LOCK_RBTREE_RD(root);
-    rc = search_iterative(root->node, key, root->cmp_key) ? true : false;
+    if (root->cache) {
+        rc = cache_search(root, key) ? true : false;
+    } else {
+        rc = search_iterative(root->node, key, root->cmp_key) ? true : false;
+    }
     UNLOCK_RBTREE(root);
     return rc;
 }
@@ -161,8 +206,11 @@ void *rbtree_search(rbroot_t *root, void *key)
     if (root == NULL) {
         return NULL;
     }
+    if (root->epoch && search_optimistic(root, key, &node, &value)) {
+        return node ? value : NULL;
+    }
     LOCK_RBTREE_RD(root);
-    node = search(root->node, key, root->cmp_key);
+    node = root->cache ? cache_search(root, key) : search(root->node, key, root->cmp_key);
     if (node == NULL) {
         UNLOCK_RBTREE(root);
         return NULL;
@@ -171,32 +219,337 @@ void *rbtree_search(rbroot_t *root, void *key)
     UNLOCK_RBTREE(root);
     return value;
 }
+// 批量查找，同时推进 RB_BATCH_WIDTH 个查找，每个查找结束后立即换入下一个 key
+size_t rbtree_search_batch(struct rbtree_root *root, void **keys, size_t n, void **out_values)
+{
+    node_t *cur[RB_BATCH_WIDTH];
+    size_t idx[RB_BATCH_WIDTH];
+    size_t next = 0;
+    size_t found = 0;
+    int active = 0;
+    int i = 0;
+    int cmp;
+    node_t *x;
+
+    if (root == NULL || n == 0) {
+        return 0;
+    }
+
+    LOCK_RBTREE_RD(root);
+    if (root->node == NULL) {
+        UNLOCK_RBTREE(root);
+        memset(out_values, 0, n * sizeof(void *));
+        return 0;
+    }
+    for (active = 0; active < RB_BATCH_WIDTH && next < n; active++) {
+        cur[active] = root->node;
+        idx[active] = next++;
+    }
+    while (active > 0) {
+        for (i = 0; i < active; i++) {
+            x = cur[i];
+            cmp = root->cmp_key(keys[idx[i]], x->key);
+            if (cmp != 0) {
+                x = cmp < 0 ? x->left : x->right;
+                if (x != NULL) {
+                    __builtin_prefetch(x);
+                    cur[i] = x;
+                    continue;
+                }
+                out_values[idx[i]] = NULL;
+            } else {
+                out_values[idx[i]] = x->value;
+                found++;
+            }
+            // 这个查找已结束，换入下一个 key；没有更多 key 时用最后一个查找填补空位
+            if (next < n) {
+                cur[i] = root->node;
+                idx[i] = next++;
+            } else {
+                active--;
+                cur[i] = cur[active];
+                idx[i] = idx[active];
+                i--;
+            }
+        }
+    }
+    UNLOCK_RBTREE(root);
+    return found;
+}
+// 统计小于 key 的节点数：向右走时左子树和当前节点都小于 key
+int rbtree_rank(struct rbtree_root *root, void *key, size_t *rank)
+{
+    node_t *x;
+    size_t n = 0;
+
+    if (root == NULL || !root->order_stat || rank == NULL) {
+        return -1;
+    }
+    LOCK_RBTREE_RD(root);
+    x = root->node;
+    while (x != NULL) {
+        if (root->cmp_key(key, x->key) <= 0) {
+            x = x->left;
+        } else {
+            n += subtree_count(x->left) + 1;
+            x = x->right;
+        }
+    }
+    UNLOCK_RBTREE(root);
+    *rank = n;
+    return 0;
+}
+
+// 按左子树大小决定向左还是向右，找到中序下标为 k 的节点
+int rbtree_select(struct rbtree_root *root, size_t k, void **key, void **value)
+{
+    node_t *x;
+    size_t left;
+
+    if (root == NULL || !root->order_stat) {
+        return -1;
+    }
+    LOCK_RBTREE_RD(root);
+    x = root->node;
+    while (x != NULL) {
+        left = subtree_count(x->left);
+        if (k == left) {
+            break;
+        }
+        if (k < left) {
+            x = x->left;
+        } else {
+            k -= left + 1;
+            x = x->right;
+        }
+    }
+    if (x != NULL) {
+        if (key) {
+            *key = x->key;
+        }
+        if (value) {
+            *value = x->value;
+        }
+    }
+    UNLOCK_RBTREE(root);
+    return x ? 0 : -1;
+}
+
+size_t rbtree_size(struct rbtree_root *root)
+{
+    size_t n;
+
+    if (root == NULL) {
+        return 0;
+    }
+    LOCK_RBTREE_RD(root);
+    n = node_count(root);
+    UNLOCK_RBTREE(root);
+    return n;
+}
+
+int rbtree_stats(struct rbtree_root *root, size_t (*size)(void *key, void *value),
+                 struct rbtree_stats *stats)
+{
+    struct rbtree_block *block;
+    node_t *x;
+    size_t depth_sum = 0;
+
+    if (root == NULL || stats == NULL) {
+        return -1;
+    }
+    memset(stats, 0, sizeof(struct rbtree_stats));
+    LOCK_RBTREE_RD(root);
+    stats_walk(root->node, 1, size, stats, &depth_sum);
+    for (x = root->node; x != NULL; x = x->left) {
+        stats->black_height += rb_is_black(x);
+    }
+    if (root->node_pool) {
+        stats->reserved_bytes += slab_mapped_bytes(root->node_pool);
+    }
+    for (block = root->blocks; block; block = block->next) {
+        stats->reserved_bytes += sizeof(struct rbtree_block) + block->nr_nodes * root->node_size;
+    }
+    // 已经遍历过，顺便更新 split 后未知的节点数
+    if (__atomic_load_n(&root->count_stale, __ATOMIC_ACQUIRE)) {
+        __atomic_store_n(&root->nr_nodes, stats->nr_nodes, __ATOMIC_RELAXED);
+        __atomic_store_n(&root->count_stale, false, __ATOMIC_RELEASE);
+    }
+    UNLOCK_RBTREE(root);
+    stats->node_bytes = stats->nr_nodes * root->node_size;
+    stats->avg_depth = stats->nr_nodes ? (double)depth_sum / stats->nr_nodes : 0.0;
+    return 0;
+}
 // 插入一个节点
 int rbtree_insert(struct rbtree_root *root, void *key, void *value, bool key_copy, bool val_copy)
 {
-    node_t *node; // 新建结点
+    return rbtree_upsert(root, key, value, key_copy, val_copy, NULL, NULL) < 0 ? -1 : 0;
+}
+
+static void *keep_old_value(void *key, void *old_value, void *new_value, void *ctx)
+{
+    (void)key;
+    (void)new_value;
+    (void)ctx;
+    return old_value;
+}
+
+// 插入或更新一个节点，只从根节点向下查找一次
+int rbtree_upsert(struct rbtree_root *root, void *key, void *value, bool key_copy, bool val_copy,
+                  void *(*merge)(void *key, void *old_value, void *new_value, void *ctx),
+                  void *ctx)
+{
+    if (root == NULL) {
+        return -1;
+    }
+    return rbtree_upsert_at(root, NULL, key, value, key_copy, val_copy, merge, ctx);
+}
+
+int rbtree_insert_hint(struct rbtree_root *root, struct rbtree_cursor *hint, void *key,
+                       void *value, bool key_copy, bool val_copy)
+{
+    if (root == NULL) {
+        return -1;
+    }
+    if (hint == NULL || hint->root != root) {
+        return rbtree_insert(root, key, value, key_copy, val_copy);
+    }
+    return rbtree_upsert_at(root, hint, key, value, key_copy, val_copy, NULL, NULL) < 0 ? -1 : 0;
+}
+
+// hint 非 NULL 时，hint 游标指向调用者给出的位置提示（可以不指向节点），成功时在锁内指向插入或
+// 更新的节点并记录当前版本；hint 为 NULL 时使用 last_insert
+static int rbtree_upsert_at(rbroot_t *root, struct rbtree_cursor *hint, void *key, void *value,
+                            bool key_copy, bool val_copy,
+                            void *(*merge)(void *key, void *old_value, void *new_value, void *ctx),
+                            void *ctx)
+{
+    node_t *node = NULL;
+    node_t *parent;
+    node_t *near = NULL;
+    int cmp;
+    int rc = 0;
     void *val_free = NULL;
 
     LOCK_RBTREE_WR(root);
-    if ((node = search(root->node, key, root->cmp_key)) != NULL) {
-        if (node->value_free_need) {
+    if (hint) {
+        // 得到提示之后树被修改过时，节点可能已经释放
+        if (hint->node && hint->version == root->version) {
+            near = hint->node;
+        }
+    } else if (root->last_insert && root->last_version == root->version &&
+               (root->hint_miss < RB_HINT_MAX_MISS || (root->version & RB_HINT_RETRY_MASK) == 0)) {
+        near = root->last_insert;
+    }
+    if (near && rbtree_hint_slot(root, near, key, &node, &parent, &cmp)) {
+        root->hint_miss = 0;
+    } else {
+        if (near) {
+            root->hint_miss++;
+        }
+        node = rbtree_find_slot(root, key, &parent, &cmp);
+    }
+    if (node != NULL) {
+        rc = 1;
+        if (merge) {
+            value = merge(node->key, node->value, value, ctx);
+            if (value == node->value) {
+                // 在原 value 上直接修改（例如计数器累加），节点无需变化
+                goto out;
+            }
+        }
+        if (val_copy) {
+            value = root->copy_value(value);
+            if (!value) {
+                rc = -1;
+                goto out;
+            }
+        }
+        if (rb_value_owned(node)) {
             val_free = node->value;
         }
-        node->value = value;
-        node->value_free_need = key_copy;
+        if (!rb_key_owned(node)) {
+            root->nr_owned += (size_t)val_copy - (size_t)rb_value_owned(node);
+        }
+        __atomic_store_n(&node->value, value, __ATOMIC_RELEASE);
+        rb_set_value_owned(node, val_copy);
+        if (val_free && root->epoch) {
+            // 乐观读者可能刚读到旧 value，等它们离开后再释放
+            epoch_retire(root->epoch, val_free, rbtree_reclaim_value, root);
+            val_free = NULL;
+        }
     } else {
-        node = rbtree_create_node(key, value, NULL, NULL, NULL, key_copy, val_copy, root->copy_key,
-                                  root->copy_value, root->free_key, root->free_value);
+        node = rbtree_create_node(root, key, value, key_copy, val_copy);
         if (node == NULL) {
+            rc = -1;
             goto out;
         }
-        rbtree_insert_node(root, node);
+        rbtree_link_node(root, node, parent, cmp);
+        if (root->cache) {
+            rbtree_cache_insert(root, node);
+        }
     }
 out:
+    if (rc >= 0) {
+        root->last_insert = node;
+        root->last_version = root->version;
+        if (hint) {
+            rbtree_cursor_set(hint, node);
+            hint->version = root->version;
+        }
+    }
     UNLOCK_RBTREE(root);
     if (val_free) {
         root->free_value(val_free);
     }
+    return rc;
+}
+
+// 仅当 key 不存在时插入
+int rbtree_emplace(struct rbtree_root *root, void *key, void *value, bool key_copy, bool val_copy)
+{
+    return rbtree_upsert(root, key, value, key_copy, val_copy, keep_old_value, NULL);
+}
+// 由升序的 key 直接构建平衡的红黑树
+int rbtree_build_sorted(struct rbtree_root *root, void **keys, void **values, size_t n)
+{
+    struct rbtree_block *block;
+    size_t red_depth = 0;
+
+    // 节点块不清零，带附加数据的树（如区间树）不支持直接构建
+    if (root == NULL || (keys == NULL && n) || root->key_inline || root->augment) {
+        return -1;
+    }
+    if (n == 0) {
+        return 0;
+    }
+
+    block = malloc(sizeof(struct rbtree_block) + n * root->node_size);
+    if (block == NULL) {
+        return -1;
+    }
+    block->nr_nodes = n;
+
+    // 折半构建时所有叶子的深度为 floor(log2(n)) 或少 1，把最深一层染红即可让各路径黑高相同
+    while ((n >> (red_depth + 1)) != 0) {
+        red_depth++;
+    }
+
+    LOCK_RBTREE_WR(root);
+    if (root->node != NULL) {
+        UNLOCK_RBTREE(root);
+        free(block);
+        return -1;
+    }
+    block->next = root->blocks;
+    root->blocks = block;
+    RB_SEQ_BEGIN(root);
+    root->node = build_sorted(root, (char *)block->nodes, keys, values, 0, n, NULL, 0, red_depth);
+    rb_set_black(root->node);
+    root->nr_nodes = n;
+    root->version++;
+    RB_SEQ_END(root);
+    UNLOCK_RBTREE(root);
     return 0;
 }
 // 删除一个节点
@@ -210,14 +563,25 @@ void rbtree_delete(rbroot_t *root, void *key)
         UNLOCK_RBTREE(root);
         return;
     }
-    if (z->key_free_need) {
+    if (rb_key_owned(z)) {
         key_free = z->key;
     }
-    if (z->value_free_need) {
+    if (rb_value_owned(z)) {
         val_free = z->value;
     }
+    if (key_free || val_free) {
+        root->nr_owned--;
+    }
 
     rbtree_delete_node(root, z);
+    root->nr_nodes--;
+    if (root->epoch) {
+        // 乐观读者可能还在访问该节点，节点和 key/value 都等读者离开后再释放
+        epoch_retire(root->epoch, z, rbtree_reclaim_node, root);
+        UNLOCK_RBTREE(root);
+        return;
+    }
+    rbtree_free_node(root, z);
     UNLOCK_RBTREE(root);
 
     if (key_free) {
@@ -254,13 +618,195 @@ void rbtree_postorder(struct rbtree_root *root, void (*cb)(void *key, void *valu
 
     postorder(root->node, cb);
 }
-// 后序遍历
-// TODO: 等待实现队列做
+void rbtree_read_lock(struct rbtree_root *root)
+{
+    LOCK_RBTREE_RD(root);
+}
+
+void rbtree_read_unlock(struct rbtree_root *root)
+{
+    UNLOCK_RBTREE(root);
+}
+
+void rbtree_cursor_init(struct rbtree_cursor *cursor, struct rbtree_root *root, int lock_mode)
+{
+    cursor->root = root;
+    cursor->node = NULL;
+    cursor->version = 0;
+    cursor->lock_mode = lock_mode;
+    cursor->invalidated = false;
+    cursor->key_owned = false;
+    cursor->key = NULL;
+    cursor->value = NULL;
+}
+
+// 释放游标持有的 key 副本。key 按值保存在节点中时副本由 malloc 分配，否则由 copy_key 分配
+static void cursor_drop_key(struct rbtree_cursor *cursor)
+{
+    if (cursor->key_owned) {
+        if (cursor->root->key_inline) {
+            free(cursor->key);
+        } else {
+            cursor->root->free_key(cursor->key);
+        }
+        cursor->key_owned = false;
+    }
+    cursor->key = NULL;
+}
+
+void rbtree_cursor_release(struct rbtree_cursor *cursor)
+{
+    cursor_drop_key(cursor);
+    cursor->node = NULL;
+    cursor->invalidated = false;
+    cursor->value = NULL;
+}
+
+int rbtree_cursor_set(struct rbtree_cursor *cursor, node_t *node)
+{
+    rbroot_t *root = cursor->root;
+    void *key;
+
+    cursor->node = node;
+    cursor->invalidated = false;
+    if (!node) {
+        return 0;
+    }
+    cursor->value = node->value;
+    // 只有逐步加锁的游标会在锁外使用 key，节点被删除时树持有的 key 随之释放，需要复制
+    if (cursor->lock_mode != RBTREE_CURSOR_LOCK_STEP ||
+        (!root->key_inline && !rb_key_owned(node))) {
+        cursor_drop_key(cursor);
+        cursor->key = node->key;
+        return 0;
+    }
+    if (root->key_inline) {
+        if ((key = malloc(root->key_inline)) != NULL) {
+            memcpy(key, node->key, root->key_inline);
+        }
+    } else {
+        key = root->copy_key(node->key);
+    }
+    if (!key) {
+        cursor->node = NULL;
+        return -1;
+    }
+    // 旧的副本可能正是定位用的 key，定位已经结束，此时才能释放
+    cursor_drop_key(cursor);
+    cursor->key = key;
+    cursor->key_owned = true;
+    return 0;
+}
+
+// 逐步加锁的游标在加锁后调用，树在两次移动之间被修改过时游标失效，保留失效前的 key 用于重新定位
+static bool cursor_check_version(struct rbtree_cursor *cursor)
+{
+    if (cursor->lock_mode == RBTREE_CURSOR_LOCK_STEP && cursor->version != cursor->root->version) {
+        cursor->node = NULL;
+        cursor->invalidated = true;
+        return false;
+    }
+    return true;
+}
+
+// 游标移动的公共部分，op 为 NULL 时按 key 定位，否则在当前节点上调用 op 移动
+static bool cursor_move(struct rbtree_cursor *cursor, node_t *(*op)(node_t *node), void *key,
+                        node_t *(*seek)(rbroot_t *root, void *key))
+{
+    rbroot_t *root = cursor->root;
+    bool step = cursor->lock_mode == RBTREE_CURSOR_LOCK_STEP;
+
+    if (step) {
+        LOCK_RBTREE_RD(root);
+    }
+    if (op) {
+        if (cursor->node && cursor_check_version(cursor)) {
+            rbtree_cursor_set(cursor, op((node_t *)cursor->node));
+        }
+    } else {
+        rbtree_cursor_set(cursor, seek(root, key));
+        cursor->version = root->version;
+    }
+    if (step) {
+        UNLOCK_RBTREE(root);
+    }
+    return cursor->node != NULL;
+}
+
+static node_t *first_node(rbroot_t *root, void *key)
+{
+    (void)key;
+    return min_node(root->node);
+}
+
+static node_t *last_node(rbroot_t *root, void *key)
+{
+    (void)key;
+    return max_node(root->node);
+}
+
+bool rbtree_cursor_first(struct rbtree_cursor *cursor)
+{
+    return cursor_move(cursor, NULL, NULL, first_node);
+}
+
+bool rbtree_cursor_last(struct rbtree_cursor *cursor)
+{
+    return cursor_move(cursor, NULL, NULL, last_node);
+}
+
+bool rbtree_cursor_lower_bound(struct rbtree_cursor *cursor, void *key)
+{
+    return cursor_move(cursor, NULL, key, lower_bound_node);
+}
+
+bool rbtree_cursor_upper_bound(struct rbtree_cursor *cursor, void *key)
+{
+    return cursor_move(cursor, NULL, key, upper_bound_node);
+}
+
+bool rbtree_cursor_seek(struct rbtree_cursor *cursor, void *key)
+{
+    return rbtree_cursor_lower_bound(cursor, key);
+}
+
+bool rbtree_cursor_next(struct rbtree_cursor *cursor)
+{
+    return cursor_move(cursor, next_node, NULL, NULL);
+}
+
+bool rbtree_cursor_prev(struct rbtree_cursor *cursor)
+{
+    return cursor_move(cursor, prev_node, NULL, NULL);
+}
+
+bool rbtree_cursor_valid(struct rbtree_cursor *cursor)
+{
+    return cursor->node != NULL;
+}
+
+bool rbtree_cursor_invalidated(struct rbtree_cursor *cursor)
+{
+    return cursor->invalidated;
+}
+
+void *rbtree_cursor_key(struct rbtree_cursor *cursor)
+{
+    return cursor->node || cursor->invalidated ? cursor->key : NULL;
+}
+
+void *rbtree_cursor_value(struct rbtree_cursor *cursor)
+{
+    return cursor->node ? cursor->value : NULL;
+}
+
 void rbtree_levelorder(struct rbtree_root *root, void (*cb)(void *key, void *value))
 {
     if (!root || !root->node) {
         return;
     }
+
+    levelorder(root->node, cb);
 }
 
 // ------------------------ private ------------------------
@@ -310,17 +856,89 @@ static void default_free_val(void *val)
     }
 }
 
+static node_t *rbtree_alloc_node(rbroot_t *root)
+{
+    node_t *node;
+
+    if (root->node_pool) {
+        return (node_t *)slab_alloc(root->node_pool);
+    }
+    if ((node = (node_t *)malloc(root->node_size)) != NULL) {
+        root->nr_heap_nodes++;
+    }
+    return node;
+}
+
+static void rbtree_free_node(rbroot_t *root, node_t *node)
+{
+    struct rbtree_block *block;
+
+    // 节点块中的节点随节点块一起释放
+    for (block = root->blocks; block; block = block->next) {
+        if ((uintptr_t)node >= (uintptr_t)block->nodes &&
+            (uintptr_t)node < (uintptr_t)block->nodes + block->nr_nodes * root->node_size) {
+            return;
+        }
+    }
+    if (root->node_pool) {
+        slab_free(root->node_pool, node);
+    } else {
+        free(node);
+        root->nr_heap_nodes--;
+    }
+}
+
+// 乐观读模式下由回收域在读者离开后调用，调用者持有写锁或正在销毁树
+static void rbtree_reclaim_node(void *ptr, void *ctx)
+{
+    rbroot_t *root = ctx;
+    node_t *node = ptr;
+
+    if (rb_key_owned(node)) {
+        root->free_key(node->key);
+    }
+    if (rb_value_owned(node)) {
+        root->free_value(node->value);
+    }
+    rbtree_free_node(root, node);
+}
+
+void rbtree_drop_node(rbroot_t *root, node_t *node)
+{
+    if (rb_key_owned(node) || rb_value_owned(node)) {
+        root->nr_owned--;
+    }
+    if (root->epoch) {
+        epoch_retire(root->epoch, node, rbtree_reclaim_node, root);
+    } else {
+        rbtree_reclaim_node(node, root);
+    }
+}
+
+static void rbtree_reclaim_value(void *ptr, void *ctx)
+{
+    rbroot_t *root = ctx;
+    root->free_value(ptr);
+}
+
 // 创建红黑树中一个节点
-static node_t *rbtree_create_node(void *key, void *value, node_t *parent, node_t *left,
-                                  node_t *right, bool k_copy, bool v_copy,
-                                  void *(*copy_key)(void *key), void *(*copy_val)(void *val),
-                                  void (*free_key)(void *key), void (*free_val)(void *val))
+static node_t *rbtree_create_node(rbroot_t *root, void *key, void *value, bool k_copy,
+                                  bool v_copy)
 {
     node_t *p;
-    if ((p = (node_t *)calloc(1, sizeof(node_t))) == NULL)
+    if ((p = rbtree_alloc_node(root)) == NULL)
         return NULL;
-    if (k_copy) {
-        p->key = copy_key(key);
+    memset(p, 0, root->node_size);
+    if (root->order_stat) {
+        rb_count(p) = 1;
+    }
+    if (root->key_inline) {
+        // key 按值存放在节点中，随节点一起释放
+        memcpy(rb_tail(root, p), key, root->key_inline);
+        p->key = rb_tail(root, p);
+        k_copy = false;
+    } else if (k_copy) {
+        p->key = root->copy_key(key);
         if (!p->key) {
             goto err;
         }
@@ -328,320 +946,262 @@ static node_t *rbtree_create_node(void *key, void *value, node_t *parent, node_t
         p->key = key;
     }
     if (v_copy) {
-        p->value = copy_val(value);
+        p->value = root->copy_value(value);
         if (!p->value) {
             goto err;
         }
     } else {
         p->value = value;
     }
-    p->left = left;
-    p->right = right;
-    p->parent = parent;
-    p->color = RB_NODE_BLACK; // 默认为黑色
+    rb_init_node(p, NULL, RB_NODE_BLACK); // 默认为黑色
+    rb_set_key_owned(p, k_copy);
+    rb_set_value_owned(p, v_copy);
+    if (k_copy || v_copy) {
+        root->nr_owned++;
+    }
     return p;
 err:
     if (p->key && k_copy) {
-        free_key(p->key);
+        root->free_key(p->key);
     }
-    if (p->value && v_copy) {
-        free_val(p->value);
+    rbtree_free_node(root, p);
+    return NULL;
+}
+
+// 调用者持有锁。节点数未知时遍历统计，多个读者可能同时统计，结果相同
+static size_t node_count(rbroot_t *root)
+{
+    size_t n;
+
+    if (!__atomic_load_n(&root->count_stale, __ATOMIC_ACQUIRE)) {
+        return __atomic_load_n(&root->nr_nodes, __ATOMIC_RELAXED);
     }
-    if (p) {
-        free(p);
+    n = tree_size(root->node);
+    __atomic_store_n(&root->nr_nodes, n, __ATOMIC_RELAXED);
+    __atomic_store_n(&root->count_stale, false, __ATOMIC_RELEASE);
+    return n;
+}
+
+static size_t tree_size(node_t *node)
+{
+    size_t n = 0;
+
+    for (; node != NULL; node = node->right) {
+        n += 1 + tree_size(node->left);
     }
-    return NULL;
+    return n;
 }
 
-// 左旋
-/*      p              p
- *      |              |
- *      x              y
- *     / \            / \
- *    a   y    -->   x   c
- *       / \        / \
- *      b   c      a   b
- */
-static void rbtree_left_rotate(rbroot_t *root, node_t *x)
-{
-    node_t *y = x->right;
-    x->right = y->left;
-    if (y->left != NULL) {
-        y->left->parent = x;
-    }
-    y->parent = x->parent;
-    if (x->parent == NULL) {
-        root->node = y;
-    } else {
-        if (x->parent->left == x) {
-            x->parent->left = y;
-        } else {
-            x->parent->right = y;
-        }
-    }
-    y->left = x;
-    x->parent = y;
-}
-// 右旋
-/*        p             p
- *        |             |
- *        y             x
- *       / \           / \
- *      x   c  -->    a   y
- *     / \               / \
- *    a   b             b   c
- */
-static void rbtree_right_rotate(rbroot_t *root, node_t *y)
-{
-    node_t *x = y->left;
-    y->left = x->right;
-    if (x->right != NULL) {
-        x->right->parent = y;
-    }
-    x->parent = y->parent;
-    if (y->parent == NULL) {
-        root->node = x;
-    } else {
-        if (y->parent->right == y) {
-            y->parent->right = x;
-        } else {
-            y->parent->left = x;
+static void stats_walk(node_t *node, size_t depth, size_t (*size)(void *key, void *value),
+                       struct rbtree_stats *stats, size_t *depth_sum)
+{
+    for (; node != NULL; node = node->right, depth++) {
+        stats->nr_nodes++;
+        *depth_sum += depth;
+        if (depth > stats->max_depth) {
+            stats->max_depth = depth;
         }
+        if (size) {
+            stats->data_bytes += size(node->key, node->value);
+        }
+        stats_walk(node->left, depth + 1, size, stats, depth_sum);
     }
-    x->right = y;
-    y->parent = x;
 }
 
-// 红黑树插入
-static void rbtree_insert_node(rbroot_t *root, node_t *node)
+static inline size_t subtree_count(node_t *node)
 {
-    node_t *y = NULL;
-    node_t *x = root->node;
-    while (x != NULL) {
-        y = x;
+    return node ? rb_count(node) : 0;
+}
 
-        if (KEY_LESS(node->key, x->key, root->cmp_key)) {
-            x = x->left;
-        } else {
-            x = x->right;
-        }
+void rbtree_node_update(rbroot_t *root, node_t *node)
+{
+    if (root->order_stat) {
+        rb_count(node) = subtree_count(node->left) + subtree_count(node->right) + 1;
     }
-    rb_parent(node) = y;
-    if (y == NULL) {
-        // 插入根节点
-        root->node = node;
-    } else if (KEY_LESS(node->key, y->key, root->cmp_key)) {
-        y->left = node;
-    } else {
-        // 包含了相同值的情况，其实也就是更新
-        y->right = node;
+    if (root->augment) {
+        root->augment(root, node);
     }
-    node->color = RB_NODE_RED;
-    rbtree_insert_fixup(root, node);
 }
 
-// 红黑树插入节点后修正
-static void rbtree_insert_fixup(rbroot_t *root, node_t *node)
-{
-    node_t *parent, *gparent;
-    while ((parent = rb_parent(node)) && rb_is_red(parent)) {
-        gparent = rb_parent(parent);
-        if (parent == gparent->left) { // 父节点是祖父节点的左孩子
-            node_t *uncle = gparent->right;
-            if (uncle && rb_is_red(uncle)) { // case 1: 叔叔节点是红节点
-                rb_set_black(parent);        // 将“父节点”设为黑色
-                rb_set_black(uncle);         // 将“叔叔节点”设为黑色
-                rb_set_red(gparent);         // 将“祖父节点”设为“红色”
-                node = gparent; // 将“祖父节点”设为“当前节点”(红色节点)
-                continue;       // 之后继续对“当前节点”进行操作。
-            }
-            // 到这表示叔叔节点是黑节点
-            if (parent->right == node) { // case 2: 叔叔是黑色，当前节点是父节点的右孩子
-                swap(parent, node);             // 将“父节点”作为“新的当前节点”
-                rbtree_left_rotate(root, node); // 以“新的当前节点”为支点进行左旋
-                // 经过上面的左旋后，当前节点一定是左孩子了
-            }
+// 从 node 开始向上重新计算每个祖先的附加数据
+static void augment_path(rbroot_t *root, node_t *node)
+{
+    if (!root->augment) {
+        return;
+    }
+    for (; node != NULL; node = rb_parent(node)) {
+        root->augment(root, node);
+    }
+}
 
-            // case 3：叔叔是黑色，当前节点是左孩子
-            rb_set_black(parent);
-            rb_set_red(gparent);
-            rbtree_right_rotate(root, gparent);
-
-        } else { // 父节点是祖父节点的右孩子
-            node_t *uncle = gparent->left;
-            if (uncle && rb_is_red(uncle)) { // case 1: 叔叔节点是红节点
-                rb_set_black(parent);        // 将“父节点”设为黑色
-                rb_set_black(uncle);         // 将“叔叔节点”设为黑色
-                rb_set_red(gparent);         // 将“祖父节点”设为“红色”
-                node = gparent; // 将“祖父节点”设为“当前节点”(红色节点)
-                continue;       // 之后继续对“当前节点”进行操作。
-            }
-            // 到这表示叔叔节点是黑节点
-            if (parent->left == node) { // case 2: 叔叔是黑色，当前节点是父节点的左孩子
-                swap(parent, node);              // 将“父节点”作为“新的当前节点”
-                rbtree_right_rotate(root, node); // 以“新的当前节点”为支点进行右旋
-                // 经过上面的右旋后，当前节点一定是右孩子了
-            }
-            // case 3：叔叔是黑色，当前节点是右孩子
-            rb_set_black(parent);
-            rb_set_red(gparent);
-            rbtree_left_rotate(root, gparent);
-        }
+// 顺序统计模式下，把 node 及其所有祖先的子树大小加上 delta
+static void count_adjust(rbroot_t *root, node_t *node, int delta)
+{
+    if (!root->order_stat) {
+        return;
+    }
+    for (; node != NULL; node = rb_parent(node)) {
+        rb_count(node) += delta;
+    }
+}
+
+// 旋转后 old 下移成为 new_ 的孩子：子树包含的节点不变，只需先算 old，再算 new_
+static void node_rotate(struct rbtree_link *old, struct rbtree_link *new_, void *ctx)
+{
+    rbroot_t *root = ctx;
+    node_t *x = rb_link_node(old);
+    node_t *y = rb_link_node(new_);
+
+    if (root->order_stat) {
+        rb_count(y) = rb_count(x);
+    }
+    rbtree_node_update(root, x);
+    if (root->augment) {
+        root->augment(root, y);
     }
-    rb_set_black(root->node);
 }
-// 红黑树删除
-static void *rbtree_delete_node(rbroot_t *root, node_t *node)
+
+// 后继 replace 移到被删除节点的位置，继承它的子树大小，rbtree_link_erase_ext 随后调用 node_erased 减 1
+static void node_copy(struct rbtree_link *old, struct rbtree_link *replace, void *ctx)
 {
-    node_t *child, *parent;
-    void *result = NULL;
-    int color;
-    if (node->left != NULL && node->right != NULL) { // 节点左右孩子都不为空
-        // 替代被删除的节点
-        node_t *replace = node;
+    rbroot_t *root = ctx;
 
-        // 获取后继节点
-        replace = replace->right;
-        while (replace->left != NULL)
-            replace = replace->left;
+    if (root->order_stat) {
+        rb_count(rb_link_node(replace)) = rb_count(rb_link_node(old));
+    }
+}
 
-        if (rb_parent(node)) { // 不是根节点
-            if (rb_parent(node)->left == node) {
-                rb_parent(node)->left = replace;
-            } else {
-                rb_parent(node)->right = replace;
-            }
-        } else { // 被删除的节点是根节点
-            root->node = replace;
-        }
-        // child是"取代节点"的右孩子，也是需要"调整的节点"。
-        // "取代节点"肯定不存在左孩子！因为它是一个后继节点。
-        child = replace->right;
-        parent = rb_parent(replace);
-        color = rb_color(replace);
+// 摘下节点后，parent 到根的路径上每个子树都少了一个节点，附加数据也需要重新计算
+static void node_erased(struct rbtree_link *parent, void *ctx)
+{
+    rbroot_t *root = ctx;
+    node_t *node = parent ? rb_link_node(parent) : NULL;
 
-        if (parent == node) { // 取代节点就是删除节点的右孩子
-            parent = replace;
-        } else {
-            if (child) {
-                rb_set_parent(child, parent);
-            }
-            parent->left = child;
-            replace->right = node->right;
-            rb_set_parent(node->right, replace);
-        }
+    count_adjust(root, node, -1);
+    augment_path(root, node);
+}
 
-        replace->parent = node->parent;
-        replace->color = node->color;
-        replace->left = node->left;
-        node->left->parent = replace;
+static const struct rbtree_link_ops node_ops = {
+    .rotate = node_rotate,
+    .copy = node_copy,
+    .erased = node_erased,
+};
 
-        if (color == RB_NODE_BLACK) {
-            rbtree_delete_fixup(root, child, parent);
+// 节点没有子树大小和附加数据时不需要回调，旋转和删除与 RBTREE_DEFINE 生成的树一样
+static const struct rbtree_link_ops *rbtree_link_ops(rbroot_t *root)
+{
+    return root->order_stat || root->augment ? &node_ops : NULL;
+}
+
+// 从根节点向下查找 key，找到时返回该节点；否则返回 NULL，
+// 并通过 parent 和 cmp 返回新节点应挂载的位置（cmp < 0 为左孩子，否则为右孩子）
+static node_t *rbtree_find_slot(rbroot_t *root, void *key, node_t **parent, int *cmp)
+{
+    node_t *y = NULL;
+    node_t *x = root->node;
+    int c = 0;
+
+    while (x != NULL) {
+        c = root->cmp_key(key, x->key);
+        if (c == 0) {
+            return x;
         }
-        result = node->value;
-        free(node);
-        return result;
-    }
-    if (node->left != NULL) {
-        child = node->left;
-    } else {
-        child = node->right;
+        y = x;
+        x = c < 0 ? x->left : x->right;
     }
-    parent = node->parent;
-    color = node->color;
+    *parent = y;
+    *cmp = c;
+    return NULL;
+}
+
+// key 落在 hint 与其前驱或后继之间时，最多比较两次得到与 rbtree_find_slot 相同的结果，返回 true；
+// 否则返回 false，由调用者从根查找
+static bool rbtree_hint_slot(rbroot_t *root, node_t *hint, void *key, node_t **found,
+                             node_t **parent, int *cmp)
+{
+    node_t *near;
+    int c, c2;
 
-    if (child) {
-        child->parent = parent;
+    *found = NULL;
+    if ((c = root->cmp_key(key, hint->key)) == 0) {
+        *found = hint;
+        return true;
     }
-    if (parent) { // "node"节点不是根节点
-        if (parent->left == node) {
-            parent->left = child;
+    if (c > 0) {
+        // 后继为空或大于 key：位置在 hint 的右孩子，或者后继（右子树的最小节点）的左孩子
+        if ((near = next_node(hint)) != NULL && (c2 = root->cmp_key(key, near->key)) >= 0) {
+            if (c2 == 0) {
+                *found = near;
+                return true;
+            }
+            return false;
+        }
+        if (hint->right == NULL) {
+            *parent = hint;
+            *cmp = 1;
         } else {
-            parent->right = child;
+            *parent = near;
+            *cmp = -1;
+        }
+        return true;
+    }
+    if ((near = prev_node(hint)) != NULL && (c2 = root->cmp_key(key, near->key)) <= 0) {
+        if (c2 == 0) {
+            *found = near;
+            return true;
         }
+        return false;
+    }
+    if (hint->left == NULL) {
+        *parent = hint;
+        *cmp = -1;
     } else {
-        root->node = child;
+        *parent = near;
+        *cmp = 1;
     }
+    return true;
+}
 
-    if (color == RB_NODE_BLACK) {
-        rbtree_delete_fixup(root, child, parent);
+// 将新节点挂到 rbtree_find_slot 返回的位置，然后修正红黑树
+static void rbtree_link_node(rbroot_t *root, node_t *node, node_t *parent, int cmp)
+{
+    node->left = NULL;
+    node->right = NULL;
+    rb_set_red(node);
+    RB_SEQ_BEGIN(root);
+    rb_set_parent(node, parent);
+    if (parent == NULL) {
+        // 插入根节点
+        root->node = node;
+    } else if (cmp < 0) {
+        parent->left = node;
+    } else {
+        parent->right = node;
     }
-    result = node->value;
-    free(node);
-    return result;
+    count_adjust(root, parent, 1);
+    augment_path(root, node);
+    rbtree_insert_fixup(root, node);
+    root->nr_nodes++;
+    root->version++;
+    RB_SEQ_END(root);
 }
-// 红黑树删除后的修正
-static void rbtree_delete_fixup(rbroot_t *root, node_t *node, node_t *parent)
-{
-    node_t *other;
-    while ((!node || rb_is_black(node)) && node != root->node) { // 调整节点不是根节点
-        if (parent->left == node) {
-            other = parent->right;
-            if (rb_is_red(other)) {
-                // case 1: x的兄弟节点是红色
-                rb_set_black(other);
-                rb_set_red(parent);
-                rbtree_left_rotate(root, parent);
-                other = parent->right;
-            }
-            if ((!other->left || rb_is_black(other->left)) &&
-                (!other->right || rb_is_black(other->right))) {
-                // case 2: x的兄弟节点是黑色，且兄弟节点的俩个孩子也都是黑色的
-                rb_set_red(other);
-                node = parent;
-                parent = rb_parent(node);
-            } else {
-                if (!other->right || rb_is_black(other->right)) {
-                    // case 3: x的兄弟节点是黑色的，并且兄弟节点的左孩子是红色，右孩子为黑色。
-                    rb_set_black(other->left);
-                    rb_set_red(other);
-                    rbtree_right_rotate(root, other);
-                    other = parent->right;
-                }
-                // case 4: x的兄弟节点是黑色的；并且兄弟节点的右孩子是红色的，左孩子任意颜色。
-                rb_set_color(other, rb_color(parent));
-                rb_set_black(parent);
-                rb_set_black(other->right);
-                rbtree_left_rotate(root, parent);
-                node = root->node;
-                break;
-            }
-        } else {
-            other = parent->left;
-            if (rb_is_red(other)) {
-                // case 1: x的兄弟节点是红色
-                rb_set_black(other);
-                rb_set_red(parent);
-                rbtree_right_rotate(root, parent);
-                other = parent->left;
-            }
-            if ((!other->left || rb_is_black(other->left)) &&
-                (!other->right || rb_is_black(other->right))) {
-                // case 2: x的兄弟节点是黑色，且兄弟节点的俩个孩子也都是黑色的
-                rb_set_red(other);
-                node = parent;
-                parent = rb_parent(node);
-            } else {
-                if (!other->left || rb_is_black(other->left)) {
-                    // case 3: x的兄弟节点是黑色的，并且兄弟节点的左孩子是红色，右孩子为黑色。
-                    rb_set_black(other->right);
-                    rb_set_red(other);
-                    rbtree_left_rotate(root, other);
-                    other = parent->left;
-                }
-                // case 4: x的兄弟节点是黑色的；并且兄弟节点的右孩子是红色的，左孩子任意颜色。
-                rb_set_color(other, rb_color(parent));
-                rb_set_black(parent);
-                rb_set_black(other->left);
-                rbtree_right_rotate(root, parent);
-                node = root->node;
-                break;
-            }
-        }
+
+// 红黑树插入节点后修正
+bool rbtree_insert_fixup(rbroot_t *root, node_t *node)
+{
+    return rbtree_link_insert_color(&root->link, &node->link, rbtree_link_ops(root), root);
+}
+// 红黑树删除，只把节点从树上摘下，由调用者释放
+void *rbtree_delete_node(rbroot_t *root, node_t *node)
+{
+    if (root->cache) {
+        rbtree_cache_invalidate(root, node);
     }
-    if (node)
-        rb_set_black(node);
+    root->version++;
+    RB_SEQ_BEGIN(root);
+    rbtree_link_erase_ext(&root->link, &node->link, rbtree_link_ops(root), root);
+    RB_SEQ_END(root);
+    return node->value;
 }
 // 前序遍历
 static void preorder(rbtree_t tree, void (*cb)(void *key, void *value))
@@ -676,12 +1236,31 @@ static void postorder(rbtree_t tree, void (*cb)(void *key, void *value))
         }
     }
 }
-// 后序遍历
-// TODO: 等待实现队列做
-static void levelorder(rbtree_t tree, void (*cb)(void *key, void *value))
+// 从左到右访问 tree 中深度为 depth 的节点，返回该层是否有节点
+static bool level_visit(rbtree_t tree, size_t depth, void (*cb)(void *key, void *value))
 {
+    bool left, right;
+
     if (tree == NULL) {
-        return;
+        return false;
+    }
+    if (depth == 0) {
+        if (cb) {
+            cb(tree->key, tree->value);
+        }
+        return true;
+    }
+    left = level_visit(tree->left, depth - 1, cb);
+    right = level_visit(tree->right, depth - 1, cb);
+    return left || right;
+}
+// 层序遍历：红黑树的高度不超过 2log(n+1)，逐层从根下降，不需要队列，耗时 O(n log n)
+static void levelorder(rbtree_t tree, void (*cb)(void *key, void *value))
+{
+    size_t depth = 0;
+
+    while (level_visit(tree, depth, cb)) {
+        depth++;
     }
 }
 
@@ -708,6 +1287,62 @@ static node_t *search_iterative(rbtree_t x, void *key, int (*cmp_key)(void *key0
     }
     return x;
 }
+// 先查热点 key 缓存，未命中时从根查找并放入缓存。调用者持有读锁
+static node_t *cache_search(rbroot_t *root, void *key)
+{
+    node_t *x;
+    uint64_t hash;
+    int c;
+
+    if ((x = rbtree_cache_lookup(root, key, &hash)) != NULL) {
+        return x;
+    }
+    for (x = root->node; x != NULL; x = c < 0 ? x->left : x->right) {
+        if ((c = root->cmp_key(key, x->key)) == 0) {
+            rbtree_cache_fill(root, hash, x, true);
+            break;
+        }
+    }
+    return x;
+}
+// 乐观读：不加锁从根节点向下查找，结束时序列号未变说明期间没有写者修改树结构，结果有效。
+// 返回 false 表示多次冲突，需要退回读锁；返回 true 时 node 为 NULL 表示 key 不存在
+static bool search_optimistic(rbroot_t *root, void *key, node_t **node, void **value)
+{
+    node_t *x;
+    uint64_t seq;
+    int retry;
+    int depth;
+    int cmp;
+
+    if (epoch_enter(root->epoch) < 0) {
+        return false;
+    }
+    for (retry = 0; retry < RB_OPTIMISTIC_RETRY; retry++) {
+        seq = __atomic_load_n(&root->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            continue;
+        }
+        x = RB_READ_ONCE(root->node);
+        for (depth = 0; x != NULL && depth < RB_OPTIMISTIC_DEPTH; depth++) {
+            cmp = root->cmp_key(key, RB_READ_ONCE(x->key));
+            if (cmp == 0) {
+                *value = RB_READ_ONCE(x->value);
+                break;
+            }
+            x = cmp < 0 ? RB_READ_ONCE(x->left) : RB_READ_ONCE(x->right);
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (depth < RB_OPTIMISTIC_DEPTH && __atomic_load_n(&root->seq, __ATOMIC_RELAXED) == seq) {
+            epoch_exit(root->epoch);
+            *node = x;
+            return true;
+        }
+    }
+    // 退回读锁前必须离开临界区，否则会和等待读者的写者互相等待
+    epoch_exit(root->epoch);
+    return false;
+}
 // 查找最小节点
 static node_t *min_node(rbtree_t tree)
 {
@@ -729,24 +1364,110 @@ static node_t *max_node(rbtree_t tree)
     return tree;
 }
 
-static void __rbtree_destroy(rbtree_t tree, void (*free_key)(void *key),
-                             void (*free_val)(void *key))
+// 中序遍历的后继节点
+static node_t *next_node(node_t *node)
+{
+    node_t *parent;
+
+    if (node->right != NULL)
+        return min_node(node->right);
+
+    while ((parent = rb_parent(node)) != NULL && parent->right == node)
+        node = parent;
+    return parent;
+}
+// 中序遍历的前驱节点
+static node_t *prev_node(node_t *node)
+{
+    node_t *parent;
+
+    if (node->left != NULL)
+        return max_node(node->left);
+
+    while ((parent = rb_parent(node)) != NULL && parent->left == node)
+        node = parent;
+    return parent;
+}
+// 第一个大于等于 key 的节点
+static node_t *lower_bound_node(rbroot_t *root, void *key)
+{
+    node_t *x = root->node;
+    node_t *result = NULL;
+    int c;
+
+    while (x != NULL) {
+        c = root->cmp_key(key, x->key);
+        if (c <= 0) {
+            result = x;
+            if (c == 0)
+                break;
+            x = x->left;
+        } else {
+            x = x->right;
+        }
+    }
+    return result;
+}
+// 第一个大于 key 的节点
+static node_t *upper_bound_node(rbroot_t *root, void *key)
+{
+    node_t *x = root->node;
+    node_t *result = NULL;
+
+    while (x != NULL) {
+        if (root->cmp_key(key, x->key) < 0) {
+            result = x;
+            x = x->left;
+        } else {
+            x = x->right;
+        }
+    }
+    return result;
+}
+
+// 以 [lo, hi) 的中点为根递归构建子树，nodes 与 keys 下标一一对应，中序遍历即顺序访问内存
+static node_t *build_sorted(rbroot_t *root, char *nodes, void **keys, void **values, size_t lo,
+                            size_t hi, node_t *parent, size_t depth, size_t red_depth)
+{
+    size_t mid;
+    node_t *node;
+
+    if (lo >= hi) {
+        return NULL;
+    }
+    mid = lo + (hi - lo) / 2;
+    node = (node_t *)(nodes + mid * root->node_size);
+    node->key = keys[mid];
+    node->value = values ? values[mid] : NULL;
+    rb_init_node(node, parent, depth == red_depth ? RB_NODE_RED : RB_NODE_BLACK);
+    if (root->order_stat) {
+        rb_count(node) = hi - lo;
+    }
+    node->left = build_sorted(root, nodes, keys, values, lo, mid, node, depth + 1, red_depth);
+    node->right = build_sorted(root, nodes, keys, values, mid + 1, hi, node, depth + 1, red_depth);
+    return node;
+}
+
+static void __rbtree_destroy(rbroot_t *root, rbtree_t tree)
 {
     if (tree == NULL)
         return;
 
     if (tree->left != NULL)
-        __rbtree_destroy(tree->left, free_key, free_val);
+        __rbtree_destroy(root, tree->left);
     if (tree->right != NULL)
-        __rbtree_destroy(tree->right, free_key, free_val);
+        __rbtree_destroy(root, tree->right);
 
-    if (tree->key_free_need) {
-        free_key(tree->key);
+    if (rb_key_owned(tree)) {
+        root->free_key(tree->key);
+    }
+    if (rb_value_owned(tree)) {
+        root->free_value(tree->value);
     }
-    if (tree->value_free_need) {
-        free_val(tree->value);
+    // 使用内存池时节点由 rbtree_destroy 随内存池一起释放
+    if (!root->node_pool) {
+        rbtree_free_node(root, tree);
     }
-    free(tree);
 }
 
 // 打印红黑数（类似tree命令）
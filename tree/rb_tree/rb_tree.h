@@ -2,9 +2,23 @@
 #define UTILS_RB_TREE
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 struct rbtree_root;
+struct rbtree_cursor;
+
+#define RBTREE_CURSOR_LOCK_BATCH 0 // 游标不加锁，由调用者用 rbtree_read_lock 包住一批移动
+#define RBTREE_CURSOR_LOCK_STEP  1 // 游标每次移动时加读锁，两次移动之间允许写入
+
+// is_thread_safe 时使用的读写锁，见 common/sync/rwlock.h
+#define RBTREE_LOCK_RWLOCK 0 // pthread 读写锁，所有读者修改同一个计数
+#define RBTREE_LOCK_BRLOCK 1 // 每个线程的读计数在各自的缓存行上，读多写极少时使用；写者代价高
+#define RBTREE_LOCK_QUEUED 2 // 按到达顺序排队的读写锁，写者不会被源源不断的读者饿死
 
 /**
  * @brief 红黑树初始化参数
@@ -17,6 +31,28 @@ struct rbtree_arg {
     void (*free_key)(void *key);
     void *(*copy_value)(void *key);
     void (*free_value)(void *value);
+    int use_node_pool; // 非 0: 节点从树私有的 slab 内存池分配，销毁时整块释放
+    uint64_t (*hash_key)(void *key); // key 的哈希，cmp_key 相等的 key 哈希值必须相同
+    // 非 0 且 is_thread_safe 时，rbtree_search/rbtree_is_exist 不加读锁，改为校验写者维护的序列号，
+    // 冲突时重试，多次失败后退回读锁；删除的节点和被替换的 key/value 延迟到读者离开后再释放。
+    // cmp_key 可能在树被并发修改时读到即将删除（尚未释放）的 key，必须是无副作用的
+    int optimistic_read;
+    int order_stat; // 非 0: 每个节点额外记录子树大小，支持 O(log n) 的 rbtree_rank/rbtree_select
+    // 写入镜像文件（rbtree_save_image）时把 key/value 序列化到 buf，返回序列化后的字节数，
+    // 大于 size 时不写入，调用者用更大的 buf 重试。为 NULL 时 key/value 本身是一个整数，占 8 字节
+    size_t (*serialize_key)(void *key, void *buf, size_t size);
+    size_t (*serialize_value)(void *value, void *buf, size_t size);
+    // 打开镜像文件（rbtree_open_mmap）后由序列化的数据得到 key/value，可以直接返回指向 buf 的指针，
+    // 返回值只在镜像关闭前有效，不会被释放。buf 按 8 字节对齐。为 NULL 时与默认的序列化对应
+    void *(*deserialize_key)(const void *buf, size_t len);
+    void *(*deserialize_value)(const void *buf, size_t len);
+    // 非 0 且未开启 optimistic_read 时，在树前面加一个约这么多项的 2 路组相联缓存，由 key 的哈希
+    // 映射到节点，命中时 rbtree_search/rbtree_is_exist 只需一次哈希和一次比较。
+    // 使用自定义 cmp_key 时必须提供 hash_key
+    size_t cache_size;
+    // RBTREE_LOCK_RWLOCK（默认）、RBTREE_LOCK_BRLOCK 或 RBTREE_LOCK_QUEUED。后两者的读锁不可重入：
+    // 有写者等待时，持有读锁的线程（如在 rbtree_parallel_foreach 的回调中）再次读同一棵树会死锁
+    int lock_policy;
 };
 
 /**
@@ -42,10 +78,71 @@ void rbtree_destroy(struct rbtree_root *root);
  * @param value
  * @param key_copy true: 对 key 调用 copy_key 进行拷贝
  * @param val_copy true: 对 val 调用 copy_val 进行拷贝
- * @return int
+ * @return int 0: 成功; -1: 失败
  */
 int rbtree_insert(struct rbtree_root *root, void *key, void *value, bool key_copy, bool val_copy);
 
+/**
+ * @brief 插入或更新一个节点，查找插入位置和挂载节点只需从根节点向下查找一次
+ *
+ * @param root
+ * @param key
+ * @param value
+ * @param key_copy true: 对 key 调用 copy_key 进行拷贝
+ * @param val_copy true: 对 val 调用 copy_val 进行拷贝
+ * @param merge key 已存在时调用，返回值作为节点新的 value；返回 old_value 表示原地修改，节点不变，
+ *              否则旧 value 按 rbtree_insert 的规则释放，返回值按 val_copy 决定是否拷贝。
+ *              为 NULL 时直接用 value 替换旧值，等同于 rbtree_insert
+ * @param ctx 透传给 merge
+ * @return int 0: 插入了新节点; 1: key 已存在并完成更新; -1: 失败
+ */
+int rbtree_upsert(struct rbtree_root *root, void *key, void *value, bool key_copy, bool val_copy,
+                  void *(*merge)(void *key, void *old_value, void *new_value, void *ctx),
+                  void *ctx);
+
+/**
+ * @brief 仅当 key 不存在时插入一个节点，已存在时不做任何修改
+ *
+ * @param root
+ * @param key
+ * @param value
+ * @param key_copy true: 对 key 调用 copy_key 进行拷贝
+ * @param val_copy true: 对 val 调用 copy_val 进行拷贝
+ * @return int 0: 插入了新节点; 1: key 已存在; -1: 失败
+ */
+int rbtree_emplace(struct rbtree_root *root, void *key, void *value, bool key_copy, bool val_copy);
+
+/**
+ * @brief 带位置提示的插入，同 rbtree_insert。key 落在 hint 指向的节点与其前驱或后继之间时，
+ *        最多比较两次即可挂载，否则从根查找。成功后 hint 指向插入或更新的节点，
+ *        插入近似有序的 key（时间戳、递增的 ID）时可以一直传入同一个游标。
+ *        hint 得到之后树被其它操作修改过时提示被忽略。
+ *        不带提示的 rbtree_insert/rbtree_upsert/rbtree_emplace 以上一次插入的位置作为提示，
+ *        提示连续落空时暂停尝试，乱序插入基本不增加比较次数
+ *
+ * @param root
+ * @param hint 由 rbtree_cursor_init 初始化的游标，可以不指向任何节点；为 NULL 时等同于 rbtree_insert
+ * @param key
+ * @param value
+ * @param key_copy true: 对 key 调用 copy_key 进行拷贝
+ * @param val_copy true: 对 val 调用 copy_val 进行拷贝
+ * @return int 0: 成功; -1: 失败
+ */
+int rbtree_insert_hint(struct rbtree_root *root, struct rbtree_cursor *hint, void *key,
+                       void *value, bool key_copy, bool val_copy);
+
+/**
+ * @brief 由已按 cmp_key 严格升序排列的 key 在 O(n) 时间内构建红黑树，不调用 cmp_key，
+ *        所有节点来自一次连续的内存分配，节点被删除后其内存在树销毁时才归还
+ *
+ * @param root 必须是空树
+ * @param keys n 个严格升序且互不相同的 key，不做拷贝，树不负责释放
+ * @param values 与 keys 一一对应的 value，不做拷贝；为 NULL 时所有 value 为 NULL
+ * @param n
+ * @return int 0: 成功; -1: 失败（树非空或内存不足）
+ */
+int rbtree_build_sorted(struct rbtree_root *root, void **keys, void **values, size_t n);
+
 /**
  * @brief 判断一个 key 是否存在于树中
  *
@@ -65,6 +162,83 @@ bool rbtree_is_exist(struct rbtree_root *root, void *key);
  */
 void *rbtree_search(struct rbtree_root *root, void *key);
 
+/**
+ * @brief 批量查找 n 个 key，只加一次读锁。多个查找交错进行，每次向下一层时预取下一层的节点，
+ *        用其它查找的比较掩盖访存延迟，适合远大于缓存的树
+ *
+ * @param root
+ * @param keys
+ * @param n
+ * @param out_values keys[i] 对应的 value 写入 out_values[i]，不存在时写入 NULL
+ * @return size_t 找到的 key 的个数
+ */
+size_t rbtree_search_batch(struct rbtree_root *root, void **keys, size_t n, void **out_values);
+
+/**
+ * @brief 统计树中小于 key 的节点数，key 存在时即为它在中序遍历中的下标，需要 order_stat
+ *
+ * @param root
+ * @param key
+ * @param rank 返回小于 key 的节点数
+ * @return int 0: 成功; -1: 失败（树没有开启 order_stat）
+ */
+int rbtree_rank(struct rbtree_root *root, void *key, size_t *rank);
+
+/**
+ * @brief 查找中序遍历中下标为 k 的节点（第 k + 1 小的 key），需要 order_stat
+ *
+ * @param root
+ * @param k 从 0 开始
+ * @param key 返回节点的 key，可以为 NULL
+ * @param value 返回节点的 value，可以为 NULL
+ * @return int 0: 成功; -1: k 超出范围或树没有开启 order_stat
+ */
+int rbtree_select(struct rbtree_root *root, size_t k, void **key, void **value);
+
+/**
+ * @brief 树的内存占用和形状，由 rbtree_stats 填写
+ *
+ */
+struct rbtree_stats {
+    size_t nr_nodes;       // 节点数
+    size_t node_bytes;     // 节点本身占用的字节数
+    size_t reserved_bytes; // 内存池和 rbtree_build_sorted 的节点块向系统申请的字节数，含空闲部分
+    size_t data_bytes;     // key 和 value 占用的字节数，由 rbtree_stats 的 size 回调统计
+    size_t max_depth;      // 最深节点的深度，根节点为 1
+    double avg_depth;      // 节点的平均深度
+    size_t black_height;   // 从根到空叶子经过的黑节点数
+};
+
+/**
+ * @brief 树中的节点数。节点数随增删维护，O(1)；未开启 order_stat 的树 rbtree_split 之后
+ *        第一次调用时遍历统计
+ *
+ * @param root
+ * @return size_t
+ */
+size_t rbtree_size(struct rbtree_root *root);
+
+/**
+ * @brief 遍历整棵树，统计内存占用和形状，用于监控容量和平衡情况。持有读锁，耗时 O(n)
+ *
+ * @param root
+ * @param size 返回一个节点的 key 和 value 占用的字节数，为 NULL 时 data_bytes 为 0
+ * @param stats
+ * @return int 0: 成功; -1: 参数错误
+ */
+int rbtree_stats(struct rbtree_root *root, size_t (*size)(void *key, void *value),
+                 struct rbtree_stats *stats);
+
+/**
+ * @brief 热点 key 缓存（rbtree_arg.cache_size）的命中和未命中次数
+ *
+ * @param root
+ * @param hits 可以为 NULL
+ * @param misses 可以为 NULL
+ * @return int 0: 成功; -1: 没有启用缓存
+ */
+int rbtree_cache_stats(struct rbtree_root *root, uint64_t *hits, uint64_t *misses);
+
 /**
  * @brief 删除一个节点
  *
@@ -73,6 +247,112 @@ void *rbtree_search(struct rbtree_root *root, void *key);
  */
 void rbtree_delete(struct rbtree_root *root, void *key);
 
+/**
+ * @brief 把 right 中的节点全部移到 left，right 变为空树。left 中的 key 必须都小于 right 中的 key，
+ *        只沿两棵树的边缘调整，耗时 O(log n)
+ *
+ * 涉及两棵树的操作（join/split/union/intersect/difference）要求两棵树的 cmp_key 和
+ * order_stat 相同；会把节点从一棵树移到另一棵的操作，还要求两棵树都不使用节点内存池，
+ * 交出节点的树没有由 rbtree_build_sorted 构建、没有开启 optimistic_read，且 free_key、free_value 相同。
+ * 锁按参数顺序获取，不要在不同线程中以相反的顺序对同一对树操作。
+ *
+ * @param left
+ * @param right
+ * @return int 0: 成功; -1: 失败（两棵树不满足上述条件，或 key 的范围有重叠）
+ */
+int rbtree_join(struct rbtree_root *left, struct rbtree_root *right);
+
+/**
+ * @brief 把 root 中大于等于 key 的节点移到 right，耗时 O(log n)
+ *
+ * @param root
+ * @param key
+ * @param right 必须是空树
+ * @return int 0: 成功; -1: 失败（right 非空或两棵树不满足 rbtree_join 中的条件）
+ */
+int rbtree_split(struct rbtree_root *root, void *key, struct rbtree_root *right);
+
+/**
+ * @brief 并集，把 src 的节点合并到 dst，src 变为空树；key 重复时保留 dst 的节点，释放 src 的节点。
+ *        以 src 的根为界 split dst，两半分别与 src 的左右子树递归合并后再 join，
+ *        较大的两半在不同的线程上执行
+ *
+ * @param dst
+ * @param src
+ * @param nr_threads 最多使用的线程数（包括调用线程），不大于 1 时不创建线程
+ * @return int 0: 成功; -1: 两棵树不满足 rbtree_join 中的条件
+ */
+int rbtree_union(struct rbtree_root *dst, struct rbtree_root *src, int nr_threads);
+
+/**
+ * @brief 交集，只保留 dst 中在 src 中也存在的 key，src 不变
+ *
+ * @param dst
+ * @param src
+ * @param nr_threads 同 rbtree_union
+ * @return int 0: 成功; -1: 两棵树的 cmp_key 或节点布局不同
+ */
+int rbtree_intersect(struct rbtree_root *dst, struct rbtree_root *src, int nr_threads);
+
+/**
+ * @brief 差集，删除 dst 中在 src 中存在的 key，src 不变
+ *
+ * @param dst
+ * @param src
+ * @param nr_threads 同 rbtree_union
+ * @return int 0: 成功; -1: 两棵树的 cmp_key 或节点布局不同
+ */
+int rbtree_difference(struct rbtree_root *dst, struct rbtree_root *src, int nr_threads);
+
+/**
+ * @brief 并行遍历，对每个节点调用一次 cb。树在子树边界处切成约 nr_threads * 8 个 key 连续的任务，
+ *        由工作线程按需领取；同一个任务内按中序调用，不同任务之间的顺序不确定。
+ *        整个过程持有读锁，cb 中不能修改树
+ *
+ * @param root
+ * @param nr_threads 最多使用的线程数（包括调用线程），不大于 1 时在调用线程中按中序遍历
+ * @param cb
+ * @param ctx 透传给 cb
+ * @return int 0: 成功; -1: 参数错误或内存不足
+ */
+int rbtree_parallel_foreach(struct rbtree_root *root, int nr_threads,
+                            void (*cb)(void *key, void *value, void *ctx), void *ctx);
+
+/**
+ * @brief 并行归约，任务的划分同 rbtree_parallel_foreach。每个任务由 init 创建部分结果，
+ *        用 map 把任务内的节点依次累加进去；全部任务完成后，在调用线程中按 key 的顺序
+ *        用 reduce 把各部分结果合并到 result，reduce 负责释放 partial，可以不满足交换律
+ *
+ * @param root
+ * @param nr_threads 同 rbtree_parallel_foreach
+ * @param init 可以为 NULL，此时 partial 为 NULL
+ * @param map
+ * @param reduce
+ * @param result 透传给 reduce
+ * @param ctx 透传给 init、map、reduce
+ * @return int 0: 成功; -1: 参数错误或内存不足
+ */
+int rbtree_parallel_reduce(struct rbtree_root *root, int nr_threads, void *(*init)(void *ctx),
+                           void (*map)(void *partial, void *key, void *value, void *ctx),
+                           void (*reduce)(void *result, void *partial, void *ctx), void *result,
+                           void *ctx);
+
+/**
+ * @brief 按节点数把树均分成 nr_parts 段连续的 key 区间，每段在一个线程中调用一次 fn。
+ *        开启 order_stat 时由子树大小直接定位各段的起点，否则先并行统计一遍节点数
+ *
+ * @param root
+ * @param nr_parts 段数，同时也是线程数（包括调用线程）
+ * @param fn cursor 指向该段的第一个节点（n 为 0 时不指向任何节点），用 rbtree_cursor_next 向后移动
+ *           n - 1 次即访问完该段。读锁已由本函数持有，cursor 为 RBTREE_CURSOR_LOCK_BATCH 模式，
+ *           fn 中不能再加锁或修改树
+ * @param ctx 透传给 fn
+ * @return int 0: 成功; -1: 参数错误或内存不足
+ */
+int rbtree_parallel_ranges(struct rbtree_root *root, int nr_parts,
+                           void (*fn)(int part, struct rbtree_cursor *cursor, size_t n, void *ctx),
+                           void *ctx);
+
 /**
  * @brief 前序遍历
  *
@@ -97,8 +377,176 @@ void rbtree_inorder(struct rbtree_root *root, void (*cb)(void *key, void *value)
  */
 void rbtree_postorder(struct rbtree_root *root, void (*cb)(void *key, void *value));
 
-// void rbtree_levelorder(struct rbtree_root *root, void (*cb)(void *key, void *value));
+/**
+ * @brief 有序遍历的游标，可以放在栈上，用 rbtree_cursor_init 初始化
+ *
+ * 游标移动时在锁内记下当前节点的 key/value，rbtree_cursor_key/value 不再访问节点。
+ * RBTREE_CURSOR_LOCK_BATCH: 移动游标期间调用者需持有 rbtree_read_lock，key/value 是节点中的指针。
+ * RBTREE_CURSOR_LOCK_STEP: 每次移动单独加读锁；若两次移动之间树中增删过节点，游标失效，
+ *                          next/prev 返回 false 且 rbtree_cursor_invalidated 返回 true，
+ *                          rbtree_cursor_key 仍返回失效前的 key，可用它 upper_bound/lower_bound
+ *                          重新定位。节点的 key 由树持有（插入时 key_copy 为 true，或 key 按值保存在
+ *                          节点中）时，游标在锁内复制一份自己持有，节点被删除后仍然有效，用完游标后
+ *                          调用 rbtree_cursor_release 释放；否则 key 是插入时传入的指针，由调用者保证有效。
+ *                          value 始终是节点中的指针，树设置了 free_value 时在节点被删除或 value
+ *                          被替换后释放，调用者需自行复制。
+ */
+struct rbtree_cursor {
+    struct rbtree_root *root;
+    void *node;
+    uint64_t version;
+    int lock_mode;
+    bool invalidated; // 因树被修改而失效，与到达两端区分
+    bool key_owned;   // key 是游标持有的副本，由 rbtree_cursor_release 或下一次移动释放
+    void *key;        // 当前节点的 key，失效时为失效前的 key
+    void *value;      // 当前节点的 value
+};
+
+/**
+ * @brief 加读锁，用于 RBTREE_CURSOR_LOCK_BATCH 模式的游标
+ *
+ * @param root
+ */
+void rbtree_read_lock(struct rbtree_root *root);
+
+/**
+ * @brief 释放 rbtree_read_lock 加的读锁
+ *
+ * @param root
+ */
+void rbtree_read_unlock(struct rbtree_root *root);
+
+/**
+ * @brief 初始化游标，初始化后游标不指向任何节点
+ *
+ * @param cursor
+ * @param root
+ * @param lock_mode RBTREE_CURSOR_LOCK_BATCH 或 RBTREE_CURSOR_LOCK_STEP
+ */
+void rbtree_cursor_init(struct rbtree_cursor *cursor, struct rbtree_root *root, int lock_mode);
+
+/**
+ * @brief 释放游标持有的 key 副本，之后游标不指向任何节点，可以继续移动或丢弃。
+ *        RBTREE_CURSOR_LOCK_STEP 模式的游标用完后必须调用，其余模式调用也无害
+ *
+ * @param cursor
+ */
+void rbtree_cursor_release(struct rbtree_cursor *cursor);
+
+/**
+ * @brief 定位到最小的 key
+ *
+ * @param cursor
+ * @return true 游标指向一个节点
+ * @return false 树为空
+ */
+bool rbtree_cursor_first(struct rbtree_cursor *cursor);
+
+/**
+ * @brief 定位到最大的 key
+ *
+ * @param cursor
+ * @return true 游标指向一个节点
+ * @return false 树为空
+ */
+bool rbtree_cursor_last(struct rbtree_cursor *cursor);
+
+/**
+ * @brief 定位到第一个大于等于 key 的节点
+ *
+ * @param cursor
+ * @param key
+ * @return true 游标指向一个节点
+ * @return false 不存在这样的节点
+ */
+bool rbtree_cursor_lower_bound(struct rbtree_cursor *cursor, void *key);
+
+/**
+ * @brief 定位到第一个大于 key 的节点
+ *
+ * @param cursor
+ * @param key
+ * @return true 游标指向一个节点
+ * @return false 不存在这样的节点
+ */
+bool rbtree_cursor_upper_bound(struct rbtree_cursor *cursor, void *key);
+
+/**
+ * @brief 定位到第一个大于等于 key 的节点，同 rbtree_cursor_lower_bound
+ *
+ * @param cursor
+ * @param key
+ * @return true 游标指向一个节点
+ * @return false 不存在这样的节点
+ */
+bool rbtree_cursor_seek(struct rbtree_cursor *cursor, void *key);
+
+/**
+ * @brief 移动到下一个（更大的）节点，沿父节点指针移动，均摊 O(1)
+ *
+ * @param cursor
+ * @return true 游标指向一个节点
+ * @return false 已经越过最大的节点，或游标已失效（用 rbtree_cursor_invalidated 区分）
+ */
+bool rbtree_cursor_next(struct rbtree_cursor *cursor);
+
+/**
+ * @brief 移动到上一个（更小的）节点，沿父节点指针移动，均摊 O(1)
+ *
+ * @param cursor
+ * @return true 游标指向一个节点
+ * @return false 已经越过最小的节点，或游标已失效（用 rbtree_cursor_invalidated 区分）
+ */
+bool rbtree_cursor_prev(struct rbtree_cursor *cursor);
+
+/**
+ * @brief 判断游标是否指向一个节点
+ *
+ * @param cursor
+ * @return true
+ * @return false
+ */
+bool rbtree_cursor_valid(struct rbtree_cursor *cursor);
+
+/**
+ * @brief 判断游标是否因为树在两次移动之间被修改而失效（仅 RBTREE_CURSOR_LOCK_STEP），
+ *        重新定位后清除
+ *
+ * @param cursor
+ * @return true 需要用 rbtree_cursor_key 返回的 key 重新定位
+ * @return false
+ */
+bool rbtree_cursor_invalidated(struct rbtree_cursor *cursor);
+
+/**
+ * @brief 游标当前节点的 key；游标失效时返回失效前的 key，不指向节点时返回 NULL。
+ *        返回值在游标下一次移动或 rbtree_cursor_release 之前有效
+ *
+ * @param cursor
+ * @return void*
+ */
+void *rbtree_cursor_key(struct rbtree_cursor *cursor);
+
+/**
+ * @brief 游标当前节点的 value，游标不指向节点时返回 NULL
+ *
+ * @param cursor
+ * @return void*
+ */
+void *rbtree_cursor_value(struct rbtree_cursor *cursor);
+
+/**
+ * @brief 层序遍历，同一层从左到右
+ *
+ * @param root
+ * @param cb
+ */
+void rbtree_levelorder(struct rbtree_root *root, void (*cb)(void *key, void *value));
 
 void print_rbtree(struct rbtree_root *root);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* UTILS_RB_TREE */
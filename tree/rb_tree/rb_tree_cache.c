@@ -0,0 +1,181 @@
+#include <stdlib.h>
+#include <memory.h>
+#include "rb_tree.h"
+#include "rb_tree_internal.h"
+
+#define RB_CACHE_WAYS    2  // 组相联的路数，第 0 路为最近使用的一路
+#define RB_CACHE_STRIPES 16 // 命中计数分散到的缓存行数，并发读者各用一行，避免在同一行上争用
+
+// 缓存的一组，两组占一个缓存行。读者在读锁下并发填充和调整，各字段单独原子读写；
+// 读到不匹配的 hash/node 组合时由 cmp_key 校验排除，node 非 NULL 时一定是树中的节点
+struct cache_set {
+    uint64_t hash[RB_CACHE_WAYS];
+    node_t *node[RB_CACHE_WAYS];
+};
+
+struct cache_stripe {
+    uint64_t hits;
+    uint64_t misses;
+} __attribute__((aligned(64)));
+
+struct rbtree_cache {
+    struct cache_set *sets;
+    size_t mask;
+    uint64_t (*hash_key)(void *key);
+    struct cache_stripe stripes[RB_CACHE_STRIPES];
+};
+
+static unsigned cache_stripe_next;
+static __thread unsigned cache_stripe_id; // 0 表示尚未分配
+
+// 与 rb_tree_shard.c 的默认哈希一致：splitmix64 的终结函数
+static uint64_t default_hash_key(void *key)
+{
+    uint64_t x = (uint64_t)key;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static inline struct cache_stripe *cache_stripe(struct rbtree_cache *cache)
+{
+    if (cache_stripe_id == 0) {
+        cache_stripe_id = __atomic_add_fetch(&cache_stripe_next, 1, __ATOMIC_RELAXED);
+    }
+    return &cache->stripes[cache_stripe_id & (RB_CACHE_STRIPES - 1)];
+}
+
+struct rbtree_cache *rbtree_cache_create(size_t size, uint64_t (*hash_key)(void *key))
+{
+    struct rbtree_cache *cache;
+    size_t nr_sets = 1;
+
+    while (nr_sets * RB_CACHE_WAYS < size) {
+        nr_sets <<= 1;
+    }
+    if (posix_memalign((void **)&cache, 64, sizeof(struct rbtree_cache)) != 0) {
+        return NULL;
+    }
+    memset(cache, 0, sizeof(struct rbtree_cache));
+    if (posix_memalign((void **)&cache->sets, 64, nr_sets * sizeof(struct cache_set)) != 0) {
+        free(cache);
+        return NULL;
+    }
+    memset(cache->sets, 0, nr_sets * sizeof(struct cache_set));
+    cache->mask = nr_sets - 1;
+    cache->hash_key = hash_key ? hash_key : default_hash_key;
+    return cache;
+}
+
+void rbtree_cache_destroy(struct rbtree_cache *cache)
+{
+    if (cache) {
+        free(cache->sets);
+        free(cache);
+    }
+}
+
+node_t *rbtree_cache_lookup(rbroot_t *root, void *key, uint64_t *hash)
+{
+    struct rbtree_cache *cache = root->cache;
+    struct cache_set *set;
+    uint64_t h = cache->hash_key(key);
+    node_t *node;
+    int w;
+
+    set = &cache->sets[h & cache->mask];
+    for (w = 0; w < RB_CACHE_WAYS; w++) {
+        if (__atomic_load_n(&set->hash[w], __ATOMIC_RELAXED) != h) {
+            continue;
+        }
+        node = __atomic_load_n(&set->node[w], __ATOMIC_RELAXED);
+        if (node && root->cmp_key(key, node->key) == 0) {
+            if (w > 0) {
+                // 换到第 0 路，下次替换时淘汰另一路
+                __atomic_store_n(&set->node[w], __atomic_load_n(&set->node[0], __ATOMIC_RELAXED),
+                                 __ATOMIC_RELAXED);
+                __atomic_store_n(&set->hash[w], __atomic_load_n(&set->hash[0], __ATOMIC_RELAXED),
+                                 __ATOMIC_RELAXED);
+                __atomic_store_n(&set->node[0], node, __ATOMIC_RELAXED);
+                __atomic_store_n(&set->hash[0], h, __ATOMIC_RELAXED);
+            }
+            __atomic_fetch_add(&cache_stripe(cache)->hits, 1, __ATOMIC_RELAXED);
+            return node;
+        }
+    }
+    __atomic_fetch_add(&cache_stripe(cache)->misses, 1, __ATOMIC_RELAXED);
+    *hash = h;
+    return NULL;
+}
+
+void rbtree_cache_fill(rbroot_t *root, uint64_t hash, node_t *node, bool evict)
+{
+    struct cache_set *set = &root->cache->sets[hash & root->cache->mask];
+    int w;
+
+    if (!evict) {
+        // 插入时只占用空闲的一路，不把热点 key 挤出去
+        for (w = 0; w < RB_CACHE_WAYS; w++) {
+            if (__atomic_load_n(&set->node[w], __ATOMIC_RELAXED) == NULL) {
+                __atomic_store_n(&set->hash[w], hash, __ATOMIC_RELAXED);
+                __atomic_store_n(&set->node[w], node, __ATOMIC_RELAXED);
+                return;
+            }
+        }
+        return;
+    }
+    for (w = RB_CACHE_WAYS - 1; w > 0; w--) {
+        __atomic_store_n(&set->node[w], __atomic_load_n(&set->node[w - 1], __ATOMIC_RELAXED),
+                         __ATOMIC_RELAXED);
+        __atomic_store_n(&set->hash[w], __atomic_load_n(&set->hash[w - 1], __ATOMIC_RELAXED),
+                         __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&set->node[0], node, __ATOMIC_RELAXED);
+    __atomic_store_n(&set->hash[0], hash, __ATOMIC_RELAXED);
+}
+
+void rbtree_cache_insert(rbroot_t *root, node_t *node)
+{
+    rbtree_cache_fill(root, root->cache->hash_key(node->key), node, false);
+}
+
+void rbtree_cache_invalidate(rbroot_t *root, node_t *node)
+{
+    struct cache_set *set;
+    int w;
+
+    set = &root->cache->sets[root->cache->hash_key(node->key) & root->cache->mask];
+    for (w = 0; w < RB_CACHE_WAYS; w++) {
+        if (set->node[w] == node) {
+            set->node[w] = NULL;
+        }
+    }
+}
+
+void rbtree_cache_reset(rbroot_t *root)
+{
+    if (root->cache) {
+        memset(root->cache->sets, 0, (root->cache->mask + 1) * sizeof(struct cache_set));
+    }
+}
+
+int rbtree_cache_stats(struct rbtree_root *root, uint64_t *hits, uint64_t *misses)
+{
+    uint64_t h = 0, m = 0;
+    int i;
+
+    if (root == NULL || root->cache == NULL) {
+        return -1;
+    }
+    for (i = 0; i < RB_CACHE_STRIPES; i++) {
+        h += __atomic_load_n(&root->cache->stripes[i].hits, __ATOMIC_RELAXED);
+        m += __atomic_load_n(&root->cache->stripes[i].misses, __ATOMIC_RELAXED);
+    }
+    if (hits) {
+        *hits = h;
+    }
+    if (misses) {
+        *misses = m;
+    }
+    return 0;
+}
@@ -1,36 +1,133 @@
 #ifndef RB_TREE_RB_TREE_CPP
 #define RB_TREE_RB_TREE_CPP
 
+#include <cstddef>
+#include <cstdio>
 #include <iostream>
+#include <iterator>
 #include <list>
+#include <memory>
+#include <memory_resource>
+#include <new>
 #include <queue>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#if defined(__cpp_lib_ranges)
+#include <ranges>
+#endif
 
 namespace tree
 {
 
 enum RBTColor { RBT_RED, RBT_BLACK };
 
+// 节点中对外可见的部分：key 构造后不能修改，data 可以修改。迭代器解引用得到它，看不到颜色和链接
 template <typename Tk, typename Tv>
-struct SRBTreeNode {
-    Tk key;
+struct SRBTreeEntry {
+    const Tk key;
     Tv data;
+
+    template <typename K, typename V>
+    SRBTreeEntry(K &&k, V &&v) : key(std::forward<K>(k)), data(std::forward<V>(v))
+    {
+    }
+
+    // key 和 data 分别由两个元组中的参数就地构造，与 std::pair 的 piecewise 构造相同
+    template <typename... KArgs, typename... VArgs>
+    SRBTreeEntry(std::piecewise_construct_t, std::tuple<KArgs...> k_args,
+                 std::tuple<VArgs...> v_args)
+        : key(std::make_from_tuple<Tk>(std::move(k_args))),
+          data(std::make_from_tuple<Tv>(std::move(v_args)))
+    {
+    }
+};
+
+template <typename Tk, typename Tv>
+struct SRBTreeNode : SRBTreeEntry<Tk, Tv> {
     RBTColor color;
     SRBTreeNode *parent;
     SRBTreeNode *left;
     SRBTreeNode *right;
+    size_t size; // 以该节点为根的子树的节点数
 
-    SRBTreeNode(Tk k, Tv v, RBTColor c, SRBTreeNode *p, SRBTreeNode *l, SRBTreeNode *r)
-        : key(k), data(v), color(c), parent(p), left(l), right(r)
+    template <typename K, typename V>
+    SRBTreeNode(K &&k, V &&v, RBTColor c, SRBTreeNode *p, SRBTreeNode *l, SRBTreeNode *r)
+        : SRBTreeEntry<Tk, Tv>(std::forward<K>(k), std::forward<V>(v)), color(c), parent(p),
+          left(l), right(r), size(1)
+    {
+    }
+
+    template <typename K, typename V>
+    SRBTreeNode(K &&k, V &&v)
+        : SRBTreeNode(std::forward<K>(k), std::forward<V>(v), RBT_BLACK, nullptr, nullptr, nullptr)
+    {
+    }
+
+    template <typename... KArgs, typename... VArgs>
+    SRBTreeNode(std::piecewise_construct_t pc, std::tuple<KArgs...> k_args,
+                std::tuple<VArgs...> v_args)
+        : SRBTreeEntry<Tk, Tv>(pc, std::move(k_args), std::move(v_args)), color(RBT_BLACK),
+          parent(nullptr), left(nullptr), right(nullptr), size(1)
     {
     }
 };
 
-template <typename Tk, typename Tv>
+template <typename Tk, typename Tv, bool b_const>
+class CRBTreeIterator;
+
+// Alloc 与 std::map 一样以 std::pair<const Tk, Tv> 为值类型，内部 rebind 到 SRBTreeNode<Tk, Tv>
+template <typename Tk, typename Tv, typename Alloc = std::allocator<std::pair<const Tk, Tv>>>
 class CRBTree
 {
 public:
+    using allocator_type = Alloc;
+
     CRBTree();
+    explicit CRBTree(const Alloc &alloc);
     ~CRBTree();
+    allocator_type GetAllocator() const { return allocator_type(m_alloc); }
+
+    // 按 key 升序遍历的双向迭代器，解引用得到 SRBTreeEntry：key 只读，data 可以修改（const_iterator
+    // 也只读），颜色和链接不可见。迭代器沿 parent 指针移动，不分配内存；删除节点只使指向该节点的迭代器失效
+    using iterator = CRBTreeIterator<Tk, Tv, false>;
+    using const_iterator = CRBTreeIterator<Tk, Tv, true>;
+    using reverse_iterator = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+    iterator begin() { return iterator(rb_first(m_pNodeRoot), &m_pNodeRoot); }
+    const_iterator begin() const { return const_iterator(rb_first(m_pNodeRoot), &m_pNodeRoot); }
+    const_iterator cbegin() const { return begin(); }
+    iterator end() { return iterator(nullptr, &m_pNodeRoot); }
+    const_iterator end() const { return const_iterator(nullptr, &m_pNodeRoot); }
+    const_iterator cend() const { return end(); }
+    reverse_iterator rbegin() { return reverse_iterator(end()); }
+    const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+    reverse_iterator rend() { return reverse_iterator(begin()); }
+    const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+    // 第一个不小于 key 的节点
+    iterator lower_bound(const Tk &key) { return iterator(lowerBound(key), &m_pNodeRoot); }
+    const_iterator lower_bound(const Tk &key) const
+    {
+        return const_iterator(lowerBound(key), &m_pNodeRoot);
+    }
+    // 第一个大于 key 的节点
+    iterator upper_bound(const Tk &key) { return iterator(upperBound(key), &m_pNodeRoot); }
+    const_iterator upper_bound(const Tk &key) const
+    {
+        return const_iterator(upperBound(key), &m_pNodeRoot);
+    }
+    // key 相同的所有节点，即 [lower_bound(key), upper_bound(key))
+    std::pair<iterator, iterator> equal_range(const Tk &key)
+    {
+        return {lower_bound(key), upper_bound(key)};
+    }
+    std::pair<const_iterator, const_iterator> equal_range(const Tk &key) const
+    {
+        return {lower_bound(key), upper_bound(key)};
+    }
+
     // 前序遍历
     std::list<Tk> Preorder(bool b_print);
     // 中序遍历
@@ -42,19 +139,45 @@ public:
     // 打印红黑数（类似tree命令）
     void Print(bool b_color);
     // 判断一个key是否存在于树中
-    bool IsExist(Tk key);
+    bool IsExist(const Tk &key);
     // 查找一个key对应的Node(递归)，如果没有返回NULL
-    SRBTreeNode<Tk, Tv> *Search(Tk key);
+    SRBTreeNode<Tk, Tv> *Search(const Tk &key);
     // 查找一个key对应的Node(迭代)，如果没有返回NULL
-    SRBTreeNode<Tk, Tv> *SearchIterative(Tk key);
+    SRBTreeNode<Tk, Tv> *SearchIterative(const Tk &key);
     // 查找红黑数最小节点
     SRBTreeNode<Tk, Tv> *Min();
     // 查找红黑数最大节点
     SRBTreeNode<Tk, Tv> *Max();
-    // 插入一个节点
-    bool Insert(Tk key, Tv value);
-    // 删除一个节点
-    bool Remove(Tk key, Tv &value);
+    // 插入一个节点，以上一次插入的节点作为位置提示，提示连续落空时暂停尝试。
+    // key 和 value 分别完美转发到节点的构造，右值被移动、左值被拷贝，每个节点只分配一次
+    template <typename K = Tk, typename V = Tv>
+    bool Insert(K &&key, V &&value);
+    // 带位置提示的插入：key 落在 hint 与其前驱或后继之间时最多比较两次即可挂载，否则从根查找。
+    // 返回新节点，可以作为下一次的 hint，失败时返回 nullptr
+    template <typename K = Tk, typename V = Tv>
+    SRBTreeNode<Tk, Tv> *InsertHint(SRBTreeNode<Tk, Tv> *hint, K &&key, V &&value);
+    // 由 args 在节点中就地构造 key 和 value 后插入，args 为 (key, value) 或
+    // (std::piecewise_construct, key 的参数元组, value 的参数元组)。与 Insert 一样允许重复的 key，
+    // 返回新节点，失败时返回 nullptr
+    template <typename... Args>
+    SRBTreeNode<Tk, Tv> *Emplace(Args &&...args);
+    // key 不存在时才分配节点并由 args 就地构造 value，key 已存在时不构造任何对象也不移动参数。
+    // 返回 key 所在的节点以及是否插入了新节点，分配失败时返回 {nullptr, false}
+    template <typename... Args>
+    std::pair<SRBTreeNode<Tk, Tv> *, bool> TryEmplace(const Tk &key, Args &&...args);
+    template <typename... Args>
+    std::pair<SRBTreeNode<Tk, Tv> *, bool> TryEmplace(Tk &&key, Args &&...args);
+    // 删除一个节点，节点的 value 移动到 value 中
+    bool Remove(const Tk &key, Tv &value);
+    // 节点数
+    size_t Size();
+    // 小于 key 的节点数，O(log n)
+    size_t Rank(const Tk &key);
+    // 中序遍历中下标为 k（从 0 开始）的节点，k 超出范围时返回 nullptr，O(log n)
+    SRBTreeNode<Tk, Tv> *Select(size_t k);
+    // 由按 key 严格升序排列的数据在 O(n) 时间内构建红黑树，不比较 key，所有节点一次分配，
+    // 树必须为空
+    bool BuildFromSorted(const Tk *keys, const Tv *values, size_t n);
 
 private:
     void preorder(SRBTreeNode<Tk, Tv> *tree, std::list<Tk> &list_out, bool b_print);
@@ -64,23 +187,53 @@ private:
     void print(SRBTreeNode<Tk, Tv> *node, size_t n_deepth, std::vector<bool> &vec_flag,
                bool b_color);
 
-    SRBTreeNode<Tk, Tv> *search(SRBTreeNode<Tk, Tv> *node, Tk key);
-    SRBTreeNode<Tk, Tv> *searchIterative(SRBTreeNode<Tk, Tv> *node, Tk key);
+    SRBTreeNode<Tk, Tv> *search(SRBTreeNode<Tk, Tv> *node, const Tk &key);
+    SRBTreeNode<Tk, Tv> *searchIterative(SRBTreeNode<Tk, Tv> *node, const Tk &key);
     SRBTreeNode<Tk, Tv> *min(SRBTreeNode<Tk, Tv> *node);
     SRBTreeNode<Tk, Tv> *max(SRBTreeNode<Tk, Tv> *node);
 
     void leftRotate(SRBTreeNode<Tk, Tv> *&root, SRBTreeNode<Tk, Tv> *x);
     void rightRotate(SRBTreeNode<Tk, Tv> *&root, SRBTreeNode<Tk, Tv> *y);
     void insert(SRBTreeNode<Tk, Tv> *&root, SRBTreeNode<Tk, Tv> *node);
+    SRBTreeNode<Tk, Tv> *insertLast(SRBTreeNode<Tk, Tv> *node);
+    SRBTreeNode<Tk, Tv> *insertHint(SRBTreeNode<Tk, Tv> *hint, SRBTreeNode<Tk, Tv> *node);
+    template <typename K, typename... Args>
+    std::pair<SRBTreeNode<Tk, Tv> *, bool> tryEmplace(K &&key, Args &&...args);
+    bool hintSlot(SRBTreeNode<Tk, Tv> *hint, const Tk &key, SRBTreeNode<Tk, Tv> *&parent,
+                  bool &left);
+    void link(SRBTreeNode<Tk, Tv> *&root, SRBTreeNode<Tk, Tv> *node, SRBTreeNode<Tk, Tv> *parent,
+              bool left);
+    SRBTreeNode<Tk, Tv> *lowerBound(const Tk &key) const;
+    SRBTreeNode<Tk, Tv> *upperBound(const Tk &key) const;
     void insertFixUp(SRBTreeNode<Tk, Tv> *&root, SRBTreeNode<Tk, Tv> *node);
     void remove(SRBTreeNode<Tk, Tv> *&root, SRBTreeNode<Tk, Tv> *node);
     void removeFixUp(SRBTreeNode<Tk, Tv> *&root, SRBTreeNode<Tk, Tv> *node,
                      SRBTreeNode<Tk, Tv> *parent);
 
+    SRBTreeNode<Tk, Tv> *buildSorted(SRBTreeNode<Tk, Tv> *nodes, const Tk *keys, const Tv *values,
+                                     size_t lo, size_t hi, SRBTreeNode<Tk, Tv> *parent,
+                                     size_t depth, size_t red_depth);
+    template <typename... Args>
+    SRBTreeNode<Tk, Tv> *newNode(Args &&...args);
+    void releaseNode(SRBTreeNode<Tk, Tv> *node);
+    static size_t subtreeSize(SRBTreeNode<Tk, Tv> *node) { return node ? node->size : 0; }
+    void adjustSize(SRBTreeNode<Tk, Tv> *node, int delta);
     void destroy(SRBTreeNode<Tk, Tv> *tree);
 
 private:
+    using NodeAlloc =
+        typename std::allocator_traits<Alloc>::template rebind_alloc<SRBTreeNode<Tk, Tv>>;
+    using NodeTraits = std::allocator_traits<NodeAlloc>;
+    static_assert(std::is_same<typename NodeTraits::pointer, SRBTreeNode<Tk, Tv> *>::value,
+                  "CRBTree links nodes with raw pointers, Alloc must allocate them");
+
+    NodeAlloc m_alloc;
     SRBTreeNode<Tk, Tv> *m_pNodeRoot; // 根节点
+    // BuildFromSorted 分配的节点块，块中的节点只析构不单独释放
+    std::vector<std::pair<SRBTreeNode<Tk, Tv> *, size_t>> m_vecBlock;
+    SRBTreeNode<Tk, Tv> *m_pLastInsert; // 上一次插入的节点，被删除时置空
+    unsigned m_nHintMiss;               // m_pLastInsert 提示连续落空的次数
+    unsigned m_nInsertCount;
 };
 
 template <typename Tk, typename Tv>
@@ -131,63 +284,193 @@ inline void rb_set_color(SRBTreeNode<Tk, Tv> *r, RBTColor c)
     r->color = c;
 }
 
+// 子树中最小的节点，子树为空时返回 nullptr
 template <typename Tk, typename Tv>
-CRBTree<Tk, Tv>::CRBTree() : m_pNodeRoot(nullptr)
+inline SRBTreeNode<Tk, Tv> *rb_first(SRBTreeNode<Tk, Tv> *node)
 {
+    if (node != nullptr) {
+        while (node->left != nullptr) {
+            node = node->left;
+        }
+    }
+    return node;
 }
 
+// 子树中最大的节点，子树为空时返回 nullptr
 template <typename Tk, typename Tv>
-CRBTree<Tk, Tv>::~CRBTree()
+inline SRBTreeNode<Tk, Tv> *rb_last(SRBTreeNode<Tk, Tv> *node)
 {
-    destroy(m_pNodeRoot);
+    if (node != nullptr) {
+        while (node->right != nullptr) {
+            node = node->right;
+        }
+    }
+    return node;
 }
 
+// 中序遍历的后继，node 为最大节点时返回 nullptr
 template <typename Tk, typename Tv>
-std::list<Tk> CRBTree<Tk, Tv>::Preorder(bool b_print)
+inline SRBTreeNode<Tk, Tv> *rb_next(SRBTreeNode<Tk, Tv> *node)
+{
+    if (node->right != nullptr) {
+        return rb_first(node->right);
+    }
+    while (node->parent != nullptr && node->parent->right == node) {
+        node = node->parent;
+    }
+    return node->parent;
+}
+
+// 中序遍历的前驱，node 为最小节点时返回 nullptr
+template <typename Tk, typename Tv>
+inline SRBTreeNode<Tk, Tv> *rb_prev(SRBTreeNode<Tk, Tv> *node)
+{
+    if (node->left != nullptr) {
+        return rb_last(node->left);
+    }
+    while (node->parent != nullptr && node->parent->left == node) {
+        node = node->parent;
+    }
+    return node->parent;
+}
+
+// end() 的节点为空，另外保存树的根指针的地址，从 end() 后退时取当前的最大节点
+template <typename Tk, typename Tv, bool b_const>
+class CRBTreeIterator
+{
+public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = SRBTreeEntry<Tk, Tv>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = std::conditional_t<b_const, const value_type *, value_type *>;
+    using reference = std::conditional_t<b_const, const value_type &, value_type &>;
+
+    CRBTreeIterator() : m_pNode(nullptr), m_ppRoot(nullptr) {}
+    CRBTreeIterator(SRBTreeNode<Tk, Tv> *node, SRBTreeNode<Tk, Tv> *const *root)
+        : m_pNode(node), m_ppRoot(root)
+    {
+    }
+    // iterator 可以隐式转换为 const_iterator
+    template <bool b_other, typename = std::enable_if_t<b_const && !b_other>>
+    CRBTreeIterator(const CRBTreeIterator<Tk, Tv, b_other> &other)
+        : m_pNode(other.m_pNode), m_ppRoot(other.m_ppRoot)
+    {
+    }
+
+    reference operator*() const { return *m_pNode; }
+    pointer operator->() const { return m_pNode; }
+
+    CRBTreeIterator &operator++()
+    {
+        m_pNode = rb_next(m_pNode);
+        return *this;
+    }
+    CRBTreeIterator operator++(int)
+    {
+        CRBTreeIterator it = *this;
+        ++*this;
+        return it;
+    }
+    CRBTreeIterator &operator--()
+    {
+        m_pNode = m_pNode != nullptr ? rb_prev(m_pNode) : rb_last(*m_ppRoot);
+        return *this;
+    }
+    CRBTreeIterator operator--(int)
+    {
+        CRBTreeIterator it = *this;
+        --*this;
+        return it;
+    }
+
+    friend bool operator==(const CRBTreeIterator &a, const CRBTreeIterator &b)
+    {
+        return a.m_pNode == b.m_pNode;
+    }
+    friend bool operator!=(const CRBTreeIterator &a, const CRBTreeIterator &b)
+    {
+        return a.m_pNode != b.m_pNode;
+    }
+
+private:
+    template <typename, typename, bool>
+    friend class CRBTreeIterator;
+
+    SRBTreeNode<Tk, Tv> *m_pNode;
+    SRBTreeNode<Tk, Tv> *const *m_ppRoot;
+};
+
+template <typename Tk, typename Tv, typename Alloc>
+CRBTree<Tk, Tv, Alloc>::CRBTree() : CRBTree(Alloc())
+{
+}
+
+template <typename Tk, typename Tv, typename Alloc>
+CRBTree<Tk, Tv, Alloc>::CRBTree(const Alloc &alloc)
+    : m_alloc(alloc), m_pNodeRoot(nullptr), m_pLastInsert(nullptr), m_nHintMiss(0),
+      m_nInsertCount(0)
+{
+}
+
+template <typename Tk, typename Tv, typename Alloc>
+CRBTree<Tk, Tv, Alloc>::~CRBTree()
+{
+    destroy(m_pNodeRoot);
+    for (auto &block : m_vecBlock) {
+        NodeTraits::deallocate(m_alloc, block.first, block.second);
+    }
+}
+
+template <typename Tk, typename Tv, typename Alloc>
+std::list<Tk> CRBTree<Tk, Tv, Alloc>::Preorder(bool b_print)
 {
     std::list<Tk> listOut;
     preorder(m_pNodeRoot, listOut, b_print);
     if (b_print) {
         std::cout << std::endl;
     }
+    return listOut;
 }
-template <typename Tk, typename Tv>
-std::list<Tk> CRBTree<Tk, Tv>::Inorder(bool b_print)
+template <typename Tk, typename Tv, typename Alloc>
+std::list<Tk> CRBTree<Tk, Tv, Alloc>::Inorder(bool b_print)
 {
     std::list<Tk> listOut;
     inorder(m_pNodeRoot, listOut, b_print);
     if (b_print) {
         std::cout << std::endl;
     }
+    return listOut;
 }
-template <typename Tk, typename Tv>
-std::list<Tk> CRBTree<Tk, Tv>::Postorder(bool b_print)
+template <typename Tk, typename Tv, typename Alloc>
+std::list<Tk> CRBTree<Tk, Tv, Alloc>::Postorder(bool b_print)
 {
     std::list<Tk> listOut;
     postorder(m_pNodeRoot, listOut, b_print);
     if (b_print) {
         std::cout << std::endl;
     }
+    return listOut;
 }
-template <typename Tk, typename Tv>
-std::list<Tk> CRBTree<Tk, Tv>::Levelorder(bool b_print)
+template <typename Tk, typename Tv, typename Alloc>
+std::list<Tk> CRBTree<Tk, Tv, Alloc>::Levelorder(bool b_print)
 {
     std::list<Tk> listOut;
     levelorder(m_pNodeRoot, listOut, b_print);
     if (b_print) {
         std::cout << std::endl;
     }
+    return listOut;
 }
 
-template <typename Tk, typename Tv>
-void CRBTree<Tk, Tv>::Print(bool b_color)
+template <typename Tk, typename Tv, typename Alloc>
+void CRBTree<Tk, Tv, Alloc>::Print(bool b_color)
 {
     std::vector<bool> vecFlag;
     print(m_pNodeRoot, 0, vecFlag, b_color);
 }
 
-template <typename Tk, typename Tv>
-bool CRBTree<Tk, Tv>::IsExist(Tk key)
+template <typename Tk, typename Tv, typename Alloc>
+bool CRBTree<Tk, Tv, Alloc>::IsExist(const Tk &key)
 {
     if (m_pNodeRoot == NULL) {
         return 0;
@@ -195,88 +478,193 @@ bool CRBTree<Tk, Tv>::IsExist(Tk key)
     return SearchIterative(key) == nullptr ? false : true;
 }
 
-template <typename Tk, typename Tv>
-SRBTreeNode<Tk, Tv> *CRBTree<Tk, Tv>::Search(Tk key)
+template <typename Tk, typename Tv, typename Alloc>
+SRBTreeNode<Tk, Tv> *CRBTree<Tk, Tv, Alloc>::Search(const Tk &key)
 {
     return search(m_pNodeRoot, key);
 }
 
-template <typename Tk, typename Tv>
-SRBTreeNode<Tk, Tv> *CRBTree<Tk, Tv>::SearchIterative(Tk key)
+template <typename Tk, typename Tv, typename Alloc>
+SRBTreeNode<Tk, Tv> *CRBTree<Tk, Tv, Alloc>::SearchIterative(const Tk &key)
 {
     return searchIterative(m_pNodeRoot, key);
 }
 
-template <typename Tk, typename Tv>
-SRBTreeNode<Tk, Tv> *CRBTree<Tk, Tv>::Min()
+template <typename Tk, typename Tv, typename Alloc>
+SRBTreeNode<Tk, Tv> *CRBTree<Tk, Tv, Alloc>::Min()
 {
     return min(m_pNodeRoot);
 }
 
-template <typename Tk, typename Tv>
-SRBTreeNode<Tk, Tv> *CRBTree<Tk, Tv>::Max()
+template <typename Tk, typename Tv, typename Alloc>
+SRBTreeNode<Tk, Tv> *CRBTree<Tk, Tv, Alloc>::Max()
 {
     return max(m_pNodeRoot);
 }
 
-template <typename Tk, typename Tv>
-bool CRBTree<Tk, Tv>::Insert(Tk key, Tv value)
+template <typename Tk, typename Tv, typename Alloc>
+template <typename K, typename V>
+bool CRBTree<Tk, Tv, Alloc>::Insert(K &&key, V &&value)
 {
-    SRBTreeNode<Tk, Tv> *node =
-        new (std::nothrow) SRBTreeNode<Tk, Tv>(key, value, RBT_BLACK, nullptr, nullptr, nullptr);
+    return Emplace(std::forward<K>(key), std::forward<V>(value)) != nullptr;
+}
+
+template <typename Tk, typename Tv, typename Alloc>
+template <typename K, typename V>
+SRBTreeNode<Tk, Tv> *CRBTree<Tk, Tv, Alloc>::InsertHint(SRBTreeNode<Tk, Tv> *hint, K &&key,
+                                                        V &&value)
+{
+    SRBTreeNode<Tk, Tv> *node = newNode(std::forward<K>(key), std::forward<V>(value));
     if (node == nullptr) {
-        return false;
+        return nullptr;
     }
-    insert(m_pNodeRoot, node);
-    return true;
+    return insertHint(hint, node);
 }
 
-template <typename Tk, typename Tv>
-bool CRBTree<Tk, Tv>::Remove(Tk key, Tv &value)
+template <typename Tk, typename Tv, typename Alloc>
+template <typename... Args>
+SRBTreeNode<Tk, Tv> *CRBTree<Tk, Tv, Alloc>::Emplace(Args &&...args)
+{
+    SRBTreeNode<Tk, Tv> *node = newNode(std::forward<Args>(args)...);
+    if (node == nullptr) {
+        return nullptr;
+    }
+    return insertLast(node);
+}
+
+template <typename Tk, typename Tv, typename Alloc>
+template <typename... Args>
+std::pair<SRBTreeNode<Tk, Tv> *, bool> CRBTree<Tk, Tv, Alloc>::TryEmplace(const Tk &key,
+                                                                          Args &&...args)
+{
+    return tryEmplace(key, std::forward<Args>(args)...);
+}
+
+template <typename Tk, typename Tv, typename Alloc>
+template <typename... Args>
+std::pair<SRBTreeNode<Tk, Tv> *, bool> CRBTree<Tk, Tv, Alloc>::TryEmplace(Tk &&key, Args &&...args)
+{
+    return tryEmplace(std::move(key), std::forward<Args>(args)...);
+}
+
+template <typename Tk, typename Tv, typename Alloc>
+bool CRBTree<Tk, Tv, Alloc>::Remove(const Tk &key, Tv &value)
 {
     SRBTreeNode<Tk, Tv> *node = search(m_pNodeRoot, key);
 
     if (node == NULL) {
         return false;
     }
-    value = node->data;
+    value = std::move(node->data);
     remove(m_pNodeRoot, node);
     return true;
 }
 
+template <typename Tk, typename Tv, typename Alloc>
+size_t CRBTree<Tk, Tv, Alloc>::Size()
+{
+    return subtreeSize(m_pNodeRoot);
+}
+
+template <typename Tk, typename Tv, typename Alloc>
+size_t CRBTree<Tk, Tv, Alloc>::Rank(const Tk &key)
+{
+    size_t n = 0;
+    SRBTreeNode<Tk, Tv> *node = m_pNodeRoot;
+    while (node != nullptr) {
+        if (node->key < key) {
+            // 左子树和当前节点都小于 key
+            n += subtreeSize(node->left) + 1;
+            node = node->right;
+        } else {
+            node = node->left;
+        }
+    }
+    return n;
+}
+
+template <typename Tk, typename Tv, typename Alloc>
+SRBTreeNode<Tk, Tv> *CRBTree<Tk, Tv, Alloc>::Select(size_t k)
+{
+    SRBTreeNode<Tk, Tv> *node = m_pNodeRoot;
+    while (node != nullptr) {
+        size_t left = subtreeSize(node->left);
+        if (k == left) {
+            break;
+        }
+        if (k < left) {
+            node = node->left;
+        } else {
+            k -= left + 1;
+            node = node->right;
+        }
+    }
+    return node;
+}
+
+template <typename Tk, typename Tv, typename Alloc>
+bool CRBTree<Tk, Tv, Alloc>::BuildFromSorted(const Tk *keys, const Tv *values, size_t n)
+{
+    if (m_pNodeRoot != nullptr) {
+        return false;
+    }
+    if (n == 0) {
+        return true;
+    }
+    SRBTreeNode<Tk, Tv> *nodes;
+    try {
+        nodes = NodeTraits::allocate(m_alloc, n);
+    } catch (const std::bad_alloc &) {
+        return false;
+    }
+    m_vecBlock.emplace_back(nodes, n);
+
+    // 折半构建时所有叶子的深度为 floor(log2(n)) 或少 1，把最深一层染红即可让各路径黑高相同
+    size_t redDepth = 0;
+    while ((n >> (redDepth + 1)) != 0) {
+        redDepth++;
+    }
+    m_pNodeRoot = buildSorted(nodes, keys, values, 0, n, nullptr, 0, redDepth);
+    rb_set_black(m_pNodeRoot);
+    return true;
+}
+
 // --------------------------- private ---------------------------
-template <typename Tk, typename Tv>
-void CRBTree<Tk, Tv>::preorder(SRBTreeNode<Tk, Tv> *tree, std::list<Tk> &list_out, bool b_print)
+template <typename Tk, typename Tv, typename Alloc>
+void CRBTree<Tk, Tv, Alloc>::preorder(SRBTreeNode<Tk, Tv> *tree, std::list<Tk> &list_out,
+                                      bool b_print)
 {
     if (tree != nullptr) {
         list_out.push_back(tree->key);
         if (b_print) {
             std::cout << tree->key << " ";
         }
-        preorder(tree->left);
-        preorder(tree->right);
+        preorder(tree->left, list_out, b_print);
+        preorder(tree->right, list_out, b_print);
     }
 }
 
-template <typename Tk, typename Tv>
-void CRBTree<Tk, Tv>::inorder(SRBTreeNode<Tk, Tv> *tree, std::list<Tk> &list_out, bool b_print)
+template <typename Tk, typename Tv, typename Alloc>
+void CRBTree<Tk, Tv, Alloc>::inorder(SRBTreeNode<Tk, Tv> *tree, std::list<Tk> &list_out,
+                                     bool b_print)
 {
     if (tree != nullptr) {
-        preorder(tree->left);
+        inorder(tree->left, list_out, b_print);
         list_out.push_back(tree->key);
         if (b_print) {
             std::cout << tree->key << " ";
         }
-        preorder(tree->right);
+        inorder(tree->right, list_out, b_print);
     }
 }
 
-template <typename Tk, typename Tv>
-void CRBTree<Tk, Tv>::postorder(SRBTreeNode<Tk, Tv> *tree, std::list<Tk> &list_out, bool b_print)
+template <typename Tk, typename Tv, typename Alloc>
+void CRBTree<Tk, Tv, Alloc>::postorder(SRBTreeNode<Tk, Tv> *tree, std::list<Tk> &list_out,
+                                       bool b_print)
 {
     if (tree != nullptr) {
-        preorder(tree->left);
-        preorder(tree->right);
+        postorder(tree->left, list_out, b_print);
+        postorder(tree->right, list_out, b_print);
         list_out.push_back(tree->key);
         if (b_print) {
             std::cout << tree->key << " ";
@@ -284,8 +672,9 @@ void CRBTree<Tk, Tv>::postorder(SRBTreeNode<Tk, Tv> *tree, std::list<Tk> &list_o
     }
 }
 
-template <typename Tk, typename Tv>
-void CRBTree<Tk, Tv>::levelorder(SRBTreeNode<Tk, Tv> *tree, std::list<Tk> &list_out, bool b_print)
+template <typename Tk, typename Tv, typename Alloc>
+void CRBTree<Tk, Tv, Alloc>::levelorder(SRBTreeNode<Tk, Tv> *tree, std::list<Tk> &list_out,
+                                        bool b_print)
 {
     if (tree == nullptr) {
         return;
@@ -295,22 +684,22 @@ void CRBTree<Tk, Tv>::levelorder(SRBTreeNode<Tk, Tv> *tree, std::list<Tk> &list_
     while (!queueNode.empty()) {
         SRBTreeNode<Tk, Tv> *pNode = queueNode.front();
         queueNode.pop();
-        list_out.push_back(pNode->val);
+        list_out.push_back(pNode->key);
         if (b_print) {
             std::cout << pNode->key << " ";
         }
-        if (pNode->pLeftNode != nullptr) {
-            queueNode.push(pNode->pLeftNode);
+        if (pNode->left != nullptr) {
+            queueNode.push(pNode->left);
         }
-        if (pNode->pRightNode != nullptr) {
-            queueNode.push(pNode->pRightNode);
+        if (pNode->right != nullptr) {
+            queueNode.push(pNode->right);
         }
     }
 }
 
-template <typename Tk, typename Tv>
-void CRBTree<Tk, Tv>::print(SRBTreeNode<Tk, Tv> *node, size_t n_deepth, std::vector<bool> &vec_flag,
-                            bool b_color)
+template <typename Tk, typename Tv, typename Alloc>
+void CRBTree<Tk, Tv, Alloc>::print(SRBTreeNode<Tk, Tv> *node, size_t n_deepth,
+                                   std::vector<bool> &vec_flag, bool b_color)
 {
     if (n_deepth > 0) {
         for (size_t i = 0; i < n_deepth - 1; i++) {
@@ -342,8 +731,8 @@ void CRBTree<Tk, Tv>::print(SRBTreeNode<Tk, Tv> *node, size_t n_deepth, std::vec
     print(node->left, n_deepth + 1, vec_flag, b_color);
 }
 
-template <typename Tk, typename Tv>
-SRBTreeNode<Tk, Tv> *CRBTree<Tk, Tv>::search(SRBTreeNode<Tk, Tv> *node, Tk key)
+template <typename Tk, typename Tv, typename Alloc>
+SRBTreeNode<Tk, Tv> *CRBTree<Tk, Tv, Alloc>::search(SRBTreeNode<Tk, Tv> *node, const Tk &key)
 {
     if (node == nullptr || node->key == key)
         return node;
@@ -354,8 +743,9 @@ SRBTreeNode<Tk, Tv> *CRBTree<Tk, Tv>::search(SRBTreeNode<Tk, Tv> *node, Tk key)
         return search(node->right, key);
 }
 
-template <typename Tk, typename Tv>
-SRBTreeNode<Tk, Tv> *CRBTree<Tk, Tv>::searchIterative(SRBTreeNode<Tk, Tv> *node, Tk key)
+template <typename Tk, typename Tv, typename Alloc>
+SRBTreeNode<Tk, Tv> *CRBTree<Tk, Tv, Alloc>::searchIterative(SRBTreeNode<Tk, Tv> *node,
+                                                             const Tk &key)
 {
     while ((node != NULL) && (node->key != key)) {
         if (key < node->key)
@@ -366,8 +756,8 @@ SRBTreeNode<Tk, Tv> *CRBTree<Tk, Tv>::searchIterative(SRBTreeNode<Tk, Tv> *node,
     return node;
 }
 
-template <typename Tk, typename Tv>
-SRBTreeNode<Tk, Tv> *CRBTree<Tk, Tv>::min(SRBTreeNode<Tk, Tv> *node)
+template <typename Tk, typename Tv, typename Alloc>
+SRBTreeNode<Tk, Tv> *CRBTree<Tk, Tv, Alloc>::min(SRBTreeNode<Tk, Tv> *node)
 {
     if (node == NULL)
         return NULL;
@@ -377,8 +767,8 @@ SRBTreeNode<Tk, Tv> *CRBTree<Tk, Tv>::min(SRBTreeNode<Tk, Tv> *node)
     return node;
 }
 
-template <typename Tk, typename Tv>
-SRBTreeNode<Tk, Tv> *CRBTree<Tk, Tv>::max(SRBTreeNode<Tk, Tv> *node)
+template <typename Tk, typename Tv, typename Alloc>
+SRBTreeNode<Tk, Tv> *CRBTree<Tk, Tv, Alloc>::max(SRBTreeNode<Tk, Tv> *node)
 {
     if (node == NULL)
         return NULL;
@@ -388,8 +778,8 @@ SRBTreeNode<Tk, Tv> *CRBTree<Tk, Tv>::max(SRBTreeNode<Tk, Tv> *node)
     return node;
 }
 
-template <typename Tk, typename Tv>
-void CRBTree<Tk, Tv>::leftRotate(SRBTreeNode<Tk, Tv> *&root, SRBTreeNode<Tk, Tv> *x)
+template <typename Tk, typename Tv, typename Alloc>
+void CRBTree<Tk, Tv, Alloc>::leftRotate(SRBTreeNode<Tk, Tv> *&root, SRBTreeNode<Tk, Tv> *x)
 {
     SRBTreeNode<Tk, Tv> *y = x->right;
     x->right = y->left;
@@ -408,10 +798,12 @@ void CRBTree<Tk, Tv>::leftRotate(SRBTreeNode<Tk, Tv> *&root, SRBTreeNode<Tk, Tv>
     }
     y->left = x;
     x->parent = y;
+    y->size = x->size;
+    x->size = subtreeSize(x->left) + subtreeSize(x->right) + 1;
 }
 
-template <typename Tk, typename Tv>
-void CRBTree<Tk, Tv>::rightRotate(SRBTreeNode<Tk, Tv> *&root, SRBTreeNode<Tk, Tv> *y)
+template <typename Tk, typename Tv, typename Alloc>
+void CRBTree<Tk, Tv, Alloc>::rightRotate(SRBTreeNode<Tk, Tv> *&root, SRBTreeNode<Tk, Tv> *y)
 {
     SRBTreeNode<Tk, Tv> *x = y->left;
     y->left = x->right;
@@ -420,7 +812,7 @@ void CRBTree<Tk, Tv>::rightRotate(SRBTreeNode<Tk, Tv> *&root, SRBTreeNode<Tk, Tv
     }
     x->parent = y->parent;
     if (y->parent == NULL) {
-        root = y;
+        root = x;
     } else {
         if (y->parent->right == y) {
             y->parent->right = x;
@@ -430,10 +822,12 @@ void CRBTree<Tk, Tv>::rightRotate(SRBTreeNode<Tk, Tv> *&root, SRBTreeNode<Tk, Tv
     }
     x->right = y;
     y->parent = x;
+    x->size = y->size;
+    y->size = subtreeSize(y->left) + subtreeSize(y->right) + 1;
 }
 
-template <typename Tk, typename Tv>
-void CRBTree<Tk, Tv>::insert(SRBTreeNode<Tk, Tv> *&root, SRBTreeNode<Tk, Tv> *node)
+template <typename Tk, typename Tv, typename Alloc>
+void CRBTree<Tk, Tv, Alloc>::insert(SRBTreeNode<Tk, Tv> *&root, SRBTreeNode<Tk, Tv> *node)
 {
     SRBTreeNode<Tk, Tv> *y = NULL;
     SRBTreeNode<Tk, Tv> *x = root;
@@ -445,23 +839,166 @@ void CRBTree<Tk, Tv>::insert(SRBTreeNode<Tk, Tv> *&root, SRBTreeNode<Tk, Tv> *no
             x = x->right;
         }
     }
-    rb_set_parent(node, y);
-    // rb_parent(node) =s y;
-    if (y == NULL) {
+    // 包含了相同值的情况，新节点在所有相同的 key 之后
+    link(root, node, y, y != NULL && node->key < y->key);
+}
+
+// key 落在 hint 与其前驱或后继之间时，得到与 insert 相同的挂载位置并返回 true
+template <typename Tk, typename Tv, typename Alloc>
+bool CRBTree<Tk, Tv, Alloc>::hintSlot(SRBTreeNode<Tk, Tv> *hint, const Tk &key,
+                                      SRBTreeNode<Tk, Tv> *&parent, bool &left)
+{
+    SRBTreeNode<Tk, Tv> *near;
+    if (!(key < hint->key)) {
+        // 位置在 hint 之后：后继为空或大于 key
+        near = rb_next(hint);
+        if (near != nullptr && !(key < near->key)) {
+            return false;
+        }
+        if (hint->right == nullptr) {
+            parent = hint;
+            left = false;
+        } else {
+            parent = near;
+            left = true;
+        }
+        return true;
+    }
+    // 位置在 hint 之前：前驱为空或不大于 key
+    near = rb_prev(hint);
+    if (near != nullptr && key < near->key) {
+        return false;
+    }
+    if (hint->left == nullptr) {
+        parent = hint;
+        left = true;
+    } else {
+        parent = near;
+        left = false;
+    }
+    return true;
+}
+
+// 以上一次插入的节点作为位置提示挂载 node，提示连续落空时只每 16 次插入尝试一次，
+// 乱序插入基本不增加比较次数
+template <typename Tk, typename Tv, typename Alloc>
+SRBTreeNode<Tk, Tv> *CRBTree<Tk, Tv, Alloc>::insertLast(SRBTreeNode<Tk, Tv> *node)
+{
+    SRBTreeNode<Tk, Tv> *parent;
+    bool left;
+    if (m_pLastInsert != nullptr && (m_nHintMiss < 4 || (++m_nInsertCount & 15) == 0)) {
+        if (hintSlot(m_pLastInsert, node->key, parent, left)) {
+            m_nHintMiss = 0;
+            link(m_pNodeRoot, node, parent, left);
+            m_pLastInsert = node;
+            return node;
+        }
+        m_nHintMiss++;
+    }
+    insert(m_pNodeRoot, node);
+    m_pLastInsert = node;
+    return node;
+}
+
+template <typename Tk, typename Tv, typename Alloc>
+SRBTreeNode<Tk, Tv> *CRBTree<Tk, Tv, Alloc>::insertHint(SRBTreeNode<Tk, Tv> *hint,
+                                                        SRBTreeNode<Tk, Tv> *node)
+{
+    SRBTreeNode<Tk, Tv> *parent;
+    bool left;
+    if (hint != nullptr && hintSlot(hint, node->key, parent, left)) {
+        link(m_pNodeRoot, node, parent, left);
+    } else {
+        insert(m_pNodeRoot, node);
+    }
+    m_pLastInsert = node;
+    return node;
+}
+
+// 先查找挂载位置，key 不存在时才构造节点，key 只有在构造节点时才被移动
+template <typename Tk, typename Tv, typename Alloc>
+template <typename K, typename... Args>
+std::pair<SRBTreeNode<Tk, Tv> *, bool> CRBTree<Tk, Tv, Alloc>::tryEmplace(K &&key, Args &&...args)
+{
+    SRBTreeNode<Tk, Tv> *parent = nullptr;
+    SRBTreeNode<Tk, Tv> *x = m_pNodeRoot;
+    bool left = false;
+    while (x != nullptr) {
+        parent = x;
+        if (key < x->key) {
+            left = true;
+            x = x->left;
+        } else if (x->key < key) {
+            left = false;
+            x = x->right;
+        } else {
+            return {x, false};
+        }
+    }
+    SRBTreeNode<Tk, Tv> *node =
+        newNode(std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)),
+                std::forward_as_tuple(std::forward<Args>(args)...));
+    if (node == nullptr) {
+        return {nullptr, false};
+    }
+    link(m_pNodeRoot, node, parent, left);
+    m_pLastInsert = node;
+    return {node, true};
+}
+
+// 把红色的新节点挂到 parent 的左孩子或右孩子，parent 为空时作为根节点，然后修正红黑树
+template <typename Tk, typename Tv, typename Alloc>
+void CRBTree<Tk, Tv, Alloc>::link(SRBTreeNode<Tk, Tv> *&root, SRBTreeNode<Tk, Tv> *node,
+                                  SRBTreeNode<Tk, Tv> *parent, bool left)
+{
+    rb_set_parent(node, parent);
+    if (parent == NULL) {
         // 插入根节点
         root = node;
-    } else if (node->key < y->key) {
-        y->left = node;
+    } else if (left) {
+        parent->left = node;
     } else {
-        // 包含了相同值的情况，其实也就是更新
-        y->right = node;
+        parent->right = node;
     }
+    adjustSize(parent, 1);
     node->color = RBT_RED;
     insertFixUp(root, node);
 }
 
-template <typename Tk, typename Tv>
-void CRBTree<Tk, Tv>::insertFixUp(SRBTreeNode<Tk, Tv> *&root, SRBTreeNode<Tk, Tv> *node)
+template <typename Tk, typename Tv, typename Alloc>
+SRBTreeNode<Tk, Tv> *CRBTree<Tk, Tv, Alloc>::lowerBound(const Tk &key) const
+{
+    SRBTreeNode<Tk, Tv> *node = m_pNodeRoot;
+    SRBTreeNode<Tk, Tv> *bound = nullptr;
+    while (node != nullptr) {
+        if (node->key < key) {
+            node = node->right;
+        } else {
+            bound = node;
+            node = node->left;
+        }
+    }
+    return bound;
+}
+
+template <typename Tk, typename Tv, typename Alloc>
+SRBTreeNode<Tk, Tv> *CRBTree<Tk, Tv, Alloc>::upperBound(const Tk &key) const
+{
+    SRBTreeNode<Tk, Tv> *node = m_pNodeRoot;
+    SRBTreeNode<Tk, Tv> *bound = nullptr;
+    while (node != nullptr) {
+        if (key < node->key) {
+            bound = node;
+            node = node->left;
+        } else {
+            node = node->right;
+        }
+    }
+    return bound;
+}
+
+template <typename Tk, typename Tv, typename Alloc>
+void CRBTree<Tk, Tv, Alloc>::insertFixUp(SRBTreeNode<Tk, Tv> *&root, SRBTreeNode<Tk, Tv> *node)
 {
     SRBTreeNode<Tk, Tv> *parent, *gparent;
     while ((parent = rb_parent(node)) && rb_is_red(parent)) {
@@ -477,8 +1014,8 @@ void CRBTree<Tk, Tv>::insertFixUp(SRBTreeNode<Tk, Tv> *&root, SRBTreeNode<Tk, Tv
             }
             // 到这表示叔叔节点是黑节点
             if (parent->right == node) { // case 2: 叔叔是黑色，当前节点是父节点的右孩子
-                swap(parent, node);     // 将“父节点”作为“新的当前节点”
-                leftRotate(root, node); // 以“新的当前节点”为支点进行左旋
+                std::swap(parent, node); // 将“父节点”作为“新的当前节点”
+                leftRotate(root, node);  // 以“新的当前节点”为支点进行左旋
                 // 经过上面的左旋后，当前节点一定是左孩子了
             }
 
@@ -498,7 +1035,7 @@ void CRBTree<Tk, Tv>::insertFixUp(SRBTreeNode<Tk, Tv> *&root, SRBTreeNode<Tk, Tv
             }
             // 到这表示叔叔节点是黑节点
             if (parent->left == node) { // case 2: 叔叔是黑色，当前节点是父节点的左孩子
-                swap(parent, node);      // 将“父节点”作为“新的当前节点”
+                std::swap(parent, node); // 将“父节点”作为“新的当前节点”
                 rightRotate(root, node); // 以“新的当前节点”为支点进行右旋
                 // 经过上面的右旋后，当前节点一定是右孩子了
             }
@@ -511,8 +1048,8 @@ void CRBTree<Tk, Tv>::insertFixUp(SRBTreeNode<Tk, Tv> *&root, SRBTreeNode<Tk, Tv
     rb_set_black(root);
 }
 
-template <typename Tk, typename Tv>
-void CRBTree<Tk, Tv>::remove(SRBTreeNode<Tk, Tv> *&root, SRBTreeNode<Tk, Tv> *node)
+template <typename Tk, typename Tv, typename Alloc>
+void CRBTree<Tk, Tv, Alloc>::remove(SRBTreeNode<Tk, Tv> *&root, SRBTreeNode<Tk, Tv> *node)
 {
     SRBTreeNode<Tk, Tv> *child, *parent;
     int color;
@@ -524,6 +1061,8 @@ void CRBTree<Tk, Tv>::remove(SRBTreeNode<Tk, Tv> *&root, SRBTreeNode<Tk, Tv> *no
         replace = replace->right;
         while (replace->left != NULL)
             replace = replace->left;
+        // 从取代节点原来的位置向上，路径上每个子树都少了一个节点
+        adjustSize(rb_parent(replace), -1);
 
         if (rb_parent(node)) { // 不是根节点
             if (rb_parent(node)->left == node) {
@@ -555,11 +1094,12 @@ void CRBTree<Tk, Tv>::remove(SRBTreeNode<Tk, Tv> *&root, SRBTreeNode<Tk, Tv> *no
         replace->color = node->color;
         replace->left = node->left;
         node->left->parent = replace;
+        replace->size = node->size;
 
         if (color == RBT_BLACK) {
             removeFixUp(root, child, parent);
         }
-        free(node);
+        releaseNode(node);
         return;
     }
     if (node->left != NULL) {
@@ -569,6 +1109,7 @@ void CRBTree<Tk, Tv>::remove(SRBTreeNode<Tk, Tv> *&root, SRBTreeNode<Tk, Tv> *no
     }
     parent = node->parent;
     color = node->color;
+    adjustSize(parent, -1);
 
     if (child) {
         child->parent = parent;
@@ -586,13 +1127,13 @@ void CRBTree<Tk, Tv>::remove(SRBTreeNode<Tk, Tv> *&root, SRBTreeNode<Tk, Tv> *no
     if (color == RBT_BLACK) {
         removeFixUp(root, child, parent);
     }
-    free(node);
+    releaseNode(node);
     return;
 }
 
-template <typename Tk, typename Tv>
-void CRBTree<Tk, Tv>::removeFixUp(SRBTreeNode<Tk, Tv> *&root, SRBTreeNode<Tk, Tv> *node,
-                                  SRBTreeNode<Tk, Tv> *parent)
+template <typename Tk, typename Tv, typename Alloc>
+void CRBTree<Tk, Tv, Alloc>::removeFixUp(SRBTreeNode<Tk, Tv> *&root, SRBTreeNode<Tk, Tv> *node,
+                                         SRBTreeNode<Tk, Tv> *parent)
 {
     SRBTreeNode<Tk, Tv> *other;
     while ((!node || rb_is_black(node)) && node != root) { // 调整节点不是根节点
@@ -602,7 +1143,7 @@ void CRBTree<Tk, Tv>::removeFixUp(SRBTreeNode<Tk, Tv> *&root, SRBTreeNode<Tk, Tv
                 // case 1: x的兄弟节点是红色
                 rb_set_black(other);
                 rb_set_red(parent);
-                rightRotate(root, parent);
+                leftRotate(root, parent);
                 other = parent->right;
             }
             if ((!other->left || rb_is_black(other->left)) &&
@@ -664,21 +1205,198 @@ void CRBTree<Tk, Tv>::removeFixUp(SRBTreeNode<Tk, Tv> *&root, SRBTreeNode<Tk, Tv
         rb_set_black(node);
 }
 
-template <typename Tk, typename Tv>
-void CRBTree<Tk, Tv>::destroy(SRBTreeNode<Tk, Tv> *tree)
+template <typename Tk, typename Tv, typename Alloc>
+SRBTreeNode<Tk, Tv> *CRBTree<Tk, Tv, Alloc>::buildSorted(SRBTreeNode<Tk, Tv> *nodes, const Tk *keys,
+                                                         const Tv *values, size_t lo, size_t hi,
+                                                         SRBTreeNode<Tk, Tv> *parent, size_t depth,
+                                                         size_t red_depth)
+{
+    if (lo >= hi) {
+        return nullptr;
+    }
+    size_t mid = lo + (hi - lo) / 2;
+    SRBTreeNode<Tk, Tv> *node = &nodes[mid];
+    NodeTraits::construct(m_alloc, node, keys[mid], values[mid],
+                          depth == red_depth ? RBT_RED : RBT_BLACK, parent, nullptr, nullptr);
+    node->size = hi - lo;
+    node->left = buildSorted(nodes, keys, values, lo, mid, node, depth + 1, red_depth);
+    node->right = buildSorted(nodes, keys, values, mid + 1, hi, node, depth + 1, red_depth);
+    return node;
+}
+
+// 把 node 及其所有祖先的子树大小加上 delta
+template <typename Tk, typename Tv, typename Alloc>
+void CRBTree<Tk, Tv, Alloc>::adjustSize(SRBTreeNode<Tk, Tv> *node, int delta)
+{
+    for (; node != nullptr; node = node->parent) {
+        node->size += delta;
+    }
+}
+
+// 分配失败时返回 nullptr，与原先的 new (std::nothrow) 一致；构造抛出的异常照常传出
+template <typename Tk, typename Tv, typename Alloc>
+template <typename... Args>
+SRBTreeNode<Tk, Tv> *CRBTree<Tk, Tv, Alloc>::newNode(Args &&...args)
+{
+    SRBTreeNode<Tk, Tv> *node;
+    try {
+        node = NodeTraits::allocate(m_alloc, 1);
+    } catch (const std::bad_alloc &) {
+        return nullptr;
+    }
+    try {
+        NodeTraits::construct(m_alloc, node, std::forward<Args>(args)...);
+    } catch (...) {
+        NodeTraits::deallocate(m_alloc, node, 1);
+        throw;
+    }
+    return node;
+}
+
+template <typename Tk, typename Tv, typename Alloc>
+void CRBTree<Tk, Tv, Alloc>::releaseNode(SRBTreeNode<Tk, Tv> *node)
+{
+    if (node == m_pLastInsert) {
+        m_pLastInsert = nullptr;
+    }
+    for (auto &block : m_vecBlock) {
+        if (node >= block.first && node < block.first + block.second) {
+            NodeTraits::destroy(m_alloc, node);
+            return;
+        }
+    }
+    NodeTraits::destroy(m_alloc, node);
+    NodeTraits::deallocate(m_alloc, node, 1);
+}
+
+template <typename Tk, typename Tv, typename Alloc>
+void CRBTree<Tk, Tv, Alloc>::destroy(SRBTreeNode<Tk, Tv> *tree)
 {
     if (tree == NULL)
         return;
 
     if (tree->left != NULL)
-        return destroy(tree->left);
+        destroy(tree->left);
     if (tree->right != NULL)
-        return destroy(tree->right);
+        destroy(tree->right);
 
-    delete tree;
-    tree = NULL;
+    releaseNode(tree);
 }
 
+// 按 SRBTreeNode<Tk, Tv> 的大小切分的节点池：从上游资源整块申请，释放的节点挂在空闲链表上
+// 复用，其它大小的请求（如 BuildFromSorted 的整块分配）直接转给上游。块只在 Release 或析构时
+// 归还上游，以 std::pmr::monotonic_buffer_resource 为上游时整棵树的内存可以一次丢弃。
+// 不是线程安全的，一个池只供单线程使用的树共享
+template <typename Tk, typename Tv>
+class CRBTreeNodePool : public std::pmr::memory_resource
+{
+public:
+    explicit CRBTreeNodePool(std::pmr::memory_resource *upstream = std::pmr::get_default_resource())
+        : m_pUpstream(upstream), m_pFree(nullptr), m_pCur(nullptr), m_nLeft(0), m_nNext(kMinChunk)
+    {
+    }
+    CRBTreeNodePool(const CRBTreeNodePool &) = delete;
+    CRBTreeNodePool &operator=(const CRBTreeNodePool &) = delete;
+    ~CRBTreeNodePool() override { Release(); }
+
+    // 把所有块归还上游，池中的节点必须已经不再使用
+    void Release();
+    std::pmr::memory_resource *Upstream() const { return m_pUpstream; }
+
+protected:
+    void *do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void *p, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+
+private:
+    static constexpr size_t kNodeSize = sizeof(SRBTreeNode<Tk, Tv>);
+    static constexpr size_t kNodeAlign = alignof(SRBTreeNode<Tk, Tv>);
+    static constexpr size_t kMinChunk = 64;   // 第一块的节点数，之后每块翻倍
+    static constexpr size_t kMaxChunk = 4096; // 每块节点数的上限
+
+    struct SFree {
+        SFree *next;
+    };
+    static bool isNode(size_t bytes, size_t alignment)
+    {
+        return bytes == kNodeSize && alignment <= kNodeAlign;
+    }
+
+    std::pmr::memory_resource *m_pUpstream;
+    std::vector<std::pair<void *, size_t>> m_vecChunk; // 块地址和节点数
+    SFree *m_pFree;                                    // 释放的节点
+    char *m_pCur;                                      // 当前块中未切分部分的起点
+    size_t m_nLeft;                                    // 当前块中未切分的节点数
+    size_t m_nNext;                                    // 下一块的节点数
+};
+
+template <typename Tk, typename Tv>
+void CRBTreeNodePool<Tk, Tv>::Release()
+{
+    for (auto &chunk : m_vecChunk) {
+        m_pUpstream->deallocate(chunk.first, chunk.second * kNodeSize, kNodeAlign);
+    }
+    m_vecChunk.clear();
+    m_pFree = nullptr;
+    m_pCur = nullptr;
+    m_nLeft = 0;
+    m_nNext = kMinChunk;
+}
+
+template <typename Tk, typename Tv>
+void *CRBTreeNodePool<Tk, Tv>::do_allocate(size_t bytes, size_t alignment)
+{
+    if (!isNode(bytes, alignment)) {
+        return m_pUpstream->allocate(bytes, alignment);
+    }
+    if (m_pFree != nullptr) {
+        SFree *node = m_pFree;
+        m_pFree = node->next;
+        return node;
+    }
+    if (m_nLeft == 0) {
+        m_vecChunk.reserve(m_vecChunk.size() + 1);
+        m_pCur = static_cast<char *>(m_pUpstream->allocate(m_nNext * kNodeSize, kNodeAlign));
+        m_vecChunk.emplace_back(m_pCur, m_nNext);
+        m_nLeft = m_nNext;
+        if (m_nNext < kMaxChunk) {
+            m_nNext *= 2;
+        }
+    }
+    void *node = m_pCur;
+    m_pCur += kNodeSize;
+    m_nLeft--;
+    return node;
+}
+
+template <typename Tk, typename Tv>
+void CRBTreeNodePool<Tk, Tv>::do_deallocate(void *p, size_t bytes, size_t alignment)
+{
+    if (!isNode(bytes, alignment)) {
+        m_pUpstream->deallocate(p, bytes, alignment);
+        return;
+    }
+    SFree *node = static_cast<SFree *>(p);
+    node->next = m_pFree;
+    m_pFree = node;
+}
+
+namespace pmr
+{
+// 节点从 std::pmr::memory_resource 分配的红黑树，例如 CRBTreeNodePool 或 monotonic_buffer_resource
+template <typename Tk, typename Tv>
+using CRBTree = tree::CRBTree<Tk, Tv, std::pmr::polymorphic_allocator<std::pair<const Tk, Tv>>>;
+} // namespace pmr
+
+#if defined(__cpp_lib_ranges)
+// C++20 下可以直接交给 std::ranges 的算法和视图
+static_assert(std::ranges::bidirectional_range<CRBTree<int, int>>);
+static_assert(std::ranges::bidirectional_range<const CRBTree<int, int>>);
+#endif
+
 } // namespace tree
 
 #endif /* RB_TREE_RB_TREE_CPP */
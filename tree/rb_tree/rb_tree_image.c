@@ -0,0 +1,471 @@
+#include "rb_tree_image.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "rb_tree_internal.h"
+
+#define RB_IMAGE_MAGIC   "RBTIMG\0\0"
+#define RB_IMAGE_VERSION 1
+#define RB_IMAGE_ALIGN   8 // 每个 key/value 的起始位置按 8 字节对齐，反序列化时可以直接读取整数
+
+#define image_align(n) (((n) + RB_IMAGE_ALIGN - 1) & ~(uint64_t)(RB_IMAGE_ALIGN - 1))
+
+// 镜像文件的头部，之后依次是节点数组和数据区
+struct image_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t node_size; // sizeof(struct image_node)，用于检查文件是否由同样的布局写入
+    uint64_t nr_nodes;
+    uint64_t nodes_off; // 节点数组相对文件开头的偏移
+    uint64_t data_off;  // 数据区相对文件开头的偏移
+    uint64_t data_size;
+};
+
+// 节点按前序排列，下标 0 为根；孩子用相对自身的下标差表示，0 表示没有该孩子
+struct image_node {
+    uint64_t key_off; // 相对数据区的偏移
+    uint64_t value_off;
+    uint32_t key_len;
+    uint32_t value_len;
+    uint64_t left;
+    uint64_t right;
+};
+
+struct rbtree_image {
+    void *base;
+    size_t size;
+    const struct image_node *nodes;
+    uint64_t nr_nodes;
+    const char *data;
+    uint64_t data_size;
+    int (*cmp_key)(void *key0, void *key1);
+    void *(*deserialize_key)(const void *buf, size_t len);
+    void *(*deserialize_value)(const void *buf, size_t len);
+};
+
+// 写镜像时的状态，nodes 是按中序排列的树节点
+struct image_writer {
+    rbroot_t *root;
+    node_t **nodes;
+    FILE *fp;
+    char *buf;
+    size_t cap;
+    uint64_t off;
+    int err;
+};
+
+// 与 rb_tree.c 中的默认 cmp_key 一致：key 本身是一个整数
+static int default_cmp_key(void *key0, void *key1)
+{
+    if ((uint64_t)key0 < (uint64_t)key1) {
+        return -1;
+    } else if ((uint64_t)key0 > (uint64_t)key1) {
+        return 1;
+    }
+    return 0;
+}
+
+static size_t default_serialize(void *obj, void *buf, size_t size)
+{
+    uint64_t x = (uint64_t)(uintptr_t)obj;
+    if (size >= sizeof(x)) {
+        memcpy(buf, &x, sizeof(x));
+    }
+    return sizeof(x);
+}
+
+static void *default_deserialize(const void *buf, size_t len)
+{
+    if (len != sizeof(uint64_t)) {
+        return NULL;
+    }
+    return (void *)(uintptr_t)*(const uint64_t *)buf;
+}
+
+static node_t *image_next(node_t *node)
+{
+    node_t *parent;
+
+    if (node->right != NULL) {
+        for (node = node->right; node->left != NULL; node = node->left) {
+        }
+        return node;
+    }
+    while ((parent = rb_parent(node)) != NULL && parent->right == node) {
+        node = parent;
+    }
+    return parent;
+}
+
+// 按中序收集所有节点
+static size_t image_collect(rbroot_t *root, node_t ***out)
+{
+    node_t **nodes = NULL, **tmp;
+    node_t *node = root->node;
+    size_t n = 0, cap = 0;
+
+    if (node == NULL) {
+        *out = NULL;
+        return 0;
+    }
+    while (node->left != NULL) {
+        node = node->left;
+    }
+    for (; node != NULL; node = image_next(node)) {
+        if (n == cap) {
+            cap = cap ? cap * 2 : 1024;
+            if ((tmp = realloc(nodes, cap * sizeof(node_t *))) == NULL) {
+                free(nodes);
+                return (size_t)-1;
+            }
+            nodes = tmp;
+        }
+        nodes[n++] = node;
+    }
+    *out = nodes;
+    return n;
+}
+
+// 序列化到 w->buf，返回长度；buf 为 NULL 时只计算长度
+static size_t image_serialize(struct image_writer *w,
+                              size_t (*serialize)(void *obj, void *buf, size_t size), void *obj,
+                              bool fill)
+{
+    size_t len;
+    char *tmp;
+
+    if (serialize == NULL) {
+        serialize = default_serialize;
+    }
+    if (!fill) {
+        return serialize(obj, NULL, 0);
+    }
+    len = serialize(obj, w->buf, w->cap);
+    if (len > w->cap) {
+        if ((tmp = realloc(w->buf, len)) == NULL) {
+            w->err = -1;
+            return 0;
+        }
+        w->buf = tmp;
+        w->cap = len;
+        len = serialize(obj, w->buf, w->cap);
+    }
+    return len;
+}
+
+// 以 [lo, hi) 的中点为根，前序写出节点
+static void image_write_nodes(struct image_writer *w, size_t lo, size_t hi)
+{
+    struct image_node rec;
+    size_t mid = lo + (hi - lo) / 2;
+    size_t len;
+
+    if (lo >= hi || w->err) {
+        return;
+    }
+    memset(&rec, 0, sizeof(rec));
+    len = image_serialize(w, w->root->serialize_key, w->nodes[mid]->key, false);
+    rec.key_off = w->off;
+    rec.key_len = (uint32_t)len;
+    w->off += image_align(len);
+    if (len > UINT32_MAX) {
+        w->err = -1;
+    }
+    len = image_serialize(w, w->root->serialize_value, w->nodes[mid]->value, false);
+    rec.value_off = w->off;
+    rec.value_len = (uint32_t)len;
+    w->off += image_align(len);
+    if (len > UINT32_MAX) {
+        w->err = -1;
+    }
+    // 左孩子紧跟在自身之后，右孩子在整个左子树之后
+    rec.left = mid > lo ? 1 : 0;
+    rec.right = mid + 1 < hi ? 1 + (mid - lo) : 0;
+    if (fwrite(&rec, sizeof(rec), 1, w->fp) != 1) {
+        w->err = -1;
+        return;
+    }
+    image_write_nodes(w, lo, mid);
+    image_write_nodes(w, mid + 1, hi);
+}
+
+static void image_write_payload(struct image_writer *w,
+                                size_t (*serialize)(void *obj, void *buf, size_t size), void *obj)
+{
+    static const char pad[RB_IMAGE_ALIGN];
+    size_t len = image_serialize(w, serialize, obj, true);
+
+    if (w->err) {
+        return;
+    }
+    if (fwrite(w->buf, 1, len, w->fp) != len ||
+        fwrite(pad, 1, image_align(len) - len, w->fp) != image_align(len) - len) {
+        w->err = -1;
+    }
+}
+
+// 按与 image_write_nodes 相同的顺序写出 key/value，同一个对象两次序列化的长度必须相同
+static void image_write_data(struct image_writer *w, size_t lo, size_t hi)
+{
+    size_t mid = lo + (hi - lo) / 2;
+
+    if (lo >= hi || w->err) {
+        return;
+    }
+    image_write_payload(w, w->root->serialize_key, w->nodes[mid]->key);
+    image_write_payload(w, w->root->serialize_value, w->nodes[mid]->value);
+    image_write_data(w, lo, mid);
+    image_write_data(w, mid + 1, hi);
+}
+
+int rbtree_save_image(struct rbtree_root *root, const char *path)
+{
+    struct image_writer w;
+    struct image_header hdr;
+    size_t n;
+    char *tmp_path;
+
+    if (root == NULL || path == NULL) {
+        return -1;
+    }
+    if ((tmp_path = malloc(strlen(path) + 5)) == NULL) {
+        return -1;
+    }
+    sprintf(tmp_path, "%s.tmp", path);
+
+    memset(&w, 0, sizeof(w));
+    w.root = root;
+    if ((w.fp = fopen(tmp_path, "wb")) == NULL) {
+        free(tmp_path);
+        return -1;
+    }
+
+    // 写入期间持有读锁，key/value 不会被释放
+    LOCK_RBTREE_RD(root);
+    n = image_collect(root, &w.nodes);
+    if (n == (size_t)-1) {
+        w.err = -1;
+        n = 0;
+    }
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, RB_IMAGE_MAGIC, sizeof(hdr.magic));
+    hdr.version = RB_IMAGE_VERSION;
+    hdr.node_size = sizeof(struct image_node);
+    hdr.nr_nodes = n;
+    hdr.nodes_off = sizeof(struct image_header);
+    hdr.data_off = hdr.nodes_off + n * sizeof(struct image_node);
+    // 先写占位的头部，数据区大小在写完节点后才知道
+    if (!w.err && fwrite(&hdr, sizeof(hdr), 1, w.fp) != 1) {
+        w.err = -1;
+    }
+    image_write_nodes(&w, 0, n);
+    image_write_data(&w, 0, n);
+    UNLOCK_RBTREE(root);
+
+    hdr.data_size = w.off;
+    if (!w.err && (fseek(w.fp, 0, SEEK_SET) != 0 || fwrite(&hdr, sizeof(hdr), 1, w.fp) != 1)) {
+        w.err = -1;
+    }
+    if (!w.err && (fflush(w.fp) != 0 || fsync(fileno(w.fp)) != 0)) {
+        w.err = -1;
+    }
+    if (fclose(w.fp) != 0) {
+        w.err = -1;
+    }
+    if (!w.err && rename(tmp_path, path) != 0) {
+        w.err = -1;
+    }
+    if (w.err) {
+        unlink(tmp_path);
+    }
+    free(w.nodes);
+    free(w.buf);
+    free(tmp_path);
+    return w.err;
+}
+
+struct rbtree_image *rbtree_open_mmap(const char *path, struct rbtree_arg arg)
+{
+    struct rbtree_image *image;
+    const struct image_header *hdr;
+    struct stat st;
+    void *base;
+    int fd;
+
+    if (path == NULL || (fd = open(path, O_RDONLY)) < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct image_header)) {
+        close(fd);
+        return NULL;
+    }
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return NULL;
+    }
+
+    // 只检查头部，打开的耗时与树的大小无关
+    hdr = base;
+    if (memcmp(hdr->magic, RB_IMAGE_MAGIC, sizeof(hdr->magic)) != 0 ||
+        hdr->version != RB_IMAGE_VERSION || hdr->node_size != sizeof(struct image_node) ||
+        hdr->nodes_off != sizeof(struct image_header) ||
+        hdr->nr_nodes > (st.st_size - hdr->nodes_off) / sizeof(struct image_node) ||
+        hdr->data_off != hdr->nodes_off + hdr->nr_nodes * sizeof(struct image_node) ||
+        hdr->data_size > st.st_size - hdr->data_off) {
+        munmap(base, st.st_size);
+        return NULL;
+    }
+
+    if ((image = malloc(sizeof(struct rbtree_image))) == NULL) {
+        munmap(base, st.st_size);
+        return NULL;
+    }
+    image->base = base;
+    image->size = st.st_size;
+    image->nodes = (const struct image_node *)((const char *)base + hdr->nodes_off);
+    image->nr_nodes = hdr->nr_nodes;
+    image->data = (const char *)base + hdr->data_off;
+    image->data_size = hdr->data_size;
+    image->cmp_key = arg.cmp_key ? arg.cmp_key : default_cmp_key;
+    image->deserialize_key = arg.deserialize_key ? arg.deserialize_key : default_deserialize;
+    image->deserialize_value =
+        arg.deserialize_value ? arg.deserialize_value : default_deserialize;
+    return image;
+}
+
+void rbtree_image_close(struct rbtree_image *image)
+{
+    if (!image) {
+        return;
+    }
+    munmap(image->base, image->size);
+    free(image);
+}
+
+size_t rbtree_image_size(struct rbtree_image *image)
+{
+    return image ? image->nr_nodes : 0;
+}
+
+// 由节点记录得到 key/value，偏移越界（文件损坏）时返回 false
+static bool image_entry(struct rbtree_image *image, const struct image_node *node, void **key,
+                        void **value)
+{
+    if (node->key_off > image->data_size || node->key_len > image->data_size - node->key_off ||
+        node->value_off > image->data_size ||
+        node->value_len > image->data_size - node->value_off) {
+        return false;
+    }
+    if (key) {
+        *key = image->deserialize_key(image->data + node->key_off, node->key_len);
+    }
+    if (value) {
+        *value = image->deserialize_value(image->data + node->value_off, node->value_len);
+    }
+    return true;
+}
+
+void *rbtree_image_search(struct rbtree_image *image, void *key)
+{
+    const struct image_node *node;
+    uint64_t i = 0, step;
+    void *node_key, *value = NULL;
+    int cmp;
+
+    if (!image) {
+        return NULL;
+    }
+    while (i < image->nr_nodes) {
+        node = &image->nodes[i];
+        if (!image_entry(image, node, &node_key, NULL)) {
+            return NULL;
+        }
+        cmp = image->cmp_key(key, node_key);
+        if (cmp == 0) {
+            image_entry(image, node, NULL, &value);
+            return value;
+        }
+        step = cmp < 0 ? node->left : node->right;
+        if (step == 0) {
+            return NULL;
+        }
+        i += step;
+    }
+    return NULL;
+}
+
+static void image_walk(struct rbtree_image *image, uint64_t i,
+                       void (*fn)(void *key, void *value, void *ctx), void *ctx)
+{
+    const struct image_node *node;
+    void *key, *value;
+
+    while (i < image->nr_nodes) {
+        node = &image->nodes[i];
+        if (node->left) {
+            image_walk(image, i + node->left, fn, ctx);
+        }
+        if (image_entry(image, node, &key, &value)) {
+            fn(key, value, ctx);
+        }
+        if (node->right == 0) {
+            break;
+        }
+        i += node->right;
+    }
+}
+
+static void image_inorder_cb(void *key, void *value, void *ctx)
+{
+    ((void (*)(void *, void *))ctx)(key, value);
+}
+
+void rbtree_image_inorder(struct rbtree_image *image, void (*cb)(void *key, void *value))
+{
+    if (!image || !cb) {
+        return;
+    }
+    image_walk(image, 0, image_inorder_cb, (void *)cb);
+}
+
+struct image_loader {
+    struct rbtree_root *root;
+    bool key_copy;
+    bool val_copy;
+    int err;
+};
+
+static void image_load_cb(void *key, void *value, void *ctx)
+{
+    struct image_loader *l = ctx;
+
+    if (!l->err && rbtree_insert(l->root, key, value, l->key_copy, l->val_copy) != 0) {
+        l->err = -1;
+    }
+}
+
+int rbtree_load_image(struct rbtree_root *root, const char *path, bool key_copy, bool val_copy)
+{
+    struct rbtree_arg arg;
+    struct rbtree_image *image;
+    struct image_loader l = {root, key_copy, val_copy, 0};
+
+    if (root == NULL) {
+        return -1;
+    }
+    memset(&arg, 0, sizeof(arg));
+    arg.cmp_key = root->cmp_key;
+    arg.deserialize_key = root->deserialize_key;
+    arg.deserialize_value = root->deserialize_value;
+    if ((image = rbtree_open_mmap(path, arg)) == NULL) {
+        return -1;
+    }
+    image_walk(image, 0, image_load_cb, &l);
+    rbtree_image_close(image);
+    return l.err;
+}
@@ -0,0 +1,85 @@
+#ifndef UTILS_RB_TREE_IMAGE
+#define UTILS_RB_TREE_IMAGE
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rb_tree.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct rbtree_image;
+
+/**
+ * @brief 把树写入镜像文件。文件中的节点按完全平衡的二叉查找树以前序排列，孩子用相对下标表示，
+ *        不含指针；key/value 由 serialize_key/serialize_value 序列化。先写临时文件，
+ *        fsync 后改名为 path，写入过程中崩溃不会破坏已有的镜像。整数使用本机字节序
+ *
+ * @param root
+ * @param path
+ * @return int 0: 成功; -1: 失败
+ */
+int rbtree_save_image(struct rbtree_root *root, const char *path);
+
+/**
+ * @brief 以只读方式映射镜像文件，直接在映射的页面上查找，不需要重建树。
+ *        多个进程映射同一个文件时共享页缓存
+ *
+ * @param path
+ * @param arg 使用 cmp_key、deserialize_key、deserialize_value，须与写入时的序列化方式对应
+ * @return struct rbtree_image* 失败时返回 NULL
+ */
+struct rbtree_image *rbtree_open_mmap(const char *path, struct rbtree_arg arg);
+
+/**
+ * @brief 解除映射，之前由镜像得到的 key/value 随之失效
+ *
+ * @param image
+ */
+void rbtree_image_close(struct rbtree_image *image);
+
+/**
+ * @brief 节点数
+ *
+ * @param image
+ * @return size_t
+ */
+size_t rbtree_image_size(struct rbtree_image *image);
+
+/**
+ * @brief 查看一个 key 对应的 value，如果没有返回 NULL。镜像只读，可以被多个线程同时查找
+ *
+ * @param image
+ * @param key
+ * @return void*
+ */
+void *rbtree_image_search(struct rbtree_image *image, void *key);
+
+/**
+ * @brief 中序遍历
+ *
+ * @param image
+ * @param cb
+ */
+void rbtree_image_inorder(struct rbtree_image *image, void (*cb)(void *key, void *value));
+
+/**
+ * @brief 把镜像文件中的 key/value 按序插入树中，用树的 deserialize_key/deserialize_value 反序列化，
+ *        已存在的 key 被更新。反序列化的结果在插入后即失效，不拷贝时它本身必须是数据（如整数）
+ *
+ * @param root
+ * @param path
+ * @param key_copy true: 对 key 调用 copy_key 进行拷贝
+ * @param val_copy true: 对 val 调用 copy_val 进行拷贝
+ * @return int 0: 成功; -1: 失败，已插入的节点保留在树中
+ */
+int rbtree_load_image(struct rbtree_root *root, const char *path, bool key_copy, bool val_copy);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UTILS_RB_TREE_IMAGE */
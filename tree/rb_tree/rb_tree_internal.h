@@ -0,0 +1,277 @@
+#ifndef UTILS_RB_TREE_INTERNAL
+#define UTILS_RB_TREE_INTERNAL
+
+// 红黑树的内部结构，只给 rb_tree.c 和在其平衡逻辑之上扩展的变体（如区间树）使用
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "rb_tree.h"
+#include "rb_tree_link.h"
+#include "common/slab/slab.h"
+#include "common/sync/epoch.h"
+#include "common/sync/rwlock.h"
+
+#define RB_NODE_RED   0 // 红色节点
+#define RB_NODE_BLACK 1 // 黑色节点
+
+// 为 1 时把 key/value 的释放标记和颜色一起压缩到父节点指针的低 3 位（同 Linux 内核的 rbtree），
+// 64 位下节点从 48 字节降到 40 字节；为 0 时释放标记使用独立字段，便于调试时直接查看。
+// 颜色总是保存在父节点指针的最低位，平衡逻辑与 RBTREE_DEFINE 共用 rb_tree_link.c
+#ifndef RBTREE_COMPACT_NODE
+#define RBTREE_COMPACT_NODE 1
+#endif
+
+#define RB_FLAG_COLOR       0x1 // 颜色，与 RB_NODE_RED/RB_NODE_BLACK 的取值一致
+#define RB_FLAG_KEY_OWNED   0x2 // key 由 copy_key 拷贝，删除节点时需要释放
+#define RB_FLAG_VALUE_OWNED 0x4 // value 由 copy_value 拷贝，删除节点时需要释放
+#define RB_FLAG_MASK        0x7
+_Static_assert(RB_FLAG_MASK == RBTREE_LINK_MASK && RB_NODE_BLACK == RBTREE_LINK_BLACK,
+               "rbtree node flags must match the shared link layout");
+
+// 红黑树的节点
+typedef struct rbtree_node {
+    // left/right/parent_flags 与 link 的布局相同：rb_tree.c 直接按 node_t 访问，
+    // 旋转和颜色调整通过 link 交给 rb_tree_link.c。link 必须在开头，孩子和根指针才能两种方式通用
+    union {
+        struct rbtree_link link;
+        struct {
+            struct rbtree_node *left;
+            struct rbtree_node *right;
+            uintptr_t parent_flags; // 父节点指针 | RB_FLAG_*，节点按 8 字节对齐，低 3 位恒为 0
+        };
+    };
+    void *key;
+    void *value;
+#if !RBTREE_COMPACT_NODE
+    bool key_free_need;
+    bool value_free_need;
+#endif
+} node_t, *rbtree_t;
+_Static_assert(offsetof(node_t, link) == 0, "rbtree node must start with its link");
+#if RBTREE_COMPACT_NODE
+_Static_assert(sizeof(node_t) == 5 * sizeof(void *) || sizeof(void *) < 8,
+               "compact rbtree node must be five pointers");
+#endif
+
+#define rb_link_node(l) RBTREE_ENTRY(l, node_t, link)
+
+// rbtree_build_sorted 一次分配的连续节点
+struct rbtree_block {
+    struct rbtree_block *next;
+    size_t nr_nodes;
+    node_t nodes[];
+};
+
+// 红黑树的根
+typedef struct rbtree_root {
+    union {
+        node_t *node;
+        struct rbtree_link *link; // 与 node 相同，交给 rb_tree_link.c 修改根
+    };
+    int (*cmp_key)(void *key0, void *key1);
+    void *(*copy_key)(void *key);
+    void (*free_key)(void *key);
+    void *(*copy_value)(void *key);
+    void (*free_value)(void *value);
+    size_t (*serialize_key)(void *key, void *buf, size_t size);
+    size_t (*serialize_value)(void *value, void *buf, size_t size);
+    void *(*deserialize_key)(const void *buf, size_t len);
+    void *(*deserialize_value)(const void *buf, size_t len);
+    bool is_thread_safe;
+    rwlock_t rwlocker; // 按 rbtree_arg.lock_policy 选择的读写锁
+    slab_pool_t *node_pool; // 节点内存池，为 NULL 时节点直接由 malloc 分配
+    size_t nr_owned;        // 持有 key 或 value 拷贝的节点数，为 0 时销毁无需遍历，split 后不小于实际值
+    uint64_t version;       // 每次增删节点加 1，逐步加锁的游标用它判断树是否被修改过
+    epoch_domain_t *epoch;  // 乐观读模式下延迟释放节点的回收域，为 NULL 时读者加读锁
+    uint64_t seq;           // 乐观读的序列号，写者修改树结构期间为奇数
+    struct rbtree_block *blocks; // rbtree_build_sorted 分配的节点块，销毁时整块释放
+    size_t nr_heap_nodes;        // 单独 malloc 的节点数，与 nr_owned 同为 0 时销毁无需遍历，同上
+    bool order_stat;             // 节点之后附带子树大小，支持 rbtree_rank/rbtree_select
+    size_t node_size;            // 每个节点占用的字节数
+    size_t tail_offset;          // 附加数据 rb_tail 相对节点起始的偏移
+    size_t key_inline;           // 非 0: 插入时把 key 指向的这么多字节拷贝到 rb_tail，key 指向该处
+    // 非 NULL 时，节点的子树发生变化后调用，由孩子重新计算 node 的附加数据（如区间树的最大端点）
+    void (*augment)(struct rbtree_root *root, node_t *node);
+    node_t *last_insert;   // 最近一次插入或更新的节点，version 未变时作为下一次插入的位置提示
+    uint64_t last_version; // 记录 last_insert 时的 version
+    unsigned hint_miss;    // last_insert 提示连续落空的次数
+    struct rbtree_cache *cache; // 热点 key 缓存，为 NULL 时不启用
+    size_t nr_nodes;            // 树中的节点数，随增删维护
+    bool count_stale;           // 未开启 order_stat 时 split 后 nr_nodes 未知，下次使用时遍历统计
+} rbroot_t;
+
+#define KEY_LESS(k0, k1, cmp_key)    (cmp_key(k0, k1) < 0)
+#define KEY_GREATER(k0, k1, cmp_key) (cmp_key(k0, k1) > 0)
+#define KEY_EQUAL(k0, k1, cmp_key)   (cmp_key(k0, k1) == 0)
+// clang-format off
+#define rb_parent(r)       ((node_t *)((r)->parent_flags & ~(uintptr_t)RB_FLAG_MASK))
+#define rb_color(r)        ((unsigned char)((r)->parent_flags & RB_FLAG_COLOR))
+#define rb_set_parent(r,p) do { (r)->parent_flags = ((r)->parent_flags & RB_FLAG_MASK) | (uintptr_t)(p); } while (0)
+#define rb_set_color(r,c)  do { (r)->parent_flags = ((r)->parent_flags & ~(uintptr_t)RB_FLAG_COLOR) | (c); } while (0)
+#if RBTREE_COMPACT_NODE
+#define rb_flag(r,f)       (((r)->parent_flags & (f)) != 0)
+#define rb_set_flag(r,f,b) do { (r)->parent_flags = ((r)->parent_flags & ~(uintptr_t)(f)) | ((b) ? (uintptr_t)(f) : 0); } while (0)
+#define rb_key_owned(r)    rb_flag(r, RB_FLAG_KEY_OWNED)
+#define rb_value_owned(r)  rb_flag(r, RB_FLAG_VALUE_OWNED)
+#define rb_set_key_owned(r,b)   rb_set_flag(r, RB_FLAG_KEY_OWNED, b)
+#define rb_set_value_owned(r,b) rb_set_flag(r, RB_FLAG_VALUE_OWNED, b)
+// 设置父节点和颜色，清除释放标记，用于新节点
+#define rb_init_node(r,p,c) do { (r)->parent_flags = (uintptr_t)(p) | (c); } while (0)
+#else
+#define rb_key_owned(r)    ((r)->key_free_need)
+#define rb_value_owned(r)  ((r)->value_free_need)
+#define rb_set_key_owned(r,b)   do { (r)->key_free_need = (b); } while (0)
+#define rb_set_value_owned(r,b) do { (r)->value_free_need = (b); } while (0)
+#define rb_init_node(r,p,c) \
+    do { (r)->parent_flags = (uintptr_t)(p) | (c); (r)->key_free_need = (r)->value_free_need = false; } while (0)
+#endif
+// 顺序统计模式下子树大小存放在节点之后，仅当 root->order_stat 时可以访问
+#define rb_count(r)        (*(size_t *)((char *)(r) + sizeof(node_t)))
+// 节点的附加数据，紧跟在 node_t（顺序统计模式下在子树大小）之后
+#define rb_tail(root,r)    ((void *)((char *)(r) + (root)->tail_offset))
+#define rb_is_red(r)       (rb_color(r) == RB_NODE_RED)
+#define rb_is_black(r)     (rb_color(r) == RB_NODE_BLACK)
+#define rb_set_black(r)    rb_set_color(r, RB_NODE_BLACK)
+#define rb_set_red(r)      rb_set_color(r, RB_NODE_RED)
+// clang-format on
+// rbtree_arg.lock_policy 直接作为 rwlock_init 的 kind
+_Static_assert(RBTREE_LOCK_RWLOCK == RWLOCK_PTHREAD && RBTREE_LOCK_BRLOCK == RWLOCK_BRLOCK &&
+                   RBTREE_LOCK_QUEUED == RWLOCK_QUEUED,
+               "rbtree lock policies must match rwlock kinds");
+#define LOCK_RBTREE_WR(r)                \
+    {                                    \
+        if ((r)->is_thread_safe)         \
+            rwlock_wrlock(&r->rwlocker); \
+    }
+#define LOCK_RBTREE_RD(r)                \
+    {                                    \
+        if ((r)->is_thread_safe)         \
+            rwlock_rdlock(&r->rwlocker); \
+    }
+#define UNLOCK_RBTREE(r)                 \
+    {                                    \
+        if ((r)->is_thread_safe)         \
+            rwlock_unlock(&r->rwlocker); \
+    }
+// 写者在修改树结构前后各把序列号加 1，乐观读者据此判断下降过程中树是否被修改过
+#define RB_SEQ_BEGIN(r)                                                          \
+    {                                                                            \
+        if ((r)->epoch) {                                                        \
+            __atomic_store_n(&(r)->seq, (r)->seq + 1, __ATOMIC_RELAXED);         \
+            __atomic_thread_fence(__ATOMIC_RELEASE);                             \
+        }                                                                        \
+    }
+#define RB_SEQ_END(r)                                                            \
+    {                                                                            \
+        if ((r)->epoch)                                                          \
+            __atomic_store_n(&(r)->seq, (r)->seq + 1, __ATOMIC_RELEASE);         \
+    }
+#define RB_READ_ONCE(x) __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+
+/**
+ * @brief 创建一个节点带附加数据的红黑树，rbtree_init 等价于 tail_size、key_inline 为 0，augment 为 NULL
+ *
+ * @param arg
+ * @param tail_size 每个节点附加数据的字节数，通过 rb_tail 访问，新节点的附加数据清零
+ * @param key_inline 非 0 时 key 按值保存在附加数据的开头，不能大于 tail_size，此时 copy_key 不再使用
+ * @param augment 附加数据依赖子树时的维护函数，可以为 NULL
+ * @return rbroot_t*
+ */
+rbroot_t *rbtree_init_ext(struct rbtree_arg arg, size_t tail_size, size_t key_inline,
+                          void (*augment)(rbroot_t *root, node_t *node));
+
+/**
+ * @brief 插入节点后修正红黑树，node 已经作为红色节点挂到树上
+ *
+ * @param root
+ * @param node
+ * @return true 最后把红色的根节点染黑，树的黑高加 1
+ * @return false 黑高不变
+ */
+bool rbtree_insert_fixup(rbroot_t *root, node_t *node);
+
+/**
+ * @brief 把 node 从树上摘下并修正红黑树，不释放节点
+ *
+ * @param root
+ * @param node
+ * @return void* node 的 value
+ */
+void *rbtree_delete_node(rbroot_t *root, node_t *node);
+
+/**
+ * @brief 孩子改变后，由孩子重新计算 node 的子树大小和附加数据
+ *
+ * @param root
+ * @param node
+ */
+void rbtree_node_update(rbroot_t *root, node_t *node);
+
+/**
+ * @brief 释放已经从树上摘下的节点及其持有的 key/value，乐观读模式下等读者离开后再释放。调用者持有写锁
+ *
+ * @param root
+ * @param node
+ */
+void rbtree_drop_node(rbroot_t *root, node_t *node);
+
+/**
+ * @brief 让游标指向 node（可以为 NULL）并记下其 key/value，调用者持有锁。
+ *        RBTREE_CURSOR_LOCK_STEP 模式下树持有的 key 会被复制，复制失败时游标不指向任何节点
+ *
+ * @param cursor
+ * @param node
+ * @return int 0: 成功; -1: 复制 key 时内存不足
+ */
+int rbtree_cursor_set(struct rbtree_cursor *cursor, node_t *node);
+
+// 热点 key 缓存（rb_tree_cache.c），除 lookup/fill 可以在读锁下调用外，调用者持有写锁
+struct rbtree_cache *rbtree_cache_create(size_t size, uint64_t (*hash_key)(void *key));
+void rbtree_cache_destroy(struct rbtree_cache *cache);
+
+/**
+ * @brief 在缓存中查找 key，未命中时返回 NULL，并把 key 的哈希写入 *hash 供 rbtree_cache_fill 使用
+ *
+ * @param root
+ * @param key
+ * @param hash
+ * @return node_t*
+ */
+node_t *rbtree_cache_lookup(rbroot_t *root, void *key, uint64_t *hash);
+
+/**
+ * @brief 查找未命中、在树中找到节点后放入缓存
+ *
+ * @param root
+ * @param hash
+ * @param node
+ * @param evict true: 淘汰最久未用的一路; false: 只在有空闲的一路时放入
+ */
+void rbtree_cache_fill(rbroot_t *root, uint64_t hash, node_t *node, bool evict);
+
+/**
+ * @brief 新插入的节点在有空闲的一路时放入缓存
+ *
+ * @param root
+ * @param node
+ */
+void rbtree_cache_insert(rbroot_t *root, node_t *node);
+
+/**
+ * @brief 节点从树上摘下前清除指向它的缓存项
+ *
+ * @param root
+ * @param node
+ */
+void rbtree_cache_invalidate(rbroot_t *root, node_t *node);
+
+/**
+ * @brief 清空缓存，用于整批移动或释放节点的操作（join/split/集合运算）
+ *
+ * @param root
+ */
+void rbtree_cache_reset(rbroot_t *root);
+
+#endif /* UTILS_RB_TREE_INTERNAL */
@@ -0,0 +1,168 @@
+#include "rb_tree_interval.h"
+#include <stdlib.h>
+#include "rb_tree_internal.h"
+
+// 区间，作为 key 按值保存在节点中
+struct interval_key {
+    uint64_t start;
+    uint64_t end;
+};
+
+// 节点的附加数据
+struct interval_tail {
+    struct interval_key key;
+    uint64_t max_end; // 以该节点为根的子树中最大的 end
+};
+
+// 区间树，节点的平衡和附加数据的维护都由 rb_tree.c 完成
+struct rbtree_interval {
+    rbroot_t *root;
+};
+
+#define interval_of(root, node) ((struct interval_tail *)rb_tail(root, node))
+
+// 先按 start 再按 end 排序
+static int interval_cmp_key(void *key0, void *key1)
+{
+    struct interval_key *k0 = key0;
+    struct interval_key *k1 = key1;
+
+    if (k0->start != k1->start) {
+        return k0->start < k1->start ? -1 : 1;
+    }
+    if (k0->end != k1->end) {
+        return k0->end < k1->end ? -1 : 1;
+    }
+    return 0;
+}
+
+static void interval_augment(rbroot_t *root, node_t *node)
+{
+    struct interval_tail *tail = interval_of(root, node);
+    uint64_t max_end = tail->key.end;
+
+    if (node->left && interval_of(root, node->left)->max_end > max_end) {
+        max_end = interval_of(root, node->left)->max_end;
+    }
+    if (node->right && interval_of(root, node->right)->max_end > max_end) {
+        max_end = interval_of(root, node->right)->max_end;
+    }
+    tail->max_end = max_end;
+}
+
+struct rbtree_interval *rbtree_interval_init(struct rbtree_arg arg)
+{
+    struct rbtree_interval *tree = malloc(sizeof(struct rbtree_interval));
+    if (!tree) {
+        return NULL;
+    }
+
+    arg.cmp_key = interval_cmp_key;
+    arg.copy_key = NULL;
+    arg.free_key = NULL;
+    arg.hash_key = NULL;
+    arg.cache_size = 0;
+    tree->root = rbtree_init_ext(arg, sizeof(struct interval_tail), sizeof(struct interval_key),
+                                 interval_augment);
+    if (!tree->root) {
+        free(tree);
+        return NULL;
+    }
+    return tree;
+}
+
+void rbtree_interval_destroy(struct rbtree_interval *tree)
+{
+    if (!tree) {
+        return;
+    }
+    rbtree_destroy(tree->root);
+    free(tree);
+}
+
+int rbtree_interval_insert(struct rbtree_interval *tree, uint64_t start, uint64_t end,
+                           void *value, bool val_copy)
+{
+    struct interval_key key = {start, end};
+
+    if (!tree || start >= end) {
+        return -1;
+    }
+    return rbtree_upsert(tree->root, &key, value, false, val_copy, NULL, NULL);
+}
+
+void *rbtree_interval_search(struct rbtree_interval *tree, uint64_t start, uint64_t end)
+{
+    struct interval_key key = {start, end};
+
+    if (!tree) {
+        return NULL;
+    }
+    return rbtree_search(tree->root, &key);
+}
+
+void rbtree_interval_delete(struct rbtree_interval *tree, uint64_t start, uint64_t end)
+{
+    struct interval_key key = {start, end};
+
+    if (!tree) {
+        return;
+    }
+    rbtree_delete(tree->root, &key);
+}
+
+// 子树中最大的 end 不超过 start 时整棵子树都不相交；节点的 start 不小于 end 时右子树也不相交。
+// 进入左子树只看最大的 end，其中的区间可能全部从 end 之后开始，耗时是 O(min(n, (k + 1) log n))。
+// 只对左子树递归，右子树用循环，递归深度不超过树高
+static size_t interval_overlap(rbroot_t *root, node_t *node, uint64_t start, uint64_t end,
+                               void (*cb)(uint64_t start, uint64_t end, void *value, void *ctx),
+                               void *ctx)
+{
+    struct interval_tail *tail;
+    size_t count = 0;
+
+    while (node != NULL) {
+        tail = interval_of(root, node);
+        if (tail->max_end <= start) {
+            break;
+        }
+        count += interval_overlap(root, node->left, start, end, cb, ctx);
+        if (tail->key.start >= end) {
+            break;
+        }
+        if (start < tail->key.end) {
+            if (cb) {
+                cb(tail->key.start, tail->key.end, node->value, ctx);
+            }
+            count++;
+        }
+        node = node->right;
+    }
+    return count;
+}
+
+size_t rbtree_interval_overlap(struct rbtree_interval *tree, uint64_t start, uint64_t end,
+                               void (*cb)(uint64_t start, uint64_t end, void *value, void *ctx),
+                               void *ctx)
+{
+    size_t count;
+
+    if (!tree || start >= end) {
+        return 0;
+    }
+    LOCK_RBTREE_RD(tree->root);
+    count = interval_overlap(tree->root, tree->root->node, start, end, cb, ctx);
+    UNLOCK_RBTREE(tree->root);
+    return count;
+}
+
+size_t rbtree_interval_stab(struct rbtree_interval *tree, uint64_t point,
+                            void (*cb)(uint64_t start, uint64_t end, void *value, void *ctx),
+                            void *ctx)
+{
+    // 区间的 end 不超过 UINT64_MAX，没有区间包含它
+    if (point == UINT64_MAX) {
+        return 0;
+    }
+    return rbtree_interval_overlap(tree, point, point + 1, cb, ctx);
+}
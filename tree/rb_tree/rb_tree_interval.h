@@ -0,0 +1,99 @@
+#ifndef UTILS_RB_TREE_INTERVAL
+#define UTILS_RB_TREE_INTERVAL
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rb_tree.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct rbtree_interval;
+
+/**
+ * @brief 创建一个区间树，保存左闭右开区间 [start, end) 到 value 的映射。
+ *        区间按 (start, end) 排序存放在红黑树中，每个节点额外记录子树中最大的 end，
+ *        旋转和增删时与红黑树的平衡一起维护
+ *
+ * @param arg 使用 is_thread_safe、lock_policy、copy_value、free_value、use_node_pool、
+ *            optimistic_read，key 由区间树自己管理，cmp_key、copy_key、free_key、hash_key 被忽略
+ * @return struct rbtree_interval*
+ */
+struct rbtree_interval *rbtree_interval_init(struct rbtree_arg arg);
+
+/**
+ * @brief 销毁区间树
+ *
+ * @param tree
+ */
+void rbtree_interval_destroy(struct rbtree_interval *tree);
+
+/**
+ * @brief 插入一个区间，区间已存在时替换它的 value
+ *
+ * @param tree
+ * @param start
+ * @param end 必须大于 start
+ * @param value
+ * @param val_copy true: 对 value 调用 copy_value 进行拷贝
+ * @return int 0: 插入了新区间; 1: 区间已存在并完成更新; -1: 失败（区间为空或内存不足）
+ */
+int rbtree_interval_insert(struct rbtree_interval *tree, uint64_t start, uint64_t end,
+                           void *value, bool val_copy);
+
+/**
+ * @brief 查找与 [start, end) 完全相同的区间，返回它的 value，如果没有返回 NULL
+ *
+ * @param tree
+ * @param start
+ * @param end
+ * @return void*
+ */
+void *rbtree_interval_search(struct rbtree_interval *tree, uint64_t start, uint64_t end);
+
+/**
+ * @brief 删除与 [start, end) 完全相同的区间
+ *
+ * @param tree
+ * @param start
+ * @param end
+ */
+void rbtree_interval_delete(struct rbtree_interval *tree, uint64_t start, uint64_t end);
+
+/**
+ * @brief 按 start 升序枚举所有与 [start, end) 相交的区间，耗时 O(min(n, (k + 1) log n))，k 为结果数：
+ *        子树只按最大的 end 剪枝，进入的子树不一定有结果，每个结果最多带来一条 O(log n) 的路径。
+ *        回调在读锁内执行，不能修改区间树
+ *
+ * @param tree
+ * @param start
+ * @param end
+ * @param cb 每个相交的区间调用一次，可以为 NULL（只计数）
+ * @param ctx 透传给 cb
+ * @return size_t 相交的区间数
+ */
+size_t rbtree_interval_overlap(struct rbtree_interval *tree, uint64_t start, uint64_t end,
+                               void (*cb)(uint64_t start, uint64_t end, void *value, void *ctx),
+                               void *ctx);
+
+/**
+ * @brief 枚举所有包含 point 的区间（start <= point < end），同 rbtree_interval_overlap
+ *
+ * @param tree
+ * @param point
+ * @param cb 可以为 NULL（只计数）
+ * @param ctx
+ * @return size_t 包含 point 的区间数
+ */
+size_t rbtree_interval_stab(struct rbtree_interval *tree, uint64_t point,
+                            void (*cb)(uint64_t start, uint64_t end, void *value, void *ctx),
+                            void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UTILS_RB_TREE_INTERVAL */
@@ -0,0 +1,315 @@
+#include "rb_tree_link.h"
+
+typedef struct rbtree_link link_t;
+
+// clang-format off
+#define link_parent(r)       rbtree_link_parent(r)
+#define link_color(r)        ((r)->parent_color & 1)
+#define link_is_red(r)       ((r) != NULL && link_color(r) == RBTREE_LINK_RED)
+#define link_is_black(r)     ((r) == NULL || link_color(r) == RBTREE_LINK_BLACK)
+#define link_set_parent(r,p) do { (r)->parent_color = ((r)->parent_color & RBTREE_LINK_MASK) | (uintptr_t)(p); } while (0)
+#define link_set_color(r,c)  do { (r)->parent_color = ((r)->parent_color & ~(uintptr_t)1) | (c); } while (0)
+#define link_set_red(r)      link_set_color(r, RBTREE_LINK_RED)
+#define link_set_black(r)    link_set_color(r, RBTREE_LINK_BLACK)
+// clang-format on
+
+// 把 parent 中指向 old 的孩子指针改为指向 new（parent 为 NULL 时修改根）
+static inline void link_replace_child(link_t **root, link_t *parent, link_t *old, link_t *new_)
+{
+    if (parent == NULL) {
+        *root = new_;
+    } else if (parent->left == old) {
+        parent->left = new_;
+    } else {
+        parent->right = new_;
+    }
+}
+
+// 左旋
+/*      p              p
+ *      |              |
+ *      x              y
+ *     / \            / \
+ *    a   y    -->   x   c
+ *       / \        / \
+ *      b   c      a   b
+ */
+static void link_left_rotate(link_t **root, link_t *x, const struct rbtree_link_ops *ops,
+                             void *ctx)
+{
+    link_t *y = x->right;
+    link_t *p = link_parent(x);
+    x->right = y->left;
+    if (y->left != NULL) {
+        link_set_parent(y->left, x);
+    }
+    link_set_parent(y, p);
+    link_replace_child(root, p, x, y);
+    y->left = x;
+    link_set_parent(x, y);
+    if (ops && ops->rotate) {
+        ops->rotate(x, y, ctx);
+    }
+}
+
+// 右旋
+/*        p             p
+ *        |             |
+ *        y             x
+ *       / \           / \
+ *      x   c  -->    a   y
+ *     / \               / \
+ *    a   b             b   c
+ */
+static void link_right_rotate(link_t **root, link_t *y, const struct rbtree_link_ops *ops,
+                              void *ctx)
+{
+    link_t *x = y->left;
+    link_t *p = link_parent(y);
+    y->left = x->right;
+    if (x->right != NULL) {
+        link_set_parent(x->right, y);
+    }
+    link_set_parent(x, p);
+    link_replace_child(root, p, y, x);
+    x->right = y;
+    link_set_parent(y, x);
+    if (ops && ops->rotate) {
+        ops->rotate(y, x, ctx);
+    }
+}
+
+bool rbtree_link_insert_color(link_t **root, link_t *node, const struct rbtree_link_ops *ops,
+                              void *ctx)
+{
+    link_t *parent, *gparent, *uncle, *tmp;
+
+    while ((parent = link_parent(node)) && link_is_red(parent)) {
+        gparent = link_parent(parent);
+        if (parent == gparent->left) {
+            uncle = gparent->right;
+            if (link_is_red(uncle)) { // case 1: 叔叔是红色
+                link_set_black(parent);
+                link_set_black(uncle);
+                link_set_red(gparent);
+                node = gparent;
+                continue;
+            }
+            if (parent->right == node) { // case 2: 叔叔是黑色，当前节点是右孩子
+                link_left_rotate(root, parent, ops, ctx);
+                tmp = parent;
+                parent = node;
+                node = tmp;
+            }
+            // case 3: 叔叔是黑色，当前节点是左孩子
+            link_set_black(parent);
+            link_set_red(gparent);
+            link_right_rotate(root, gparent, ops, ctx);
+        } else {
+            uncle = gparent->left;
+            if (link_is_red(uncle)) {
+                link_set_black(parent);
+                link_set_black(uncle);
+                link_set_red(gparent);
+                node = gparent;
+                continue;
+            }
+            if (parent->left == node) {
+                link_right_rotate(root, parent, ops, ctx);
+                tmp = parent;
+                parent = node;
+                node = tmp;
+            }
+            link_set_black(parent);
+            link_set_red(gparent);
+            link_left_rotate(root, gparent, ops, ctx);
+        }
+    }
+    if (link_is_red(*root)) {
+        link_set_black(*root);
+        return true;
+    }
+    return false;
+}
+
+// 删除后的修正，node 是取代被删除节点的孩子（可能为 NULL），parent 是它的父节点
+static void link_erase_fixup(link_t **root, link_t *node, link_t *parent,
+                             const struct rbtree_link_ops *ops, void *ctx)
+{
+    link_t *other;
+
+    while (link_is_black(node) && node != *root) {
+        if (parent->left == node) {
+            other = parent->right;
+            if (link_is_red(other)) { // case 1: 兄弟是红色
+                link_set_black(other);
+                link_set_red(parent);
+                link_left_rotate(root, parent, ops, ctx);
+                other = parent->right;
+            }
+            if (link_is_black(other->left) && link_is_black(other->right)) {
+                // case 2: 兄弟是黑色，且兄弟的两个孩子都是黑色
+                link_set_red(other);
+                node = parent;
+                parent = link_parent(node);
+            } else {
+                if (link_is_black(other->right)) { // case 3: 兄弟的左孩子红，右孩子黑
+                    link_set_black(other->left);
+                    link_set_red(other);
+                    link_right_rotate(root, other, ops, ctx);
+                    other = parent->right;
+                }
+                // case 4: 兄弟的右孩子是红色
+                link_set_color(other, link_color(parent));
+                link_set_black(parent);
+                link_set_black(other->right);
+                link_left_rotate(root, parent, ops, ctx);
+                node = *root;
+                break;
+            }
+        } else {
+            other = parent->left;
+            if (link_is_red(other)) {
+                link_set_black(other);
+                link_set_red(parent);
+                link_right_rotate(root, parent, ops, ctx);
+                other = parent->left;
+            }
+            if (link_is_black(other->left) && link_is_black(other->right)) {
+                link_set_red(other);
+                node = parent;
+                parent = link_parent(node);
+            } else {
+                if (link_is_black(other->left)) {
+                    link_set_black(other->right);
+                    link_set_red(other);
+                    link_left_rotate(root, other, ops, ctx);
+                    other = parent->left;
+                }
+                link_set_color(other, link_color(parent));
+                link_set_black(parent);
+                link_set_black(other->left);
+                link_right_rotate(root, parent, ops, ctx);
+                node = *root;
+                break;
+            }
+        }
+    }
+    if (node) {
+        link_set_black(node);
+    }
+}
+
+void rbtree_link_erase_ext(link_t **root, link_t *node, const struct rbtree_link_ops *ops,
+                           void *ctx)
+{
+    link_t *child, *parent, *replace;
+    uintptr_t color;
+
+    if (node->left != NULL && node->right != NULL) {
+        // 用后继节点取代被删除的节点
+        replace = node->right;
+        while (replace->left != NULL) {
+            replace = replace->left;
+        }
+        link_replace_child(root, link_parent(node), node, replace);
+
+        child = replace->right;
+        parent = link_parent(replace);
+        color = link_color(replace);
+        if (parent == node) {
+            parent = replace;
+        } else {
+            if (child) {
+                link_set_parent(child, parent);
+            }
+            parent->left = child;
+            replace->right = node->right;
+            link_set_parent(node->right, replace);
+        }
+        // 继承 node 的父节点和颜色，保留 replace 自己的其余标记位
+        replace->parent_color = (node->parent_color & ~(uintptr_t)(RBTREE_LINK_MASK & ~1)) |
+                                (replace->parent_color & (RBTREE_LINK_MASK & ~1));
+        replace->left = node->left;
+        link_set_parent(node->left, replace);
+        if (ops && ops->copy) {
+            ops->copy(node, replace, ctx);
+        }
+    } else {
+        child = node->left != NULL ? node->left : node->right;
+        parent = link_parent(node);
+        color = link_color(node);
+        if (child) {
+            link_set_parent(child, parent);
+        }
+        link_replace_child(root, parent, node, child);
+    }
+    if (ops && ops->erased) {
+        ops->erased(parent, ctx);
+    }
+    if (color == RBTREE_LINK_BLACK) {
+        link_erase_fixup(root, child, parent, ops, ctx);
+    }
+}
+
+void rbtree_link_insert(link_t **root, link_t *node, link_t *parent, link_t **slot)
+{
+    node->left = NULL;
+    node->right = NULL;
+    node->parent_color = (uintptr_t)parent | RBTREE_LINK_RED;
+    *slot = node;
+    rbtree_link_insert_color(root, node, NULL, NULL);
+}
+
+void rbtree_link_erase(link_t **root, link_t *node)
+{
+    rbtree_link_erase_ext(root, node, NULL, NULL);
+}
+
+link_t *rbtree_link_first(link_t *root)
+{
+    if (root == NULL) {
+        return NULL;
+    }
+    while (root->left != NULL) {
+        root = root->left;
+    }
+    return root;
+}
+
+link_t *rbtree_link_last(link_t *root)
+{
+    if (root == NULL) {
+        return NULL;
+    }
+    while (root->right != NULL) {
+        root = root->right;
+    }
+    return root;
+}
+
+link_t *rbtree_link_next(link_t *node)
+{
+    link_t *parent;
+
+    if (node->right != NULL) {
+        return rbtree_link_first(node->right);
+    }
+    while ((parent = link_parent(node)) != NULL && parent->right == node) {
+        node = parent;
+    }
+    return parent;
+}
+
+link_t *rbtree_link_prev(link_t *node)
+{
+    link_t *parent;
+
+    if (node->left != NULL) {
+        return rbtree_link_last(node->left);
+    }
+    while ((parent = link_parent(node)) != NULL && parent->left == node) {
+        node = parent;
+    }
+    return parent;
+}
@@ -0,0 +1,102 @@
+#ifndef UTILS_RB_TREE_LINK
+#define UTILS_RB_TREE_LINK
+
+// 与 key 类型无关的红黑树链接层：旋转以及插入、删除后的颜色调整。
+// rb_tree.c 的 node_t 和 RBTREE_DEFINE 生成的节点都嵌入 struct rbtree_link，共用这里的平衡逻辑
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RBTREE_LINK_RED   0
+#define RBTREE_LINK_BLACK 1
+// parent_color 的低 3 位：最低位是颜色，其余两位留给嵌入者（如 rb_tree.c 的释放标记），链接层不修改
+#define RBTREE_LINK_MASK 0x7
+
+/**
+ * @brief 侵入式红黑树的链接，嵌入到节点结构中。颜色保存在父节点指针的最低位
+ *
+ */
+struct rbtree_link {
+    struct rbtree_link *left;
+    struct rbtree_link *right;
+    uintptr_t parent_color;
+} __attribute__((aligned(8)));
+
+#define RBTREE_ENTRY(ptr, type, member) ((type *)((char *)(ptr) - offsetof(type, member)))
+
+#define rbtree_link_parent(l) \
+    ((struct rbtree_link *)((l)->parent_color & ~(uintptr_t)RBTREE_LINK_MASK))
+
+/**
+ * @brief 节点附带依赖子树的数据（子树大小、区间树的最大端点等）时的维护回调，
+ *        不需要时传 NULL，各回调也可以为 NULL
+ *
+ */
+struct rbtree_link_ops {
+    // 旋转后 old 成为 new_ 的孩子，new_ 占据 old 原来的位置，子树包含的节点不变
+    void (*rotate)(struct rbtree_link *old, struct rbtree_link *new_, void *ctx);
+    // 删除有两个孩子的 node 时，后继 replace 移到了 node 的位置
+    void (*copy)(struct rbtree_link *node, struct rbtree_link *replace, void *ctx);
+    // 摘下节点后，parent（可能为 NULL）是子树发生变化的最低节点，它到根的路径上每个子树都少了一个节点
+    void (*erased)(struct rbtree_link *parent, void *ctx);
+};
+
+/**
+ * @brief node 已经作为红色节点挂到树上，修正红黑树
+ *
+ * @param root
+ * @param node
+ * @param ops 可以为 NULL
+ * @param ctx 传给 ops 的回调
+ * @return true 最后把红色的根节点染黑，树的黑高加 1
+ * @return false 黑高不变
+ */
+bool rbtree_link_insert_color(struct rbtree_link **root, struct rbtree_link *node,
+                              const struct rbtree_link_ops *ops, void *ctx);
+
+/**
+ * @brief 把 node 从树上摘下并修正红黑树，node 的内存由调用者释放
+ *
+ * @param root
+ * @param node
+ * @param ops 可以为 NULL
+ * @param ctx 传给 ops 的回调
+ */
+void rbtree_link_erase_ext(struct rbtree_link **root, struct rbtree_link *node,
+                           const struct rbtree_link_ops *ops, void *ctx);
+
+/**
+ * @brief 把 node 挂到查找得到的位置 *slot（parent 的某个孩子指针，空树时为 root 本身），然后修正红黑树。
+ *        比较由调用者完成，这里只做与 key 类型无关的颜色调整和旋转
+ *
+ * @param root
+ * @param node
+ * @param parent
+ * @param slot
+ */
+void rbtree_link_insert(struct rbtree_link **root, struct rbtree_link *node,
+                        struct rbtree_link *parent, struct rbtree_link **slot);
+
+/**
+ * @brief 把 node 从树上摘下并修正红黑树，node 的内存由调用者释放
+ *
+ * @param root
+ * @param node
+ */
+void rbtree_link_erase(struct rbtree_link **root, struct rbtree_link *node);
+
+struct rbtree_link *rbtree_link_first(struct rbtree_link *root);
+struct rbtree_link *rbtree_link_last(struct rbtree_link *root);
+struct rbtree_link *rbtree_link_next(struct rbtree_link *node);
+struct rbtree_link *rbtree_link_prev(struct rbtree_link *node);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UTILS_RB_TREE_LINK */
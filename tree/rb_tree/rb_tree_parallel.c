@@ -0,0 +1,374 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <memory.h>
+#include "rb_tree.h"
+#include "rb_tree_internal.h"
+
+#define RB_PAR_TASKS_PER_THREAD 8 // 每个线程平均分到的任务数，任务大小不均时由领取的顺序平衡
+
+// 一个按 key 连续的任务：先访问单个节点 pre，再中序访问以 sub 为根的子树，二者都可以为 NULL
+struct par_task {
+    node_t *pre;
+    node_t *sub;
+};
+
+struct par_job {
+    rbroot_t *root;
+    struct par_task *tasks;
+    size_t nr_tasks;
+    size_t next; // 下一个待领取的任务
+    node_t *pending;
+    // 访问一个节点，partial 为当前任务的部分结果
+    void (*visit)(struct par_job *job, size_t i, void *partial, node_t *node);
+    void (*cb)(void *key, void *value, void *ctx);
+    void *(*init)(void *ctx);
+    void (*map)(void *partial, void *key, void *value, void *ctx);
+    void **partials;
+    size_t *counts;
+    void *ctx;
+};
+
+static node_t *par_next(node_t *node)
+{
+    node_t *parent;
+
+    if (node->right != NULL) {
+        for (node = node->right; node->left != NULL; node = node->left) {
+        }
+        return node;
+    }
+    while ((parent = rb_parent(node)) != NULL && parent->right == node) {
+        node = parent;
+    }
+    return parent;
+}
+
+static void par_emit(struct par_job *job, node_t *pre, node_t *sub)
+{
+    job->tasks[job->nr_tasks].pre = pre;
+    job->tasks[job->nr_tasks].sub = sub;
+    job->nr_tasks++;
+}
+
+// 深度为 depth 的子树各成为一个任务，其上的节点依附于中序紧随其后的子树
+static void par_collect(struct par_job *job, node_t *node, int depth)
+{
+    if (node == NULL) {
+        return;
+    }
+    if (depth == 0) {
+        par_emit(job, job->pending, node);
+        job->pending = NULL;
+        return;
+    }
+    par_collect(job, node->left, depth - 1);
+    if (job->pending) {
+        par_emit(job, job->pending, NULL);
+    }
+    job->pending = node;
+    par_collect(job, node->right, depth - 1);
+}
+
+// 把树切成约 nr_tasks 个任务，返回 0 或 -1（内存不足）
+static int par_split(struct par_job *job, size_t nr_tasks)
+{
+    int depth = 0;
+
+    while (((size_t)1 << depth) < nr_tasks && depth < 30) {
+        depth++;
+    }
+    // 深度 depth 处最多 2^depth 个子树，其上最多 2^depth - 1 个节点
+    job->tasks = malloc(sizeof(struct par_task) << (depth + 1));
+    if (job->tasks == NULL) {
+        return -1;
+    }
+    job->nr_tasks = 0;
+    job->next = 0;
+    job->pending = NULL;
+    par_collect(job, job->root->node, depth);
+    if (job->pending) {
+        par_emit(job, job->pending, NULL);
+    }
+    return 0;
+}
+
+static void par_walk(struct par_job *job, size_t i, void *partial, node_t *node)
+{
+    while (node != NULL) {
+        par_walk(job, i, partial, node->left);
+        job->visit(job, i, partial, node);
+        node = node->right;
+    }
+}
+
+static void *par_worker(void *arg)
+{
+    struct par_job *job = arg;
+    struct par_task *task;
+    void *partial;
+    size_t i;
+
+    while ((i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->nr_tasks) {
+        task = &job->tasks[i];
+        partial = job->init ? job->init(job->ctx) : NULL;
+        if (job->partials) {
+            job->partials[i] = partial;
+        }
+        if (task->pre) {
+            job->visit(job, i, partial, task->pre);
+        }
+        par_walk(job, i, partial, task->sub);
+    }
+    return NULL;
+}
+
+// 调用线程之外再创建 nr_threads - 1 个线程领取任务，创建失败时由已有的线程完成
+static void par_run(struct par_job *job, int nr_threads)
+{
+    pthread_t *tids = NULL;
+    int i, nr = 0;
+
+    if (nr_threads > 1 && (tids = malloc(sizeof(pthread_t) * (nr_threads - 1))) != NULL) {
+        for (i = 0; i < nr_threads - 1; i++) {
+            if (pthread_create(&tids[nr], NULL, par_worker, job) == 0) {
+                nr++;
+            }
+        }
+    }
+    par_worker(job);
+    for (i = 0; i < nr; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    free(tids);
+}
+
+static size_t par_nr_tasks(int nr_threads)
+{
+    return nr_threads > 1 ? (size_t)nr_threads * RB_PAR_TASKS_PER_THREAD : 1;
+}
+
+static void par_visit_cb(struct par_job *job, size_t i, void *partial, node_t *node)
+{
+    (void)i;
+    (void)partial;
+    job->cb(node->key, node->value, job->ctx);
+}
+
+static void par_visit_map(struct par_job *job, size_t i, void *partial, node_t *node)
+{
+    (void)i;
+    job->map(partial, node->key, node->value, job->ctx);
+}
+
+static void par_visit_count(struct par_job *job, size_t i, void *partial, node_t *node)
+{
+    (void)partial;
+    (void)node;
+    job->counts[i]++;
+}
+
+int rbtree_parallel_foreach(struct rbtree_root *root, int nr_threads,
+                            void (*cb)(void *key, void *value, void *ctx), void *ctx)
+{
+    struct par_job job;
+
+    if (root == NULL || cb == NULL) {
+        return -1;
+    }
+    memset(&job, 0, sizeof(job));
+    job.root = root;
+    job.visit = par_visit_cb;
+    job.cb = cb;
+    job.ctx = ctx;
+
+    LOCK_RBTREE_RD(root);
+    if (par_split(&job, par_nr_tasks(nr_threads)) != 0) {
+        UNLOCK_RBTREE(root);
+        return -1;
+    }
+    par_run(&job, nr_threads);
+    UNLOCK_RBTREE(root);
+    free(job.tasks);
+    return 0;
+}
+
+int rbtree_parallel_reduce(struct rbtree_root *root, int nr_threads, void *(*init)(void *ctx),
+                           void (*map)(void *partial, void *key, void *value, void *ctx),
+                           void (*reduce)(void *result, void *partial, void *ctx), void *result,
+                           void *ctx)
+{
+    struct par_job job;
+    size_t i;
+
+    if (root == NULL || map == NULL || reduce == NULL) {
+        return -1;
+    }
+    memset(&job, 0, sizeof(job));
+    job.root = root;
+    job.visit = par_visit_map;
+    job.init = init;
+    job.map = map;
+    job.ctx = ctx;
+
+    LOCK_RBTREE_RD(root);
+    if (par_split(&job, par_nr_tasks(nr_threads)) != 0 ||
+        (job.partials = calloc(job.nr_tasks ? job.nr_tasks : 1, sizeof(void *))) == NULL) {
+        UNLOCK_RBTREE(root);
+        free(job.tasks);
+        return -1;
+    }
+    par_run(&job, nr_threads);
+    UNLOCK_RBTREE(root);
+    // 任务按 key 的顺序排列，reduce 不必满足交换律
+    for (i = 0; i < job.nr_tasks; i++) {
+        reduce(result, job.partials[i], ctx);
+    }
+    free(job.partials);
+    free(job.tasks);
+    return 0;
+}
+
+// 中序第 k 个节点，要求 order_stat
+static node_t *par_select(node_t *x, size_t k)
+{
+    size_t left;
+
+    while (x != NULL) {
+        left = x->left ? rb_count(x->left) : 0;
+        if (k == left) {
+            break;
+        }
+        if (k < left) {
+            x = x->left;
+        } else {
+            k -= left + 1;
+            x = x->right;
+        }
+    }
+    return x;
+}
+
+struct par_range {
+    rbroot_t *root;
+    int part;
+    node_t *first;
+    size_t n;
+    void (*fn)(int part, struct rbtree_cursor *cursor, size_t n, void *ctx);
+    void *ctx;
+};
+
+static void *par_range_thread(void *arg)
+{
+    struct par_range *r = arg;
+    struct rbtree_cursor cursor;
+
+    rbtree_cursor_init(&cursor, r->root, RBTREE_CURSOR_LOCK_BATCH);
+    rbtree_cursor_set(&cursor, r->first);
+    cursor.version = r->root->version;
+    r->fn(r->part, &cursor, r->n, r->ctx);
+    return NULL;
+}
+
+// 没有子树大小时先并行统计每个任务的节点数，再由任务内的偏移定位各段的起点
+static int par_locate(rbroot_t *root, struct par_range *ranges, int nr_parts, size_t *total)
+{
+    struct par_job job;
+    struct par_task *task;
+    node_t *node;
+    size_t i, base = 0, start, skip;
+    int p = 0;
+
+    memset(&job, 0, sizeof(job));
+    job.root = root;
+    job.visit = par_visit_count;
+    if (par_split(&job, par_nr_tasks(nr_parts)) != 0 ||
+        (job.counts = calloc(job.nr_tasks ? job.nr_tasks : 1, sizeof(size_t))) == NULL) {
+        free(job.tasks);
+        return -1;
+    }
+    par_run(&job, nr_parts);
+    for (i = 0; i < job.nr_tasks; i++) {
+        *total += job.counts[i];
+    }
+    for (i = 0; i < job.nr_tasks && p < nr_parts; i++) {
+        while (p < nr_parts && (start = *total * p / nr_parts) < base + job.counts[i]) {
+            task = &job.tasks[i];
+            node = task->pre;
+            if (node == NULL) {
+                for (node = task->sub; node->left != NULL; node = node->left) {
+                }
+            }
+            for (skip = start - base; skip > 0; skip--) {
+                node = par_next(node);
+            }
+            ranges[p++].first = node;
+        }
+        base += job.counts[i];
+    }
+    free(job.counts);
+    free(job.tasks);
+    return 0;
+}
+
+int rbtree_parallel_ranges(struct rbtree_root *root, int nr_parts,
+                           void (*fn)(int part, struct rbtree_cursor *cursor, size_t n, void *ctx),
+                           void *ctx)
+{
+    struct par_range *ranges;
+    pthread_t *tids;
+    bool *threaded;
+    size_t total = 0;
+    int p, rc = 0;
+
+    if (root == NULL || fn == NULL || nr_parts < 1) {
+        return -1;
+    }
+    ranges = calloc(nr_parts, sizeof(struct par_range));
+    tids = calloc(nr_parts, sizeof(pthread_t));
+    threaded = calloc(nr_parts, sizeof(bool));
+    if (!ranges || !tids || !threaded) {
+        rc = -1;
+        goto out;
+    }
+
+    LOCK_RBTREE_RD(root);
+    if (root->order_stat) {
+        total = root->node ? rb_count(root->node) : 0;
+        for (p = 0; p < nr_parts; p++) {
+            ranges[p].first = par_select(root->node, total * p / nr_parts);
+        }
+    } else if (par_locate(root, ranges, nr_parts, &total) != 0) {
+        UNLOCK_RBTREE(root);
+        rc = -1;
+        goto out;
+    }
+    for (p = 0; p < nr_parts; p++) {
+        ranges[p].root = root;
+        ranges[p].part = p;
+        ranges[p].n = total * (p + 1) / nr_parts - total * p / nr_parts;
+        if (ranges[p].n == 0) {
+            ranges[p].first = NULL;
+        }
+        ranges[p].fn = fn;
+        ranges[p].ctx = ctx;
+    }
+    // 最后一段在调用线程上执行，创建线程失败的段随后也在调用线程上执行
+    for (p = 0; p < nr_parts - 1; p++) {
+        threaded[p] = pthread_create(&tids[p], NULL, par_range_thread, &ranges[p]) == 0;
+    }
+    par_range_thread(&ranges[nr_parts - 1]);
+    for (p = 0; p < nr_parts - 1; p++) {
+        if (threaded[p]) {
+            pthread_join(tids[p], NULL);
+        } else {
+            par_range_thread(&ranges[p]);
+        }
+    }
+    UNLOCK_RBTREE(root);
+
+out:
+    free(threaded);
+    free(tids);
+    free(ranges);
+    return rc;
+}
@@ -0,0 +1,594 @@
+#include "rb_tree_persist.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <memory.h>
+
+#define RB_PERSIST_RED   0
+#define RB_PERSIST_BLACK 1
+
+// 一次修改在每一层最多复制的节点数：路径上的节点，加上旋转和颜色翻转涉及的孩子
+#define RB_PERSIST_COPY_PER_LEVEL 12
+
+// key/value 拷贝的引用计数，由所有指向同一份拷贝的节点共享
+struct persist_ref {
+    uint32_t count;
+};
+
+// 快照树的节点，可能同时属于多个版本，被共享时只读
+typedef struct persist_node {
+    void *key;
+    void *value;
+    struct persist_node *left;
+    struct persist_node *right;
+    struct persist_ref *key_ref;   // 非 NULL: key 是 copy_key 得到的拷贝
+    struct persist_ref *value_ref; // 非 NULL: value 是 copy_value 得到的拷贝
+    uint32_t refcnt;               // 指向该节点的孩子指针和根指针的个数
+    unsigned char color;
+} pnode_t;
+
+struct rbtree_persist {
+    pnode_t *root;
+    size_t size;
+    int (*cmp_key)(void *key0, void *key1);
+    void *(*copy_key)(void *key);
+    void (*free_key)(void *key);
+    void *(*copy_value)(void *key);
+    void (*free_value)(void *value);
+    bool is_thread_safe;
+    pthread_rwlock_t rwlocker;
+    uint32_t refcnt; // 1 + 未释放的快照数，归零时释放树的根结构
+    pnode_t *spare;  // 写者预先分配的节点，保证修改开始后不会因内存不足而中断
+    size_t nr_spare;
+};
+
+struct rbtree_snapshot {
+    struct rbtree_persist *tree;
+    pnode_t *root;
+    size_t size;
+};
+
+#define LOCK_PERSIST_WR(t)                       \
+    {                                            \
+        if ((t)->is_thread_safe)                 \
+            pthread_rwlock_wrlock(&t->rwlocker); \
+    }
+#define LOCK_PERSIST_RD(t)                       \
+    {                                            \
+        if ((t)->is_thread_safe)                 \
+            pthread_rwlock_rdlock(&t->rwlocker); \
+    }
+#define UNLOCK_PERSIST(t)                        \
+    {                                            \
+        if ((t)->is_thread_safe)                 \
+            pthread_rwlock_unlock(&t->rwlocker); \
+    }
+
+// 与 rb_tree.c 中的默认回调一致
+static int default_cmp_key(void *key0, void *key1)
+{
+    if ((uint64_t)key0 < (uint64_t)key1) {
+        return -1;
+    } else if ((uint64_t)key0 > (uint64_t)key1) {
+        return 1;
+    }
+    return 0;
+}
+
+static void *default_copy(void *ptr)
+{
+    void *p = calloc(1, sizeof(uint64_t));
+    if (!p) {
+        return NULL;
+    }
+    memcpy(p, ptr, sizeof(uint64_t));
+    return p;
+}
+
+static void default_free(void *ptr)
+{
+    free(ptr);
+}
+
+static inline bool is_red(pnode_t *node)
+{
+    return node != NULL && node->color == RB_PERSIST_RED;
+}
+
+static inline void ref_get(struct persist_ref *ref)
+{
+    if (ref) {
+        __atomic_add_fetch(&ref->count, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static void ref_put(struct persist_ref *ref, void *ptr, void (*free_fn)(void *ptr))
+{
+    if (ref && __atomic_sub_fetch(&ref->count, 1, __ATOMIC_ACQ_REL) == 0) {
+        free_fn(ptr);
+        free(ref);
+    }
+}
+
+static inline void node_get(pnode_t *node)
+{
+    if (node) {
+        __atomic_add_fetch(&node->refcnt, 1, __ATOMIC_RELAXED);
+    }
+}
+
+// 去掉一个引用，归零时释放节点并去掉它对孩子的引用。快照释放时可能在任意线程中调用
+static void node_put(struct rbtree_persist *tree, pnode_t *node)
+{
+    if (node == NULL || __atomic_sub_fetch(&node->refcnt, 1, __ATOMIC_ACQ_REL) != 0) {
+        return;
+    }
+    ref_put(node->key_ref, node->key, tree->free_key);
+    ref_put(node->value_ref, node->value, tree->free_value);
+    node_put(tree, node->left);
+    node_put(tree, node->right);
+    free(node);
+}
+
+static void tree_put(struct rbtree_persist *tree)
+{
+    pnode_t *node;
+
+    if (__atomic_sub_fetch(&tree->refcnt, 1, __ATOMIC_ACQ_REL) != 0) {
+        return;
+    }
+    while ((node = tree->spare) != NULL) {
+        tree->spare = node->left;
+        free(node);
+    }
+    if (tree->is_thread_safe) {
+        pthread_rwlock_destroy(&tree->rwlocker);
+    }
+    free(tree);
+}
+
+// 按当前高度的上界预留一次修改可能用到的节点
+static int reserve(struct rbtree_persist *tree)
+{
+    size_t height = 2;
+    size_t need;
+    pnode_t *node;
+
+    while ((tree->size + 1) >> (height / 2)) {
+        height += 2;
+    }
+    need = height * RB_PERSIST_COPY_PER_LEVEL + 1;
+    while (tree->nr_spare < need) {
+        if ((node = malloc(sizeof(pnode_t))) == NULL) {
+            return -1;
+        }
+        node->left = tree->spare;
+        tree->spare = node;
+        tree->nr_spare++;
+    }
+    return 0;
+}
+
+static pnode_t *node_alloc(struct rbtree_persist *tree)
+{
+    pnode_t *node = tree->spare;
+    tree->spare = node->left;
+    tree->nr_spare--;
+    return node;
+}
+
+/**
+ * @brief 取得可以修改的节点，接管调用者对 node 的引用。只有当前版本引用 node 时原地修改，
+ *        否则复制一份，复制的节点引用原节点的孩子和 key/value
+ *
+ * 调用者必须保证 node 的父节点也是可以修改的，此时引用计数为 1 说明没有其它版本能访问到它
+ */
+static pnode_t *node_mut(struct rbtree_persist *tree, pnode_t *node)
+{
+    pnode_t *copy;
+
+    if (__atomic_load_n(&node->refcnt, __ATOMIC_ACQUIRE) == 1) {
+        return node;
+    }
+    // 逐个字段复制，不读取其它线程可能正在修改的 refcnt
+    copy = node_alloc(tree);
+    copy->key = node->key;
+    copy->value = node->value;
+    copy->left = node->left;
+    copy->right = node->right;
+    copy->key_ref = node->key_ref;
+    copy->value_ref = node->value_ref;
+    copy->color = node->color;
+    copy->refcnt = 1;
+    node_get(copy->left);
+    node_get(copy->right);
+    ref_get(copy->key_ref);
+    ref_get(copy->value_ref);
+    node_put(tree, node);
+    return copy;
+}
+
+// 以下旋转和颜色翻转同 Sedgewick 的左倾红黑树，被修改的孩子先经过 node_mut
+static pnode_t *rotate_left(struct rbtree_persist *tree, pnode_t *h)
+{
+    pnode_t *x = node_mut(tree, h->right);
+    h->right = x->left;
+    x->left = h;
+    x->color = h->color;
+    h->color = RB_PERSIST_RED;
+    return x;
+}
+
+static pnode_t *rotate_right(struct rbtree_persist *tree, pnode_t *h)
+{
+    pnode_t *x = node_mut(tree, h->left);
+    h->left = x->right;
+    x->right = h;
+    x->color = h->color;
+    h->color = RB_PERSIST_RED;
+    return x;
+}
+
+static void flip_colors(struct rbtree_persist *tree, pnode_t *h)
+{
+    h->left = node_mut(tree, h->left);
+    h->right = node_mut(tree, h->right);
+    h->color = !h->color;
+    h->left->color = !h->left->color;
+    h->right->color = !h->right->color;
+}
+
+static pnode_t *balance(struct rbtree_persist *tree, pnode_t *h)
+{
+    if (is_red(h->right) && !is_red(h->left)) {
+        h = rotate_left(tree, h);
+    }
+    if (is_red(h->left) && is_red(h->left->left)) {
+        h = rotate_right(tree, h);
+    }
+    if (is_red(h->left) && is_red(h->right)) {
+        flip_colors(tree, h);
+    }
+    return h;
+}
+
+static pnode_t *move_red_left(struct rbtree_persist *tree, pnode_t *h)
+{
+    flip_colors(tree, h);
+    if (is_red(h->right->left)) {
+        h->right = rotate_right(tree, h->right);
+        h = rotate_left(tree, h);
+        flip_colors(tree, h);
+    }
+    return h;
+}
+
+static pnode_t *move_red_right(struct rbtree_persist *tree, pnode_t *h)
+{
+    flip_colors(tree, h);
+    if (is_red(h->left->left)) {
+        h = rotate_right(tree, h);
+        flip_colors(tree, h);
+    }
+    return h;
+}
+
+// 插入时预先准备好的新节点内容
+struct persist_entry {
+    void *key;
+    void *value;
+    struct persist_ref *key_ref;
+    struct persist_ref *value_ref;
+    bool replaced;
+};
+
+static pnode_t *insert(struct rbtree_persist *tree, pnode_t *h, struct persist_entry *entry)
+{
+    int cmp;
+
+    if (h == NULL) {
+        h = node_alloc(tree);
+        h->key = entry->key;
+        h->value = entry->value;
+        h->key_ref = entry->key_ref;
+        h->value_ref = entry->value_ref;
+        h->left = h->right = NULL;
+        h->refcnt = 1;
+        h->color = RB_PERSIST_RED;
+        return h;
+    }
+
+    h = node_mut(tree, h);
+    cmp = tree->cmp_key(entry->key, h->key);
+    if (cmp == 0) {
+        // 保留节点原来的 key，新的 key 拷贝不再需要
+        ref_put(entry->key_ref, entry->key, tree->free_key);
+        ref_put(h->value_ref, h->value, tree->free_value);
+        h->value = entry->value;
+        h->value_ref = entry->value_ref;
+        entry->replaced = true;
+        return h;
+    }
+    if (cmp < 0) {
+        h->left = insert(tree, h->left, entry);
+    } else {
+        h->right = insert(tree, h->right, entry);
+    }
+    return balance(tree, h);
+}
+
+// 删除子树中最小的节点，左倾红黑树中没有左孩子的节点也没有右孩子
+static pnode_t *delete_min(struct rbtree_persist *tree, pnode_t *h)
+{
+    h = node_mut(tree, h);
+    if (h->left == NULL) {
+        node_put(tree, h);
+        return NULL;
+    }
+    if (!is_red(h->left) && !is_red(h->left->left)) {
+        h = move_red_left(tree, h);
+    }
+    h->left = delete_min(tree, h->left);
+    return balance(tree, h);
+}
+
+// key 必须存在
+static pnode_t *delete(struct rbtree_persist *tree, pnode_t *h, void *key)
+{
+    pnode_t *min;
+
+    h = node_mut(tree, h);
+    if (tree->cmp_key(key, h->key) < 0) {
+        if (!is_red(h->left) && !is_red(h->left->left)) {
+            h = move_red_left(tree, h);
+        }
+        h->left = delete(tree, h->left, key);
+        return balance(tree, h);
+    }
+    if (is_red(h->left)) {
+        h = rotate_right(tree, h);
+    }
+    if (tree->cmp_key(key, h->key) == 0 && h->right == NULL) {
+        node_put(tree, h);
+        return NULL;
+    }
+    if (!is_red(h->right) && !is_red(h->right->left)) {
+        h = move_red_right(tree, h);
+    }
+    if (tree->cmp_key(key, h->key) == 0) {
+        // 用右子树中最小的节点的内容取代当前节点，再删除那个节点
+        for (min = h->right; min->left != NULL; min = min->left) {
+        }
+        ref_put(h->key_ref, h->key, tree->free_key);
+        ref_put(h->value_ref, h->value, tree->free_value);
+        h->key = min->key;
+        h->value = min->value;
+        h->key_ref = min->key_ref;
+        h->value_ref = min->value_ref;
+        ref_get(h->key_ref);
+        ref_get(h->value_ref);
+        h->right = delete_min(tree, h->right);
+    } else {
+        h->right = delete(tree, h->right, key);
+    }
+    return balance(tree, h);
+}
+
+static pnode_t *search(struct rbtree_persist *tree, pnode_t *x, void *key)
+{
+    int cmp;
+
+    while (x != NULL) {
+        cmp = tree->cmp_key(key, x->key);
+        if (cmp == 0) {
+            return x;
+        }
+        x = cmp < 0 ? x->left : x->right;
+    }
+    return NULL;
+}
+
+static void inorder(pnode_t *x, void (*cb)(void *key, void *value))
+{
+    while (x != NULL) {
+        inorder(x->left, cb);
+        cb(x->key, x->value);
+        x = x->right;
+    }
+}
+
+struct rbtree_persist *rbtree_persist_init(struct rbtree_arg arg)
+{
+    struct rbtree_persist *tree = calloc(1, sizeof(struct rbtree_persist));
+    if (!tree) {
+        return NULL;
+    }
+
+    tree->cmp_key = arg.cmp_key ? arg.cmp_key : default_cmp_key;
+    tree->copy_key = arg.copy_key ? arg.copy_key : default_copy;
+    tree->free_key = arg.free_key ? arg.free_key : default_free;
+    tree->copy_value = arg.copy_value ? arg.copy_value : default_copy;
+    tree->free_value = arg.free_value ? arg.free_value : default_free;
+    tree->is_thread_safe = arg.is_thread_safe;
+    tree->refcnt = 1;
+    if (tree->is_thread_safe && pthread_rwlock_init(&tree->rwlocker, NULL) != 0) {
+        free(tree);
+        return NULL;
+    }
+    return tree;
+}
+
+void rbtree_persist_destroy(struct rbtree_persist *tree)
+{
+    if (!tree) {
+        return;
+    }
+    LOCK_PERSIST_WR(tree);
+    node_put(tree, tree->root);
+    tree->root = NULL;
+    tree->size = 0;
+    UNLOCK_PERSIST(tree);
+    tree_put(tree);
+}
+
+int rbtree_persist_insert(struct rbtree_persist *tree, void *key, void *value, bool key_copy,
+                          bool val_copy)
+{
+    struct persist_entry entry = {key, value, NULL, NULL, false};
+    pnode_t *root;
+
+    if (!tree) {
+        return -1;
+    }
+    // 拷贝和分配都在修改树之前完成，失败时树不变
+    if (key_copy) {
+        entry.key_ref = malloc(sizeof(struct persist_ref));
+        if (!entry.key_ref || !(entry.key = tree->copy_key(key))) {
+            goto err0;
+        }
+        entry.key_ref->count = 1;
+    }
+    if (val_copy) {
+        entry.value_ref = malloc(sizeof(struct persist_ref));
+        if (!entry.value_ref || !(entry.value = tree->copy_value(value))) {
+            goto err1;
+        }
+        entry.value_ref->count = 1;
+    }
+
+    LOCK_PERSIST_WR(tree);
+    if (reserve(tree) != 0) {
+        UNLOCK_PERSIST(tree);
+        goto err2;
+    }
+    root = insert(tree, tree->root, &entry);
+    root->color = RB_PERSIST_BLACK;
+    tree->root = root;
+    if (!entry.replaced) {
+        tree->size++;
+    }
+    UNLOCK_PERSIST(tree);
+    return entry.replaced ? 1 : 0;
+
+err2:
+    if (val_copy) {
+        tree->free_value(entry.value);
+    }
+err1:
+    free(entry.value_ref);
+    if (key_copy && entry.key) {
+        tree->free_key(entry.key);
+    }
+err0:
+    free(entry.key_ref);
+    return -1;
+}
+
+int rbtree_persist_delete(struct rbtree_persist *tree, void *key)
+{
+    pnode_t *root;
+
+    if (!tree) {
+        return -1;
+    }
+    LOCK_PERSIST_WR(tree);
+    if (search(tree, tree->root, key) == NULL) {
+        UNLOCK_PERSIST(tree);
+        return 0;
+    }
+    if (reserve(tree) != 0) {
+        UNLOCK_PERSIST(tree);
+        return -1;
+    }
+    root = node_mut(tree, tree->root);
+    if (!is_red(root->left) && !is_red(root->right)) {
+        root->color = RB_PERSIST_RED;
+    }
+    root = delete(tree, root, key);
+    if (root) {
+        root->color = RB_PERSIST_BLACK;
+    }
+    tree->root = root;
+    tree->size--;
+    UNLOCK_PERSIST(tree);
+    return 0;
+}
+
+void *rbtree_persist_search(struct rbtree_persist *tree, void *key)
+{
+    pnode_t *node;
+    void *value = NULL;
+
+    if (!tree) {
+        return NULL;
+    }
+    LOCK_PERSIST_RD(tree);
+    if ((node = search(tree, tree->root, key)) != NULL) {
+        value = node->value;
+    }
+    UNLOCK_PERSIST(tree);
+    return value;
+}
+
+size_t rbtree_persist_size(struct rbtree_persist *tree)
+{
+    size_t size;
+
+    if (!tree) {
+        return 0;
+    }
+    LOCK_PERSIST_RD(tree);
+    size = tree->size;
+    UNLOCK_PERSIST(tree);
+    return size;
+}
+
+struct rbtree_snapshot *rbtree_snapshot(struct rbtree_persist *tree)
+{
+    struct rbtree_snapshot *snap;
+
+    if (!tree || (snap = malloc(sizeof(struct rbtree_snapshot))) == NULL) {
+        return NULL;
+    }
+    // 写者持有写锁时不会有快照增加引用，它看到引用计数为 1 的节点可以安全地原地修改
+    LOCK_PERSIST_RD(tree);
+    snap->tree = tree;
+    snap->root = tree->root;
+    snap->size = tree->size;
+    node_get(snap->root);
+    __atomic_add_fetch(&tree->refcnt, 1, __ATOMIC_RELAXED);
+    UNLOCK_PERSIST(tree);
+    return snap;
+}
+
+void rbtree_snapshot_release(struct rbtree_snapshot *snap)
+{
+    if (!snap) {
+        return;
+    }
+    node_put(snap->tree, snap->root);
+    tree_put(snap->tree);
+    free(snap);
+}
+
+void *rbtree_snapshot_search(struct rbtree_snapshot *snap, void *key)
+{
+    pnode_t *node;
+
+    if (!snap || (node = search(snap->tree, snap->root, key)) == NULL) {
+        return NULL;
+    }
+    return node->value;
+}
+
+size_t rbtree_snapshot_size(struct rbtree_snapshot *snap)
+{
+    return snap ? snap->size : 0;
+}
+
+void rbtree_snapshot_inorder(struct rbtree_snapshot *snap, void (*cb)(void *key, void *value))
+{
+    if (!snap || !cb) {
+        return;
+    }
+    inorder(snap->root, cb);
+}
@@ -0,0 +1,119 @@
+#ifndef UTILS_RB_TREE_PERSIST
+#define UTILS_RB_TREE_PERSIST
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rb_tree.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct rbtree_persist;
+struct rbtree_snapshot;
+
+/**
+ * @brief 创建一个支持快照的红黑树（左倾红黑树，节点没有父指针）。
+ *        修改时只复制从根到目标路径上被其它快照共享的节点，未共享的节点原地修改；
+ *        节点按引用计数回收，最后一个引用它的版本释放时才释放节点和它持有的 key/value 拷贝
+ *
+ * @param arg 使用 is_thread_safe、cmp_key、copy_key、free_key、copy_value、free_value，
+ *            节点总是由 malloc 分配（快照可能在其它线程中释放节点），其余参数被忽略
+ * @return struct rbtree_persist*
+ */
+struct rbtree_persist *rbtree_persist_init(struct rbtree_arg arg);
+
+/**
+ * @brief 销毁树，尚未释放的快照仍然有效，最后一个快照释放时回收剩余的内存
+ *
+ * @param tree
+ */
+void rbtree_persist_destroy(struct rbtree_persist *tree);
+
+/**
+ * @brief 插入或更新一个节点，同 rbtree_upsert 中 merge 为 NULL 的情况
+ *
+ * @param tree
+ * @param key
+ * @param value
+ * @param key_copy true: 对 key 调用 copy_key 进行拷贝
+ * @param val_copy true: 对 val 调用 copy_val 进行拷贝
+ * @return int 0: 插入了新节点; 1: key 已存在并完成更新; -1: 失败，树不变
+ */
+int rbtree_persist_insert(struct rbtree_persist *tree, void *key, void *value, bool key_copy,
+                          bool val_copy);
+
+/**
+ * @brief 删除一个节点，已经创建的快照不受影响
+ *
+ * @param tree
+ * @param key
+ * @return int 0: 成功或 key 不存在; -1: 内存不足，树不变
+ */
+int rbtree_persist_delete(struct rbtree_persist *tree, void *key);
+
+/**
+ * @brief 在最新版本中查看一个 key 对应的 value，如果没有返回 NULL
+ *
+ * @param tree
+ * @param key
+ * @return void*
+ */
+void *rbtree_persist_search(struct rbtree_persist *tree, void *key);
+
+/**
+ * @brief 节点数
+ *
+ * @param tree
+ * @return size_t
+ */
+size_t rbtree_persist_size(struct rbtree_persist *tree);
+
+/**
+ * @brief 在 O(1) 时间内创建当前版本的只读快照。之后的写入不会改变快照的内容，
+ *        读取快照不加锁，不阻塞写者
+ *
+ * @param tree
+ * @return struct rbtree_snapshot* 失败时返回 NULL
+ */
+struct rbtree_snapshot *rbtree_snapshot(struct rbtree_persist *tree);
+
+/**
+ * @brief 释放快照，可以在任意线程中调用
+ *
+ * @param snap
+ */
+void rbtree_snapshot_release(struct rbtree_snapshot *snap);
+
+/**
+ * @brief 在快照中查看一个 key 对应的 value，如果没有返回 NULL
+ *
+ * @param snap
+ * @param key
+ * @return void*
+ */
+void *rbtree_snapshot_search(struct rbtree_snapshot *snap, void *key);
+
+/**
+ * @brief 快照中的节点数
+ *
+ * @param snap
+ * @return size_t
+ */
+size_t rbtree_snapshot_size(struct rbtree_snapshot *snap);
+
+/**
+ * @brief 中序遍历快照
+ *
+ * @param snap
+ * @param cb
+ */
+void rbtree_snapshot_inorder(struct rbtree_snapshot *snap, void (*cb)(void *key, void *value));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UTILS_RB_TREE_PERSIST */
@@ -0,0 +1,497 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <memory.h>
+#include "rb_tree_internal.h"
+
+// 子树黑高不小于该值（至少约 2^8 个节点）时，两半才分到不同的线程上执行
+#define RB_SETOP_GRAIN_HEIGHT 8
+
+#define RB_SETOP_UNION      0
+#define RB_SETOP_INTERSECT  1
+#define RB_SETOP_DIFFERENCE 2
+
+// 集合运算中被淘汰的节点，通过 left 串起来，运算结束后在调用线程中统一释放
+struct setop_list {
+    node_t *head;
+    node_t *tail;
+};
+
+// 一次递归的参数和结果，a 来自 dst，b 来自 src
+struct setop_task {
+    const rbroot_t *proto; // 提供 cmp_key 和节点附加数据的维护方式
+    int op;
+    node_t *a;
+    size_t ha;
+    node_t *b;
+    size_t hb;
+    int depth; // 还可以再分出线程的层数
+    node_t *result;
+    size_t h;
+    struct setop_list dropped;
+};
+
+// 黑高：从 node 到叶子路径上的黑色节点数，包含 node 本身
+static size_t black_height(node_t *node)
+{
+    size_t h = 0;
+    for (; node != NULL; node = node->left) {
+        h += rb_is_black(node);
+    }
+    return h;
+}
+
+// 旋转和修正只用到根结构中的 node、order_stat 和 augment，每个线程用自己的临时根结构
+static void scratch_init(rbroot_t *scratch, const rbroot_t *proto)
+{
+    memset(scratch, 0, sizeof(rbroot_t));
+    scratch->cmp_key = proto->cmp_key;
+    scratch->order_stat = proto->order_stat;
+    scratch->tail_offset = proto->tail_offset;
+    scratch->augment = proto->augment;
+}
+
+static void list_push(struct setop_list *list, node_t *node)
+{
+    node->left = list->head;
+    list->head = node;
+    if (list->tail == NULL) {
+        list->tail = node;
+    }
+}
+
+static void list_concat(struct setop_list *list, struct setop_list *other)
+{
+    if (other->head == NULL) {
+        return;
+    }
+    if (list->head == NULL) {
+        *list = *other;
+        return;
+    }
+    list->tail->left = other->head;
+    list->tail = other->tail;
+}
+
+static void list_push_tree(struct setop_list *list, node_t *node)
+{
+    if (node == NULL) {
+        return;
+    }
+    list_push_tree(list, node->right);
+    list_push_tree(list, node->left);
+    list_push(list, node);
+}
+
+// 把子树摘下作为一棵独立的树，红色的根染黑后黑高加 1
+static node_t *detach(node_t *node, size_t *h)
+{
+    if (node != NULL) {
+        rb_set_parent(node, NULL);
+        if (rb_is_red(node)) {
+            rb_set_black(node);
+            (*h)++;
+        }
+    }
+    return node;
+}
+
+/**
+ * @brief 用 k 连接 l 和 r，l 中的 key 都小于 k，r 中的 key 都大于 k。沿较高一棵树的边缘下降到
+ *        黑高与另一棵相同的黑色节点 c，用红色的 k 取代 c 并把 c 和另一棵树作为 k 的孩子，
+ *        之后的修正与插入相同。耗时 O(|hl - hr| + 1)
+ *
+ * @return node_t* 新的根，黑高通过 h 返回
+ */
+static node_t *join(rbroot_t *scratch, node_t *l, size_t hl, node_t *k, node_t *r, size_t hr,
+                    size_t *h)
+{
+    node_t *c, *p = NULL;
+    size_t ch;
+
+    l = detach(l, &hl);
+    r = detach(r, &hr);
+    if (hl == hr) {
+        k->left = l;
+        k->right = r;
+        if (l) {
+            rb_set_parent(l, k);
+        }
+        if (r) {
+            rb_set_parent(r, k);
+        }
+        rb_set_parent(k, NULL);
+        rb_set_black(k);
+        rbtree_node_update(scratch, k);
+        *h = hl + 1;
+        return k;
+    }
+
+    if (hl > hr) {
+        for (c = l, ch = hl; c != NULL && !(rb_is_black(c) && ch == hr); c = c->right) {
+            ch -= rb_is_black(c);
+            p = c;
+        }
+        k->left = c;
+        k->right = r;
+        p->right = k;
+        scratch->node = l;
+        *h = hl;
+    } else {
+        for (c = r, ch = hr; c != NULL && !(rb_is_black(c) && ch == hl); c = c->left) {
+            ch -= rb_is_black(c);
+            p = c;
+        }
+        k->left = l;
+        k->right = c;
+        p->left = k;
+        scratch->node = r;
+        *h = hr;
+    }
+    if (k->left) {
+        rb_set_parent(k->left, k);
+    }
+    if (k->right) {
+        rb_set_parent(k->right, k);
+    }
+    rb_set_parent(k, p);
+    rb_set_red(k);
+    for (c = k; c != NULL; c = rb_parent(c)) {
+        rbtree_node_update(scratch, c);
+    }
+    *h += rbtree_insert_fixup(scratch, k);
+    return scratch->node;
+}
+
+// 没有中间节点的连接：取出 r 中最小的节点作为 k
+static node_t *join2(rbroot_t *scratch, node_t *l, size_t hl, node_t *r, size_t hr, size_t *h)
+{
+    node_t *k;
+
+    if (r == NULL) {
+        *h = hl;
+        return detach(l, h);
+    }
+    r = detach(r, &hr);
+    for (k = r; k->left != NULL; k = k->left) {
+    }
+    scratch->node = r;
+    rbtree_delete_node(scratch, k);
+    r = scratch->node;
+    return join(scratch, l, hl, k, r, black_height(r), h);
+}
+
+/**
+ * @brief 按 key 把 t 分成小于 key 的 l 和大于 key 的 r，等于 key 的节点通过返回值返回。
+ *        每一层的 join 耗时与两棵树的黑高差成正比，逐层相加后总耗时 O(log n)
+ */
+static node_t *split(rbroot_t *scratch, node_t *t, size_t h, void *key, node_t **l, size_t *hl,
+                     node_t **r, size_t *hr)
+{
+    node_t *found, *left, *right, *sub;
+    size_t hleft, hright, hsub;
+    int cmp;
+
+    if (t == NULL) {
+        *l = *r = NULL;
+        *hl = *hr = 0;
+        return NULL;
+    }
+    cmp = scratch->cmp_key(key, t->key);
+    left = t->left;
+    right = t->right;
+    hleft = hright = h - rb_is_black(t);
+    left = detach(left, &hleft);
+    right = detach(right, &hright);
+    if (cmp == 0) {
+        *l = left;
+        *hl = hleft;
+        *r = right;
+        *hr = hright;
+        return t;
+    }
+    if (cmp < 0) {
+        found = split(scratch, left, hleft, key, l, hl, &sub, &hsub);
+        *r = join(scratch, sub, hsub, t, right, hright, hr);
+    } else {
+        found = split(scratch, right, hright, key, &sub, &hsub, r, hr);
+        *l = join(scratch, left, hleft, t, sub, hsub, hl);
+    }
+    return found;
+}
+
+static void setop_run(struct setop_task *task);
+
+static void *setop_thread(void *arg)
+{
+    setop_run(arg);
+    return NULL;
+}
+
+// 以 b 的根为界把 a 分成两半，两半分别与 b 的左右子树递归运算，足够大时左半交给新线程
+static void setop_run(struct setop_task *task)
+{
+    rbroot_t scratch;
+    struct setop_task sub[2];
+    node_t *b = task->b;
+    node_t *found, *k = NULL;
+    pthread_t tid;
+    bool threaded = false;
+    int i;
+
+    memset(&task->dropped, 0, sizeof(task->dropped));
+    if (task->a == NULL) {
+        task->result = task->op == RB_SETOP_UNION ? detach(b, &task->hb) : NULL;
+        task->h = task->op == RB_SETOP_UNION ? task->hb : 0;
+        return;
+    }
+    if (b == NULL) {
+        if (task->op == RB_SETOP_INTERSECT) {
+            list_push_tree(&task->dropped, task->a);
+            task->result = NULL;
+            task->h = 0;
+        } else {
+            task->result = task->a;
+            task->h = task->ha;
+        }
+        return;
+    }
+
+    scratch_init(&scratch, task->proto);
+    for (i = 0; i < 2; i++) {
+        sub[i] = *task;
+        sub[i].depth = task->depth - 1;
+        sub[i].b = i == 0 ? b->left : b->right;
+        sub[i].hb = task->hb - rb_is_black(b);
+    }
+    found = split(&scratch, task->a, task->ha, b->key, &sub[0].a, &sub[0].ha, &sub[1].a,
+                  &sub[1].ha);
+    if (task->op == RB_SETOP_UNION) {
+        // union 消耗 src 的节点：b 与 dst 中的节点重复时保留 dst 的节点，b 被淘汰
+        sub[0].b = detach(b->left, &sub[0].hb);
+        sub[1].b = detach(b->right, &sub[1].hb);
+        if (found) {
+            k = found;
+            list_push(&task->dropped, b);
+        } else {
+            k = b;
+        }
+    } else if (task->op == RB_SETOP_INTERSECT) {
+        k = found;
+    } else if (found) {
+        list_push(&task->dropped, found);
+    }
+
+    if (task->depth > 0 && task->hb >= RB_SETOP_GRAIN_HEIGHT) {
+        threaded = pthread_create(&tid, NULL, setop_thread, &sub[0]) == 0;
+    }
+    if (!threaded) {
+        setop_run(&sub[0]);
+    }
+    setop_run(&sub[1]);
+    if (threaded) {
+        pthread_join(tid, NULL);
+    }
+
+    list_concat(&task->dropped, &sub[0].dropped);
+    list_concat(&task->dropped, &sub[1].dropped);
+    if (k) {
+        task->result = join(&scratch, sub[0].result, sub[0].h, k, sub[1].result, sub[1].h, &task->h);
+    } else {
+        task->result = join2(&scratch, sub[0].result, sub[0].h, sub[1].result, sub[1].h, &task->h);
+    }
+}
+
+// 两棵树的 key 可以相互比较，节点的布局相同
+static bool setop_compatible(rbroot_t *dst, rbroot_t *src)
+{
+    return dst != src && dst->cmp_key == src->cmp_key && dst->order_stat == src->order_stat &&
+           dst->node_size == src->node_size && dst->key_inline == src->key_inline &&
+           dst->augment == src->augment;
+}
+
+// 节点要从 src 移到 dst：都不使用内存池，src 的节点不在节点块中，没有乐观读者，释放方式相同
+static bool setop_movable(rbroot_t *dst, rbroot_t *src)
+{
+    return setop_compatible(dst, src) && !dst->node_pool && !src->node_pool && !src->blocks &&
+           !src->epoch && dst->free_key == src->free_key && dst->free_value == src->free_value;
+}
+
+// 分出线程的层数，2^depth 不小于 nr_threads
+static int setop_depth(int nr_threads)
+{
+    int depth = 0;
+    while (depth < 16 && (1 << depth) < nr_threads) {
+        depth++;
+    }
+    return depth;
+}
+
+static void setop_finish(rbroot_t *root, node_t *node, struct setop_list *dropped)
+{
+    node_t *next;
+
+    root->node = node;
+    if (node) {
+        rb_set_parent(node, NULL);
+        rb_set_black(node);
+    }
+    // 节点被整批移走或释放，逐个清除缓存项不划算
+    rbtree_cache_reset(root);
+    root->version++;
+    RB_SEQ_END(root);
+    for (node = dropped->head; node != NULL; node = next) {
+        next = node->left;
+        rbtree_drop_node(root, node);
+        root->nr_nodes--;
+    }
+}
+
+static int setop(rbroot_t *dst, rbroot_t *src, int op, int nr_threads)
+{
+    struct setop_task task;
+
+    if (dst == NULL || src == NULL) {
+        return -1;
+    }
+    if (op == RB_SETOP_UNION ? !setop_movable(dst, src) : !setop_compatible(dst, src)) {
+        return -1;
+    }
+
+    LOCK_RBTREE_WR(dst);
+    if (op == RB_SETOP_UNION) {
+        LOCK_RBTREE_WR(src);
+    } else {
+        LOCK_RBTREE_RD(src);
+    }
+    memset(&task, 0, sizeof(task));
+    task.proto = dst;
+    task.op = op;
+    task.a = dst->node;
+    task.ha = black_height(dst->node);
+    task.b = src->node;
+    task.hb = black_height(src->node);
+    task.depth = setop_depth(nr_threads);
+
+    RB_SEQ_BEGIN(dst);
+    setop_run(&task);
+    if (op == RB_SETOP_UNION) {
+        // src 的节点全部归 dst 所有，被淘汰的重复节点由 dst 释放
+        dst->nr_heap_nodes += src->nr_heap_nodes;
+        dst->nr_owned += src->nr_owned;
+        dst->nr_nodes += src->nr_nodes;
+        dst->count_stale |= src->count_stale;
+        src->node = NULL;
+        src->nr_heap_nodes = 0;
+        src->nr_owned = 0;
+        src->nr_nodes = 0;
+        src->count_stale = false;
+        src->version++;
+        rbtree_cache_reset(src);
+    }
+    setop_finish(dst, task.result, &task.dropped);
+    UNLOCK_RBTREE(src);
+    UNLOCK_RBTREE(dst);
+    return 0;
+}
+
+int rbtree_union(struct rbtree_root *dst, struct rbtree_root *src, int nr_threads)
+{
+    return setop(dst, src, RB_SETOP_UNION, nr_threads);
+}
+
+int rbtree_intersect(struct rbtree_root *dst, struct rbtree_root *src, int nr_threads)
+{
+    return setop(dst, src, RB_SETOP_INTERSECT, nr_threads);
+}
+
+int rbtree_difference(struct rbtree_root *dst, struct rbtree_root *src, int nr_threads)
+{
+    return setop(dst, src, RB_SETOP_DIFFERENCE, nr_threads);
+}
+
+int rbtree_join(struct rbtree_root *left, struct rbtree_root *right)
+{
+    rbroot_t scratch;
+    struct setop_list dropped = {NULL, NULL};
+    node_t *max, *min, *node;
+    size_t h;
+
+    if (left == NULL || right == NULL || !setop_movable(left, right)) {
+        return -1;
+    }
+
+    LOCK_RBTREE_WR(left);
+    LOCK_RBTREE_WR(right);
+    if (left->node && right->node) {
+        for (max = left->node; max->right != NULL; max = max->right) {
+        }
+        for (min = right->node; min->left != NULL; min = min->left) {
+        }
+        if (left->cmp_key(max->key, min->key) >= 0) {
+            UNLOCK_RBTREE(right);
+            UNLOCK_RBTREE(left);
+            return -1;
+        }
+    }
+    scratch_init(&scratch, left);
+    RB_SEQ_BEGIN(left);
+    node = join2(&scratch, left->node, black_height(left->node), right->node,
+                 black_height(right->node), &h);
+    left->nr_heap_nodes += right->nr_heap_nodes;
+    left->nr_owned += right->nr_owned;
+    left->nr_nodes += right->nr_nodes;
+    left->count_stale |= right->count_stale;
+    right->node = NULL;
+    right->nr_heap_nodes = 0;
+    right->nr_owned = 0;
+    right->nr_nodes = 0;
+    right->count_stale = false;
+    right->version++;
+    rbtree_cache_reset(right);
+    setop_finish(left, node, &dropped);
+    UNLOCK_RBTREE(right);
+    UNLOCK_RBTREE(left);
+    return 0;
+}
+
+int rbtree_split(struct rbtree_root *root, void *key, struct rbtree_root *right)
+{
+    rbroot_t scratch;
+    struct setop_list dropped = {NULL, NULL};
+    node_t *l, *r, *found;
+    size_t hl, hr;
+
+    if (root == NULL || right == NULL || !setop_movable(right, root)) {
+        return -1;
+    }
+
+    LOCK_RBTREE_WR(root);
+    LOCK_RBTREE_WR(right);
+    if (right->node != NULL) {
+        UNLOCK_RBTREE(right);
+        UNLOCK_RBTREE(root);
+        return -1;
+    }
+    scratch_init(&scratch, root);
+    RB_SEQ_BEGIN(root);
+    found = split(&scratch, root->node, black_height(root->node), key, &l, &hl, &r, &hr);
+    if (found) {
+        r = join(&scratch, NULL, 0, found, r, hr, &hr);
+    }
+    // 不遍历被移走的节点，两棵树都沿用原来的计数，只保证不小于实际值
+    right->nr_heap_nodes = root->nr_heap_nodes;
+    right->nr_owned = root->nr_owned;
+    // 有子树大小时节点数可以直接得到，否则留到下次使用时再遍历统计
+    if (root->order_stat) {
+        right->nr_nodes = r ? rb_count(r) : 0;
+        root->nr_nodes = l ? rb_count(l) : 0;
+    } else {
+        root->count_stale = right->count_stale = true;
+    }
+    setop_finish(root, l, &dropped);
+    RB_SEQ_BEGIN(right);
+    setop_finish(right, r, &dropped);
+    UNLOCK_RBTREE(right);
+    UNLOCK_RBTREE(root);
+    return 0;
+}
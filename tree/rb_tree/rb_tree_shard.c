@@ -0,0 +1,246 @@
+#include "rb_tree_shard.h"
+#include <stdlib.h>
+
+#define RB_SHARD_MAX 4096 // 分片数上限
+
+// 分片红黑树，各分片的根结构由 rbtree_init 按缓存行对齐分配，锁互不干扰
+struct rbtree_shard {
+    uint32_t mask; // 分片数 - 1
+    uint64_t (*hash_key)(void *key);
+    int (*cmp_key)(void *key0, void *key1);
+    struct rbtree_root *trees[];
+};
+
+// 与 rb_tree.c 中默认的 cmp_key 一致：key 本身是一个整数
+static int default_cmp_key(void *key0, void *key1)
+{
+    if ((uint64_t)key0 < (uint64_t)key1) {
+        return -1;
+    } else if ((uint64_t)key0 > (uint64_t)key1) {
+        return 1;
+    }
+    return 0;
+}
+
+// splitmix64 的终结函数，连续的整数 key 也能均匀分布到各个分片
+static uint64_t default_hash_key(void *key)
+{
+    uint64_t x = (uint64_t)key;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static inline struct rbtree_root *shard_of(struct rbtree_shard *shard, void *key)
+{
+    return shard->trees[shard->hash_key(key) & shard->mask];
+}
+
+struct rbtree_shard *rbtree_shard_init(struct rbtree_arg arg, uint32_t nr_shards)
+{
+    struct rbtree_shard *shard;
+    uint32_t n = 1;
+    uint32_t i;
+
+    if (arg.cmp_key && !arg.hash_key) {
+        return NULL;
+    }
+    if (nr_shards > RB_SHARD_MAX) {
+        nr_shards = RB_SHARD_MAX;
+    }
+    while (n < nr_shards) {
+        n <<= 1;
+    }
+
+    shard = calloc(1, sizeof(struct rbtree_shard) + n * sizeof(struct rbtree_root *));
+    if (!shard) {
+        return NULL;
+    }
+    shard->mask = n - 1;
+    shard->hash_key = arg.hash_key ? arg.hash_key : default_hash_key;
+    shard->cmp_key = arg.cmp_key ? arg.cmp_key : default_cmp_key;
+    for (i = 0; i < n; i++) {
+        shard->trees[i] = rbtree_init(arg);
+        if (!shard->trees[i]) {
+            goto err;
+        }
+    }
+
+    return shard;
+err:
+    rbtree_shard_destroy(shard);
+    return NULL;
+}
+
+void rbtree_shard_destroy(struct rbtree_shard *shard)
+{
+    uint32_t i;
+
+    if (!shard) {
+        return;
+    }
+    for (i = 0; i <= shard->mask; i++) {
+        rbtree_destroy(shard->trees[i]);
+    }
+    free(shard);
+}
+
+uint32_t rbtree_shard_count(struct rbtree_shard *shard)
+{
+    return shard ? shard->mask + 1 : 0;
+}
+
+int rbtree_shard_insert(struct rbtree_shard *shard, void *key, void *value, bool key_copy,
+                        bool val_copy)
+{
+    if (!shard) {
+        return -1;
+    }
+    return rbtree_insert(shard_of(shard, key), key, value, key_copy, val_copy);
+}
+
+int rbtree_shard_upsert(struct rbtree_shard *shard, void *key, void *value, bool key_copy,
+                        bool val_copy,
+                        void *(*merge)(void *key, void *old_value, void *new_value, void *ctx),
+                        void *ctx)
+{
+    if (!shard) {
+        return -1;
+    }
+    return rbtree_upsert(shard_of(shard, key), key, value, key_copy, val_copy, merge, ctx);
+}
+
+bool rbtree_shard_is_exist(struct rbtree_shard *shard, void *key)
+{
+    if (!shard) {
+        return false;
+    }
+    return rbtree_is_exist(shard_of(shard, key), key);
+}
+
+void *rbtree_shard_search(struct rbtree_shard *shard, void *key)
+{
+    if (!shard) {
+        return NULL;
+    }
+    return rbtree_search(shard_of(shard, key), key);
+}
+
+void rbtree_shard_delete(struct rbtree_shard *shard, void *key)
+{
+    if (!shard) {
+        return;
+    }
+    rbtree_delete(shard_of(shard, key), key);
+}
+
+// ------------------------ iterator ------------------------
+
+// 在各分片游标中选出 key 最小的一个，分片数不多，线性扫描即可。游标的 key 是移动时在该分片的锁内
+// 取得的，STEP 模式下树持有的 key 是游标自己的副本，节点被删除后仍可用于比较和重新定位
+static bool shard_iter_pick(struct rbtree_shard_iter *iter)
+{
+    struct rbtree_shard *shard = iter->shard;
+    void *min_key = NULL;
+    uint32_t i;
+
+    iter->current = -1;
+    for (i = 0; i <= shard->mask; i++) {
+        if (!rbtree_cursor_valid(&iter->cursors[i])) {
+            continue;
+        }
+        if (iter->current < 0 ||
+            shard->cmp_key(rbtree_cursor_key(&iter->cursors[i]), min_key) < 0) {
+            iter->current = (int)i;
+            min_key = rbtree_cursor_key(&iter->cursors[i]);
+        }
+    }
+    return iter->current >= 0;
+}
+
+int rbtree_shard_iter_init(struct rbtree_shard_iter *iter, struct rbtree_shard *shard,
+                           int lock_mode)
+{
+    uint32_t i;
+
+    if (!iter || !shard) {
+        return -1;
+    }
+    iter->cursors = calloc(shard->mask + 1, sizeof(struct rbtree_cursor));
+    if (!iter->cursors) {
+        return -1;
+    }
+    iter->shard = shard;
+    iter->lock_mode = lock_mode;
+    iter->current = -1;
+    for (i = 0; i <= shard->mask; i++) {
+        rbtree_cursor_init(&iter->cursors[i], shard->trees[i], lock_mode);
+        if (lock_mode == RBTREE_CURSOR_LOCK_BATCH) {
+            rbtree_read_lock(shard->trees[i]);
+        }
+    }
+    return 0;
+}
+
+void rbtree_shard_iter_release(struct rbtree_shard_iter *iter)
+{
+    uint32_t i;
+
+    if (!iter || !iter->cursors) {
+        return;
+    }
+    for (i = 0; i <= iter->shard->mask; i++) {
+        rbtree_cursor_release(&iter->cursors[i]);
+        if (iter->lock_mode == RBTREE_CURSOR_LOCK_BATCH) {
+            rbtree_read_unlock(iter->shard->trees[i]);
+        }
+    }
+    free(iter->cursors);
+    iter->cursors = NULL;
+    iter->current = -1;
+}
+
+bool rbtree_shard_iter_first(struct rbtree_shard_iter *iter)
+{
+    uint32_t i;
+
+    for (i = 0; i <= iter->shard->mask; i++) {
+        rbtree_cursor_first(&iter->cursors[i]);
+    }
+    return shard_iter_pick(iter);
+}
+
+bool rbtree_shard_iter_seek(struct rbtree_shard_iter *iter, void *key)
+{
+    uint32_t i;
+
+    for (i = 0; i <= iter->shard->mask; i++) {
+        rbtree_cursor_seek(&iter->cursors[i], key);
+    }
+    return shard_iter_pick(iter);
+}
+
+bool rbtree_shard_iter_next(struct rbtree_shard_iter *iter)
+{
+    struct rbtree_cursor *cursor;
+
+    if (iter->current < 0) {
+        return false;
+    }
+    cursor = &iter->cursors[iter->current];
+    if (!rbtree_cursor_next(cursor) && rbtree_cursor_invalidated(cursor)) {
+        // STEP 模式下该分片在两次移动之间被修改过，从它刚返回的 key 之后重新定位，不丢掉该分片
+        rbtree_cursor_upper_bound(cursor, rbtree_cursor_key(cursor));
+    }
+    return shard_iter_pick(iter);
+}
+
+void *rbtree_shard_iter_key(struct rbtree_shard_iter *iter)
+{
+    return iter->current < 0 ? NULL : rbtree_cursor_key(&iter->cursors[iter->current]);
+}
+
+void *rbtree_shard_iter_value(struct rbtree_shard_iter *iter)
+{
+    return iter->current < 0 ? NULL : rbtree_cursor_value(&iter->cursors[iter->current]);
+}
@@ -0,0 +1,180 @@
+#ifndef UTILS_RB_TREE_SHARD
+#define UTILS_RB_TREE_SHARD
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "rb_tree.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct rbtree_shard;
+
+/**
+ * @brief 跨分片的有序迭代器，对各分片的游标做多路归并
+ *
+ */
+struct rbtree_shard_iter {
+    struct rbtree_shard *shard;
+    struct rbtree_cursor *cursors; // 每个分片一个游标
+    int lock_mode;
+    int current; // 当前 key 所在的分片，-1 表示迭代结束
+};
+
+/**
+ * @brief 创建一个分片红黑树，key 按 arg.hash_key 的哈希值分到 nr_shards 棵独立的红黑树中，
+ *        每棵树有自己的锁，不同 key 的写入可以并行
+ *
+ * @param arg 每个分片使用的参数。使用自定义 cmp_key 时必须提供 hash_key；
+ *            使用默认 cmp_key（key 本身是整数）时 hash_key 可以为 NULL
+ * @param nr_shards 分片数，向上取整为 2 的幂
+ * @return struct rbtree_shard*
+ */
+struct rbtree_shard *rbtree_shard_init(struct rbtree_arg arg, uint32_t nr_shards);
+
+/**
+ * @brief 销毁分片红黑树
+ *
+ * @param shard
+ */
+void rbtree_shard_destroy(struct rbtree_shard *shard);
+
+/**
+ * @brief 分片数
+ *
+ * @param shard
+ * @return uint32_t
+ */
+uint32_t rbtree_shard_count(struct rbtree_shard *shard);
+
+/**
+ * @brief 插入一个节点，同 rbtree_insert
+ *
+ * @param shard
+ * @param key
+ * @param value
+ * @param key_copy
+ * @param val_copy
+ * @return int 0: 成功; -1: 失败
+ */
+int rbtree_shard_insert(struct rbtree_shard *shard, void *key, void *value, bool key_copy,
+                        bool val_copy);
+
+/**
+ * @brief 插入或更新一个节点，同 rbtree_upsert
+ *
+ * @param shard
+ * @param key
+ * @param value
+ * @param key_copy
+ * @param val_copy
+ * @param merge
+ * @param ctx
+ * @return int 0: 插入了新节点; 1: key 已存在并完成更新; -1: 失败
+ */
+int rbtree_shard_upsert(struct rbtree_shard *shard, void *key, void *value, bool key_copy,
+                        bool val_copy,
+                        void *(*merge)(void *key, void *old_value, void *new_value, void *ctx),
+                        void *ctx);
+
+/**
+ * @brief 判断一个 key 是否存在
+ *
+ * @param shard
+ * @param key
+ * @return true
+ * @return false
+ */
+bool rbtree_shard_is_exist(struct rbtree_shard *shard, void *key);
+
+/**
+ * @brief 查看一个 key 对应的 value，如果没有返回 NULL
+ *
+ * @param shard
+ * @param key
+ * @return void*
+ */
+void *rbtree_shard_search(struct rbtree_shard *shard, void *key);
+
+/**
+ * @brief 删除一个节点
+ *
+ * @param shard
+ * @param key
+ */
+void rbtree_shard_delete(struct rbtree_shard *shard, void *key);
+
+/**
+ * @brief 初始化跨分片迭代器
+ *
+ * @param iter
+ * @param shard
+ * @param lock_mode RBTREE_CURSOR_LOCK_BATCH: 持有所有分片的读锁直到 rbtree_shard_iter_release，
+ *                  看到的是一致的快照；RBTREE_CURSOR_LOCK_STEP: 各分片的游标逐步加锁，
+ *                  迭代期间允许写入。此时 key/value 是各分片游标移动时的快照；分片被修改后
+ *                  从它上一次返回的 key 之后重新定位，迭代期间一直存在的 key 按序各返回一次，
+ *                  迭代期间插入或删除的 key 可能返回也可能不返回。树持有 key（key_copy）时
+ *                  游标保存的是 key 的副本，由 rbtree_shard_iter_release 释放
+ * @return int 0: 成功; -1: 失败
+ */
+int rbtree_shard_iter_init(struct rbtree_shard_iter *iter, struct rbtree_shard *shard,
+                           int lock_mode);
+
+/**
+ * @brief 释放迭代器及各分片游标保存的 key 副本，BATCH 模式下释放所有分片的读锁
+ *
+ * @param iter
+ */
+void rbtree_shard_iter_release(struct rbtree_shard_iter *iter);
+
+/**
+ * @brief 定位到所有分片中最小的 key
+ *
+ * @param iter
+ * @return true 迭代器指向一个节点
+ * @return false 所有分片都为空
+ */
+bool rbtree_shard_iter_first(struct rbtree_shard_iter *iter);
+
+/**
+ * @brief 定位到所有分片中第一个大于等于 key 的节点
+ *
+ * @param iter
+ * @param key
+ * @return true 迭代器指向一个节点
+ * @return false 不存在这样的节点
+ */
+bool rbtree_shard_iter_seek(struct rbtree_shard_iter *iter, void *key);
+
+/**
+ * @brief 移动到下一个 key
+ *
+ * @param iter
+ * @return true 迭代器指向一个节点
+ * @return false 迭代结束
+ */
+bool rbtree_shard_iter_next(struct rbtree_shard_iter *iter);
+
+/**
+ * @brief 迭代器当前的 key，迭代结束时返回 NULL
+ *
+ * @param iter
+ * @return void*
+ */
+void *rbtree_shard_iter_key(struct rbtree_shard_iter *iter);
+
+/**
+ * @brief 迭代器当前的 value，迭代结束时返回 NULL
+ *
+ * @param iter
+ * @return void*
+ */
+void *rbtree_shard_iter_value(struct rbtree_shard_iter *iter);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UTILS_RB_TREE_SHARD */
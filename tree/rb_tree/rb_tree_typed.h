@@ -0,0 +1,160 @@
+#ifndef UTILS_RB_TREE_TYPED
+#define UTILS_RB_TREE_TYPED
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "rb_tree_link.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 数值类型 key 的比较，返回 -1/0/1
+#define RBTREE_CMP_NUM(a, b) (((a) > (b)) - ((a) < (b)))
+
+/**
+ * @brief 生成一个 key/value 类型固定的红黑树 name，key 和 value 直接存放在节点中，
+ *        比较由 cmp(a, b) 内联展开（返回 <0, 0, >0），没有函数指针调用。不是线程安全的。
+ *
+ *        生成的类型与函数：
+ *        struct name / struct name##_node
+ *        void name##_init(struct name *t);
+ *        void name##_destroy(struct name *t);
+ *        size_t name##_size(struct name *t);
+ *        struct name##_node *name##_find(struct name *t, K key);
+ *        struct name##_node *name##_lower_bound(struct name *t, K key);
+ *        int name##_insert(struct name *t, K key, V value);  0: 插入; 1: 更新; -1: 内存不足
+ *        bool name##_erase(struct name *t, K key, V *value); value 可以为 NULL
+ *        struct name##_node *name##_first(struct name *t);
+ *        struct name##_node *name##_next(struct name##_node *node);
+ *
+ *        例: RBTREE_DEFINE(u64map, uint64_t, void *, RBTREE_CMP_NUM)
+ */
+#define RBTREE_DEFINE(name, K, V, cmp)                                                          \
+    struct name##_node {                                                                        \
+        struct rbtree_link link;                                                                \
+        K key;                                                                                  \
+        V value;                                                                                \
+    };                                                                                          \
+    struct name {                                                                               \
+        struct rbtree_link *root;                                                               \
+        size_t size;                                                                            \
+    };                                                                                          \
+    static inline struct name##_node *name##_entry_(struct rbtree_link *link)                   \
+    {                                                                                           \
+        return link ? RBTREE_ENTRY(link, struct name##_node, link) : NULL;                      \
+    }                                                                                           \
+    static inline void name##_init(struct name *t)                                              \
+    {                                                                                           \
+        t->root = NULL;                                                                         \
+        t->size = 0;                                                                            \
+    }                                                                                           \
+    static inline void name##_destroy(struct name *t)                                           \
+    {                                                                                           \
+        struct rbtree_link *x = t->root;                                                        \
+        struct rbtree_link *parent;                                                             \
+        /* 后序释放，不需要额外的栈：先下到叶子，释放后回到父节点并断开该孩子 */                \
+        while (x != NULL) {                                                                     \
+            if (x->left) {                                                                      \
+                x = x->left;                                                                    \
+            } else if (x->right) {                                                              \
+                x = x->right;                                                                   \
+            } else {                                                                            \
+                parent = rbtree_link_parent(x);                                                 \
+                if (parent) {                                                                   \
+                    if (parent->left == x) {                                                    \
+                        parent->left = NULL;                                                    \
+                    } else {                                                                    \
+                        parent->right = NULL;                                                   \
+                    }                                                                           \
+                }                                                                               \
+                free(name##_entry_(x));                                                         \
+                x = parent;                                                                     \
+            }                                                                                   \
+        }                                                                                       \
+        name##_init(t);                                                                         \
+    }                                                                                           \
+    static inline size_t name##_size(struct name *t)                                            \
+    {                                                                                           \
+        return t->size;                                                                         \
+    }                                                                                           \
+    static inline struct name##_node *name##_find(struct name *t, K key)                        \
+    {                                                                                           \
+        struct rbtree_link *x = t->root;                                                        \
+        while (x != NULL) {                                                                     \
+            int c = cmp(key, name##_entry_(x)->key);                                            \
+            if (c == 0) {                                                                       \
+                return name##_entry_(x);                                                        \
+            }                                                                                   \
+            x = c < 0 ? x->left : x->right;                                                     \
+        }                                                                                       \
+        return NULL;                                                                            \
+    }                                                                                           \
+    static inline struct name##_node *name##_lower_bound(struct name *t, K key)                 \
+    {                                                                                           \
+        struct rbtree_link *x = t->root;                                                        \
+        struct rbtree_link *result = NULL;                                                      \
+        while (x != NULL) {                                                                     \
+            if (cmp(name##_entry_(x)->key, key) < 0) {                                          \
+                x = x->right;                                                                   \
+            } else {                                                                            \
+                result = x;                                                                     \
+                x = x->left;                                                                    \
+            }                                                                                   \
+        }                                                                                       \
+        return name##_entry_(result);                                                           \
+    }                                                                                           \
+    static inline int name##_insert(struct name *t, K key, V value)                             \
+    {                                                                                           \
+        struct rbtree_link **slot = &t->root;                                                   \
+        struct rbtree_link *parent = NULL;                                                      \
+        struct name##_node *node;                                                               \
+        while (*slot != NULL) {                                                                 \
+            int c = cmp(key, name##_entry_(*slot)->key);                                        \
+            if (c == 0) {                                                                       \
+                name##_entry_(*slot)->value = value;                                            \
+                return 1;                                                                       \
+            }                                                                                   \
+            parent = *slot;                                                                     \
+            slot = c < 0 ? &parent->left : &parent->right;                                      \
+        }                                                                                       \
+        node = (struct name##_node *)malloc(sizeof(struct name##_node));                        \
+        if (node == NULL) {                                                                     \
+            return -1;                                                                          \
+        }                                                                                       \
+        node->key = key;                                                                        \
+        node->value = value;                                                                    \
+        rbtree_link_insert(&t->root, &node->link, parent, slot);                                \
+        t->size++;                                                                              \
+        return 0;                                                                               \
+    }                                                                                           \
+    static inline bool name##_erase(struct name *t, K key, V *value)                            \
+    {                                                                                           \
+        struct name##_node *node = name##_find(t, key);                                         \
+        if (node == NULL) {                                                                     \
+            return false;                                                                       \
+        }                                                                                       \
+        if (value) {                                                                            \
+            *value = node->value;                                                               \
+        }                                                                                       \
+        rbtree_link_erase(&t->root, &node->link);                                               \
+        free(node);                                                                             \
+        t->size--;                                                                              \
+        return true;                                                                            \
+    }                                                                                           \
+    static inline struct name##_node *name##_first(struct name *t)                              \
+    {                                                                                           \
+        return name##_entry_(rbtree_link_first(t->root));                                       \
+    }                                                                                           \
+    static inline struct name##_node *name##_next(struct name##_node *node)                     \
+    {                                                                                           \
+        return name##_entry_(rbtree_link_next(&node->link));                                    \
+    }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UTILS_RB_TREE_TYPED */
@@ -0,0 +1,719 @@
+#include "rb_tree_wal.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "rb_tree_image.h"
+
+#define WAL_OP_INSERT 1
+#define WAL_OP_DELETE 2
+
+#define WAL_SYNC_INTERVAL_US 1000
+#define WAL_FLUSH_BYTES      (1 << 20)  // 队列超过这么多字节时不等 sync_interval_us 立即写入
+#define WAL_MAX_PENDING      (64 << 20) // 队列超过这么多字节时写者等待后台线程
+#define WAL_STACK_RECORD     256        // 小于这个长度的记录在栈上组装
+
+// 日志记录的头部，之后依次是序列化的 key 和 value
+struct wal_record {
+    uint32_t crc; // 头部 crc 之后的部分和 key/value 的 crc32，用于识别写了一半的记录
+    uint32_t op;
+    uint32_t key_len;
+    uint32_t value_len;
+};
+
+struct rbtree_wal {
+    struct rbtree_root *root;
+    struct rbtree_arg arg;
+    char *dir;
+    uint64_t gen; // 当前日志为 wal.<gen>，检查点 checkpoint.<gen> 包含之前所有日志的内容
+    int fd;
+    uint64_t wal_size; // 当前日志已写入的字节数
+    uint32_t sync_interval_us;
+    size_t checkpoint_size;
+
+    // lock 保证修改树和追加记录的顺序一致，同时保护以下字段
+    pthread_mutex_t lock;
+    pthread_cond_t wake; // 唤醒后台线程
+    pthread_cond_t done; // 一批记录写完、检查点结束
+    pthread_t thread;
+    char *buf; // 等待写入的记录
+    size_t len;
+    size_t cap;
+    char *spare; // 后台线程写入时与 buf 交换，写入期间写者继续向 buf 追加
+    size_t spare_cap;
+    uint64_t enqueued; // 已进入队列的记录数
+    uint64_t flushed;  // 已落盘的记录数
+    int nr_sync_waiters;
+    bool flushing;
+    bool checkpointing;
+    bool stop;
+    int err;
+};
+
+static uint32_t crc_table[256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_init(void)
+{
+    uint32_t c;
+    int i, k;
+
+    for (i = 0; i < 256; i++) {
+        c = (uint32_t)i;
+        for (k = 0; k < 8; k++) {
+            c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+        }
+        crc_table[i] = c;
+    }
+}
+
+static uint32_t crc32(const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    uint32_t c = 0xFFFFFFFF;
+
+    pthread_once(&crc_once, crc_init);
+    while (len--) {
+        c = crc_table[(c ^ *p++) & 0xFF] ^ (c >> 8);
+    }
+    return c ^ 0xFFFFFFFF;
+}
+
+// 与 rb_tree_image.c 的默认序列化一致：key/value 本身是一个整数
+static size_t default_serialize(void *obj, void *buf, size_t size)
+{
+    uint64_t x = (uint64_t)(uintptr_t)obj;
+    if (size >= sizeof(x)) {
+        memcpy(buf, &x, sizeof(x));
+    }
+    return sizeof(x);
+}
+
+static void *default_deserialize(const void *buf, size_t len)
+{
+    if (len != sizeof(uint64_t)) {
+        return NULL;
+    }
+    return (void *)(uintptr_t)*(const uint64_t *)buf;
+}
+
+static char *wal_path(const char *dir, const char *name, uint64_t gen)
+{
+    size_t size = strlen(dir) + strlen(name) + 32;
+    char *path = malloc(size);
+
+    if (path) {
+        snprintf(path, size, "%s/%s.%llu", dir, name, (unsigned long long)gen);
+    }
+    return path;
+}
+
+// 让目录中的创建、改名和删除落盘
+static int wal_sync_dir(const char *dir)
+{
+    int fd, rc;
+
+    if ((fd = open(dir, O_RDONLY | O_DIRECTORY)) < 0) {
+        return -1;
+    }
+    rc = fsync(fd);
+    close(fd);
+    return rc == 0 ? 0 : -1;
+}
+
+static void wal_unlink(const char *dir, const char *name, uint64_t gen)
+{
+    char *path = wal_path(dir, name, gen);
+
+    if (path) {
+        unlink(path);
+        free(path);
+    }
+}
+
+static int wal_open_log(struct rbtree_wal *wal, uint64_t gen, bool truncate)
+{
+    char *path = wal_path(wal->dir, "wal", gen);
+    int fd;
+
+    if (!path) {
+        return -1;
+    }
+    fd = open(path, O_WRONLY | O_CREAT | O_APPEND | (truncate ? O_TRUNC : 0), 0644);
+    free(path);
+    return fd;
+}
+
+// 在 lock 之外组装一条记录，*out 不是 stack 时由调用者释放
+static size_t wal_build(struct rbtree_wal *wal, uint32_t op, void *key, void *value, char *stack,
+                        char **out)
+{
+    size_t (*sk)(void *, void *, size_t) = wal->arg.serialize_key;
+    size_t (*sv)(void *, void *, size_t) = wal->arg.serialize_value;
+    struct wal_record rec;
+    size_t klen, vlen = 0, total;
+    char *p;
+
+    sk = sk ? sk : default_serialize;
+    sv = sv ? sv : default_serialize;
+    klen = sk(key, NULL, 0);
+    if (op == WAL_OP_INSERT) {
+        vlen = sv(value, NULL, 0);
+    }
+    if (klen > UINT32_MAX || vlen > UINT32_MAX) {
+        return 0;
+    }
+    total = sizeof(rec) + klen + vlen;
+    if (total <= WAL_STACK_RECORD) {
+        p = stack;
+    } else if ((p = malloc(total)) == NULL) {
+        return 0;
+    }
+    sk(key, p + sizeof(rec), klen);
+    if (op == WAL_OP_INSERT) {
+        sv(value, p + sizeof(rec) + klen, vlen);
+    }
+    rec.op = op;
+    rec.key_len = (uint32_t)klen;
+    rec.value_len = (uint32_t)vlen;
+    memcpy(p, &rec, sizeof(rec));
+    rec.crc = crc32(p + sizeof(rec.crc), total - sizeof(rec.crc));
+    memcpy(p, &rec.crc, sizeof(rec.crc));
+    *out = p;
+    return total;
+}
+
+static int wal_reserve(struct rbtree_wal *wal, size_t len)
+{
+    size_t cap = wal->cap ? wal->cap : 4096;
+    char *tmp;
+
+    if (wal->len + len <= wal->cap) {
+        return 0;
+    }
+    while (cap < wal->len + len) {
+        cap *= 2;
+    }
+    if ((tmp = realloc(wal->buf, cap)) == NULL) {
+        return -1;
+    }
+    wal->buf = tmp;
+    wal->cap = cap;
+    return 0;
+}
+
+static int wal_write_all(int fd, const char *buf, size_t len)
+{
+    ssize_t n;
+
+    while (len > 0) {
+        n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// 持有 lock 时调用，写入期间释放 lock，写者可以继续追加记录
+static int wal_flush_locked(struct rbtree_wal *wal)
+{
+    char *buf;
+    size_t len, cap;
+    uint64_t target;
+    int fd, rc;
+
+    while (wal->flushing) {
+        pthread_cond_wait(&wal->done, &wal->lock);
+    }
+    if (wal->len == 0 || wal->err) {
+        return wal->err;
+    }
+    buf = wal->buf;
+    len = wal->len;
+    cap = wal->cap;
+    wal->buf = wal->spare;
+    wal->cap = wal->spare_cap;
+    wal->len = 0;
+    wal->spare = NULL;
+    wal->spare_cap = 0;
+    target = wal->enqueued;
+    fd = wal->fd;
+    wal->flushing = true;
+    // 队列可能因 WAL_MAX_PENDING 阻塞了写者
+    pthread_cond_broadcast(&wal->done);
+    pthread_mutex_unlock(&wal->lock);
+
+    rc = wal_write_all(fd, buf, len);
+    if (rc == 0 && fdatasync(fd) != 0) {
+        rc = -1;
+    }
+
+    pthread_mutex_lock(&wal->lock);
+    wal->spare = buf;
+    wal->spare_cap = cap;
+    if (rc == 0) {
+        wal->wal_size += len;
+        wal->flushed = target;
+    } else {
+        wal->err = -1;
+    }
+    wal->flushing = false;
+    pthread_cond_broadcast(&wal->done);
+    return wal->err;
+}
+
+// 先写新的空日志，再写检查点，任何一步失败时旧的检查点和日志仍然完整
+static int wal_rotate(struct rbtree_wal *wal, int *new_fd)
+{
+    char *path;
+    int fd, rc;
+
+    if ((fd = wal_open_log(wal, wal->gen + 1, true)) < 0) {
+        return -1;
+    }
+    if ((path = wal_path(wal->dir, "checkpoint", wal->gen + 1)) == NULL) {
+        close(fd);
+        wal_unlink(wal->dir, "wal", wal->gen + 1);
+        return -1;
+    }
+    rc = rbtree_save_image(wal->root, path);
+    if (rc == 0) {
+        rc = wal_sync_dir(wal->dir);
+    }
+    if (rc != 0) {
+        close(fd);
+        unlink(path);
+        wal_unlink(wal->dir, "wal", wal->gen + 1);
+    }
+    free(path);
+    *new_fd = fd;
+    return rc;
+}
+
+// 持有 lock 时调用
+static int wal_checkpoint_locked(struct rbtree_wal *wal)
+{
+    int rc, fd = -1;
+
+    while (wal->checkpointing) {
+        pthread_cond_wait(&wal->done, &wal->lock);
+    }
+    // 阻塞写者，队列中已有的记录写完后树与日志一致
+    wal->checkpointing = true;
+    while ((wal->len || wal->flushing) && !wal->err) {
+        wal_flush_locked(wal);
+    }
+    rc = wal->err;
+    if (rc == 0) {
+        pthread_mutex_unlock(&wal->lock);
+        rc = wal_rotate(wal, &fd);
+        pthread_mutex_lock(&wal->lock);
+    }
+    if (rc == 0) {
+        close(wal->fd);
+        wal->fd = fd;
+        wal_unlink(wal->dir, "wal", wal->gen);
+        wal_unlink(wal->dir, "checkpoint", wal->gen);
+        wal->gen++;
+        wal->wal_size = 0;
+    }
+    wal->checkpointing = false;
+    pthread_cond_broadcast(&wal->done);
+    return rc;
+}
+
+static void *wal_thread(void *arg)
+{
+    struct rbtree_wal *wal = arg;
+    struct timespec ts;
+
+    pthread_mutex_lock(&wal->lock);
+    for (;;) {
+        if (wal->len == 0) {
+            if (wal->stop) {
+                break;
+            }
+            pthread_cond_wait(&wal->wake, &wal->lock);
+            continue;
+        }
+        // 等待更多的记录合并到同一次 fsync，有人在 rbtree_wal_sync 中等待时立即写入
+        if (!wal->stop && wal->nr_sync_waiters == 0 && wal->len < WAL_FLUSH_BYTES) {
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += (long)wal->sync_interval_us * 1000;
+            ts.tv_sec += ts.tv_nsec / 1000000000;
+            ts.tv_nsec %= 1000000000;
+            pthread_cond_timedwait(&wal->wake, &wal->lock, &ts);
+        }
+        if (wal_flush_locked(wal) != 0) {
+            // 出错后不再写入，丢弃队列并唤醒等待者
+            wal->len = 0;
+            pthread_cond_broadcast(&wal->done);
+            continue;
+        }
+        if (wal->checkpoint_size && wal->wal_size >= wal->checkpoint_size) {
+            wal_checkpoint_locked(wal);
+        }
+    }
+    pthread_mutex_unlock(&wal->lock);
+    return NULL;
+}
+
+static int wal_log(struct rbtree_wal *wal, uint32_t op, void *key, void *value, bool key_copy,
+                   bool val_copy)
+{
+    char stack[WAL_STACK_RECORD];
+    char *rec = NULL;
+    size_t len;
+    int rc = 0;
+
+    if ((len = wal_build(wal, op, key, value, stack, &rec)) == 0) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&wal->lock);
+    while (!wal->err && (wal->checkpointing || wal->len >= WAL_MAX_PENDING)) {
+        pthread_cond_signal(&wal->wake);
+        pthread_cond_wait(&wal->done, &wal->lock);
+    }
+    // 先预留队列空间，树修改成功后追加记录不会再失败
+    if (wal->err || wal_reserve(wal, len) != 0) {
+        rc = -1;
+        goto out;
+    }
+    if (op == WAL_OP_INSERT) {
+        rc = rbtree_insert(wal->root, key, value, key_copy, val_copy);
+    } else {
+        rbtree_delete(wal->root, key);
+    }
+    if (rc == 0) {
+        memcpy(wal->buf + wal->len, rec, len);
+        wal->len += len;
+        wal->enqueued++;
+        if (wal->len >= WAL_FLUSH_BYTES) {
+            pthread_cond_signal(&wal->wake);
+        }
+    }
+out:
+    pthread_mutex_unlock(&wal->lock);
+    if (rec != stack) {
+        free(rec);
+    }
+    return rc;
+}
+
+// 重放一个日志文件，返回完整记录的总长度；文件末尾写了一半的记录设置 *torn
+static ssize_t wal_replay(struct rbtree_wal *wal, const char *path, bool *torn)
+{
+    void *(*dk)(const void *, size_t) = wal->arg.deserialize_key;
+    void *(*dv)(const void *, size_t) = wal->arg.deserialize_value;
+    struct wal_record rec;
+    struct stat st;
+    char *data = NULL, *payload = NULL;
+    size_t off = 0, len, cap = 0, voff;
+    ssize_t n;
+    void *key, *value;
+    int fd;
+
+    dk = dk ? dk : default_deserialize;
+    dv = dv ? dv : default_deserialize;
+    *torn = false;
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st) != 0 || (st.st_size && (data = malloc(st.st_size)) == NULL)) {
+        close(fd);
+        return -1;
+    }
+    for (len = 0; len < (size_t)st.st_size; len += n) {
+        if ((n = read(fd, data + len, st.st_size - len)) <= 0) {
+            break;
+        }
+    }
+    close(fd);
+
+    while (off + sizeof(rec) <= len) {
+        memcpy(&rec, data + off, sizeof(rec));
+        if ((rec.op != WAL_OP_INSERT && rec.op != WAL_OP_DELETE) ||
+            rec.key_len > len - off - sizeof(rec) ||
+            rec.value_len > len - off - sizeof(rec) - rec.key_len ||
+            crc32(data + off + sizeof(rec.crc),
+                  sizeof(rec) - sizeof(rec.crc) + rec.key_len + rec.value_len) != rec.crc) {
+            break;
+        }
+        // key/value 拷贝到 malloc 的缓冲区，反序列化时按 8 字节对齐
+        if (cap < (size_t)rec.key_len + rec.value_len + 8) {
+            free(payload);
+            cap = (size_t)rec.key_len + rec.value_len + 8;
+            if ((payload = malloc(cap)) == NULL) {
+                free(data);
+                return -1;
+            }
+        }
+        memcpy(payload, data + off + sizeof(rec), rec.key_len);
+        key = dk(payload, rec.key_len);
+        if (rec.op == WAL_OP_INSERT) {
+            voff = ((size_t)rec.key_len + 7) & ~(size_t)7;
+            memcpy(payload + voff, data + off + sizeof(rec) + rec.key_len, rec.value_len);
+            value = dv(payload + voff, rec.value_len);
+            if (rbtree_insert(wal->root, key, value, wal->arg.copy_key != NULL,
+                              wal->arg.copy_value != NULL) != 0) {
+                free(payload);
+                free(data);
+                return -1;
+            }
+        } else {
+            rbtree_delete(wal->root, key);
+        }
+        off += sizeof(rec) + rec.key_len + rec.value_len;
+    }
+    *torn = off != len;
+    free(payload);
+    free(data);
+    return (ssize_t)off;
+}
+
+static int cmp_gen(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// 解析 "<name>.<gen>"，后面有多余字符（如 .tmp）时返回 false
+static bool wal_parse_name(const char *file, const char *name, uint64_t *gen)
+{
+    size_t n = strlen(name);
+    unsigned long long x;
+    int end = 0;
+
+    if (strncmp(file, name, n) != 0 || file[n] != '.') {
+        return false;
+    }
+    if (sscanf(file + n + 1, "%llu%n", &x, &end) != 1 || file[n + 1 + end] != '\0') {
+        return false;
+    }
+    *gen = x;
+    return true;
+}
+
+// 载入最近的检查点并重放之后的日志，打开最后一个日志用于追加
+static int wal_recover(struct rbtree_wal *wal)
+{
+    DIR *dirp;
+    struct dirent *ent;
+    uint64_t *gens = NULL, *tmp, gen, cp_gen = 0;
+    size_t nr_gens = 0, cap = 0, i;
+    bool has_cp = false, torn = false;
+    ssize_t valid = 0;
+    char *path;
+    int rc = 0;
+
+    if ((dirp = opendir(wal->dir)) == NULL) {
+        return -1;
+    }
+    while ((ent = readdir(dirp)) != NULL) {
+        if (wal_parse_name(ent->d_name, "checkpoint", &gen)) {
+            if (!has_cp || gen > cp_gen) {
+                cp_gen = gen;
+            }
+            has_cp = true;
+        } else if (wal_parse_name(ent->d_name, "wal", &gen)) {
+            if (nr_gens == cap) {
+                cap = cap ? cap * 2 : 8;
+                if ((tmp = realloc(gens, cap * sizeof(uint64_t))) == NULL) {
+                    rc = -1;
+                    break;
+                }
+                gens = tmp;
+            }
+            gens[nr_gens++] = gen;
+        }
+    }
+    closedir(dirp);
+    if (rc != 0) {
+        free(gens);
+        return -1;
+    }
+    if (nr_gens > 1) {
+        qsort(gens, nr_gens, sizeof(uint64_t), cmp_gen);
+    }
+
+    if (has_cp) {
+        if ((path = wal_path(wal->dir, "checkpoint", cp_gen)) == NULL) {
+            free(gens);
+            return -1;
+        }
+        rc = rbtree_load_image(wal->root, path, wal->arg.copy_key != NULL,
+                               wal->arg.copy_value != NULL);
+        free(path);
+    }
+    wal->gen = cp_gen;
+    for (i = 0; i < nr_gens && rc == 0; i++) {
+        if (gens[i] < cp_gen) {
+            // 上次检查点之后没来得及删除
+            wal_unlink(wal->dir, "wal", gens[i]);
+            continue;
+        }
+        // 只有最后一个日志可能写了一半，之前的日志在切换前已经完整落盘
+        if (torn || (path = wal_path(wal->dir, "wal", gens[i])) == NULL) {
+            rc = -1;
+            break;
+        }
+        valid = wal_replay(wal, path, &torn);
+        free(path);
+        if (valid < 0) {
+            rc = -1;
+            break;
+        }
+        wal->gen = gens[i];
+    }
+    free(gens);
+    if (rc != 0) {
+        return -1;
+    }
+
+    if ((wal->fd = wal_open_log(wal, wal->gen, false)) < 0) {
+        return -1;
+    }
+    // 截掉写了一半的记录，之后的记录紧接在完整的记录之后
+    if (torn && (ftruncate(wal->fd, valid) != 0 || fdatasync(wal->fd) != 0)) {
+        close(wal->fd);
+        return -1;
+    }
+    wal->wal_size = valid;
+    return 0;
+}
+
+struct rbtree_wal *rbtree_wal_open(const char *dir, struct rbtree_arg arg,
+                                   struct rbtree_wal_arg wal_arg)
+{
+    struct rbtree_wal *wal;
+
+    if (dir == NULL || (mkdir(dir, 0755) != 0 && errno != EEXIST)) {
+        return NULL;
+    }
+    if ((wal = calloc(1, sizeof(struct rbtree_wal))) == NULL) {
+        return NULL;
+    }
+    wal->arg = arg;
+    wal->sync_interval_us = wal_arg.sync_interval_us ? wal_arg.sync_interval_us
+                                                     : WAL_SYNC_INTERVAL_US;
+    wal->checkpoint_size = wal_arg.checkpoint_size;
+    wal->fd = -1;
+    if ((wal->dir = strdup(dir)) == NULL || (wal->root = rbtree_init(arg)) == NULL) {
+        goto err;
+    }
+    if (wal_recover(wal) != 0) {
+        goto err;
+    }
+    pthread_mutex_init(&wal->lock, NULL);
+    pthread_cond_init(&wal->wake, NULL);
+    pthread_cond_init(&wal->done, NULL);
+    if (pthread_create(&wal->thread, NULL, wal_thread, wal) != 0) {
+        pthread_cond_destroy(&wal->done);
+        pthread_cond_destroy(&wal->wake);
+        pthread_mutex_destroy(&wal->lock);
+        goto err;
+    }
+    return wal;
+
+err:
+    if (wal->fd >= 0) {
+        close(wal->fd);
+    }
+    if (wal->root) {
+        rbtree_destroy(wal->root);
+    }
+    free(wal->dir);
+    free(wal);
+    return NULL;
+}
+
+void rbtree_wal_close(struct rbtree_wal *wal)
+{
+    if (!wal) {
+        return;
+    }
+    pthread_mutex_lock(&wal->lock);
+    wal->stop = true;
+    pthread_cond_signal(&wal->wake);
+    pthread_mutex_unlock(&wal->lock);
+    pthread_join(wal->thread, NULL);
+
+    close(wal->fd);
+    rbtree_destroy(wal->root);
+    pthread_cond_destroy(&wal->done);
+    pthread_cond_destroy(&wal->wake);
+    pthread_mutex_destroy(&wal->lock);
+    free(wal->buf);
+    free(wal->spare);
+    free(wal->dir);
+    free(wal);
+}
+
+struct rbtree_root *rbtree_wal_tree(struct rbtree_wal *wal)
+{
+    return wal ? wal->root : NULL;
+}
+
+int rbtree_wal_insert(struct rbtree_wal *wal, void *key, void *value, bool key_copy,
+                      bool val_copy)
+{
+    if (!wal) {
+        return -1;
+    }
+    return wal_log(wal, WAL_OP_INSERT, key, value, key_copy, val_copy);
+}
+
+int rbtree_wal_delete(struct rbtree_wal *wal, void *key)
+{
+    if (!wal) {
+        return -1;
+    }
+    return wal_log(wal, WAL_OP_DELETE, key, NULL, false, false);
+}
+
+int rbtree_wal_sync(struct rbtree_wal *wal)
+{
+    uint64_t target;
+    int rc;
+
+    if (!wal) {
+        return -1;
+    }
+    pthread_mutex_lock(&wal->lock);
+    target = wal->enqueued;
+    wal->nr_sync_waiters++;
+    while (wal->flushed < target && !wal->err) {
+        pthread_cond_signal(&wal->wake);
+        pthread_cond_wait(&wal->done, &wal->lock);
+    }
+    wal->nr_sync_waiters--;
+    rc = wal->err;
+    pthread_mutex_unlock(&wal->lock);
+    return rc;
+}
+
+int rbtree_wal_checkpoint(struct rbtree_wal *wal)
+{
+    int rc;
+
+    if (!wal) {
+        return -1;
+    }
+    pthread_mutex_lock(&wal->lock);
+    rc = wal_checkpoint_locked(wal);
+    pthread_mutex_unlock(&wal->lock);
+    return rc;
+}
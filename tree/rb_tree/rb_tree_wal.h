@@ -0,0 +1,100 @@
+#ifndef UTILS_RB_TREE_WAL
+#define UTILS_RB_TREE_WAL
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rb_tree.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct rbtree_wal;
+
+/**
+ * @brief 预写日志参数
+ *
+ */
+struct rbtree_wal_arg {
+    // 后台线程两次 fsync 之间的最长间隔（微秒），期间的写入合并为一次 fsync。为 0 时使用 1000
+    uint32_t sync_interval_us;
+    // 日志超过这么多字节时后台线程自动做检查点，为 0 时只在调用 rbtree_wal_checkpoint 时做
+    size_t checkpoint_size;
+};
+
+/**
+ * @brief 打开 dir 下的持久化红黑树，目录不存在时创建。先载入最近的检查点（rbtree_save_image 格式），
+ *        再重放之后的日志；日志末尾写了一半的记录被丢弃。恢复时反序列化得到的 key/value：
+ *        arg 设置了 copy_key/copy_value 时拷贝后插入，否则直接插入（此时它们本身必须是数据，如整数）
+ *
+ * @param dir
+ * @param arg 同 rbtree_init，另外使用 serialize_key/serialize_value 写日志，
+ *            deserialize_key/deserialize_value 恢复
+ * @param wal_arg
+ * @return struct rbtree_wal* 失败（包括日志中间的记录损坏）时返回 NULL
+ */
+struct rbtree_wal *rbtree_wal_open(const char *dir, struct rbtree_arg arg,
+                                   struct rbtree_wal_arg wal_arg);
+
+/**
+ * @brief 把尚未写入的日志写入磁盘，停止后台线程并销毁树
+ *
+ * @param wal
+ */
+void rbtree_wal_close(struct rbtree_wal *wal);
+
+/**
+ * @brief 内部的红黑树，只能用于读（search、游标、遍历等），修改必须经过 rbtree_wal_insert/delete
+ *
+ * @param wal
+ * @return struct rbtree_root*
+ */
+struct rbtree_root *rbtree_wal_tree(struct rbtree_wal *wal);
+
+/**
+ * @brief 插入一个节点并追加一条日志记录。只把记录放入内存中的队列，由后台线程批量写入和 fsync，
+ *        返回时记录不一定已经落盘，需要时调用 rbtree_wal_sync
+ *
+ * @param wal
+ * @param key
+ * @param value
+ * @param key_copy true: 对 key 调用 copy_key 进行拷贝
+ * @param val_copy true: 对 val 调用 copy_val 进行拷贝
+ * @return int 0: 成功; -1: 失败（内存不足或之前的日志写入出错），树不变
+ */
+int rbtree_wal_insert(struct rbtree_wal *wal, void *key, void *value, bool key_copy,
+                      bool val_copy);
+
+/**
+ * @brief 删除一个节点并追加一条日志记录，同 rbtree_wal_insert
+ *
+ * @param wal
+ * @param key
+ * @return int 0: 成功或 key 不存在; -1: 失败，树不变
+ */
+int rbtree_wal_delete(struct rbtree_wal *wal, void *key);
+
+/**
+ * @brief 等待之前的所有修改落盘。多个线程同时等待时共用一次 fsync
+ *
+ * @param wal
+ * @return int 0: 成功; -1: 日志写入出错
+ */
+int rbtree_wal_sync(struct rbtree_wal *wal);
+
+/**
+ * @brief 把整棵树写成新的检查点并切换到新的日志文件，之后删除旧的检查点和日志。
+ *        写检查点期间修改操作阻塞，读不受影响
+ *
+ * @param wal
+ * @return int 0: 成功; -1: 失败，旧的检查点和日志仍然有效
+ */
+int rbtree_wal_checkpoint(struct rbtree_wal *wal);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UTILS_RB_TREE_WAL */
@@ -1,9 +1,18 @@
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <dirent.h>
+#include <unistd.h>
 #include <memory.h>
 #include "common/log/log.h"
 #include "rb_tree.h"
+#include "rb_tree_image.h"
+#include "rb_tree_interval.h"
+#include "rb_tree_persist.h"
+#include "rb_tree_shard.h"
+#include "rb_tree_typed.h"
+#include "rb_tree_wal.h"
 // #include "rb_tree_c.h"
 
 #ifndef ARRAY_SIZE
@@ -107,6 +116,7 @@ void test2(void)
     }
     rbtree_inorder(rb_root, test2_print_key_val);
     print_rbtree(rb_root);
+    rbtree_levelorder(rb_root, test2_print_key_val);
     rbtree_destroy(rb_root);
 
     // for (i = 0; i < key_len; i++) {
@@ -116,11 +126,696 @@ void test2(void)
     // }
 }
 
+void *test3_merge_count(void *key, void *old_value, void *new_value, void *ctx)
+{
+    (void)key;
+    (void)ctx;
+    return (void *)((long)old_value + (long)new_value);
+}
+
+void test3(void)
+{
+    long key[] = {3, 1, 4, 1, 5, 9, 2, 6, 5, 3, 5};
+    int i = 0;
+    int key_len = ARRAY_SIZE(key);
+    struct rbtree_root *rb_root = NULL;
+    struct rbtree_arg arg = {
+        .is_thread_safe = true,
+        .use_node_pool = true,
+    };
+
+    rb_root = rbtree_init(arg);
+
+    // 统计每个 key 出现的次数
+    for (i = 0; i < key_len; ++i) {
+        rbtree_upsert(rb_root, (void *)key[i], (void *)1L, false, false, test3_merge_count, NULL);
+    }
+    LOG_INFO("count of key[5]: %ld", (long)rbtree_search(rb_root, (void *)5L));
+    LOG_INFO("emplace key[9]: %d", rbtree_emplace(rb_root, (void *)9L, (void *)100L, false, false));
+    LOG_INFO("emplace key[7]: %d", rbtree_emplace(rb_root, (void *)7L, (void *)100L, false, false));
+    rbtree_inorder(rb_root, print_key_val);
+    rbtree_destroy(rb_root);
+}
+
+void test4(void)
+{
+    long i = 0;
+    struct rbtree_root *rb_root = NULL;
+    struct rbtree_cursor cursor;
+    struct rbtree_arg arg = {
+        .is_thread_safe = true,
+    };
+    struct rbtree_arg str_arg = {
+        .is_thread_safe = true,
+        .cmp_key = test2_cmp_key,
+        .copy_key = test2_copy_key,
+        .free_key = test2_free_key,
+    };
+    char str_key[8];
+
+    rb_root = rbtree_init(arg);
+    for (i = 0; i < 100; i += 2) {
+        rbtree_insert(rb_root, (void *)i, (void *)(i * 10), false, false);
+    }
+
+    // 范围查询 [31, 41)
+    rbtree_cursor_init(&cursor, rb_root, RBTREE_CURSOR_LOCK_BATCH);
+    rbtree_read_lock(rb_root);
+    for (rbtree_cursor_seek(&cursor, (void *)31L);
+         rbtree_cursor_valid(&cursor) && (long)rbtree_cursor_key(&cursor) < 41;
+         rbtree_cursor_next(&cursor)) {
+        print_key_val(rbtree_cursor_key(&cursor), rbtree_cursor_value(&cursor));
+    }
+    rbtree_read_unlock(rb_root);
+
+    // 从 upper_bound(90) 向前逐步遍历，中途插入节点后游标失效
+    rbtree_cursor_init(&cursor, rb_root, RBTREE_CURSOR_LOCK_STEP);
+    rbtree_cursor_upper_bound(&cursor, (void *)90L);
+    do {
+        print_key_val(rbtree_cursor_key(&cursor), rbtree_cursor_value(&cursor));
+    } while (rbtree_cursor_prev(&cursor) && (long)rbtree_cursor_key(&cursor) > 86);
+    rbtree_insert(rb_root, (void *)87L, (void *)870L, false, false);
+    LOG_INFO("cursor valid after insert: %d", rbtree_cursor_prev(&cursor));
+    LOG_INFO("cursor invalidated: %d, last key: %ld", rbtree_cursor_invalidated(&cursor),
+             (long)rbtree_cursor_key(&cursor));
+    // 用失效前的 key 重新定位，继续向前遍历
+    if (rbtree_cursor_lower_bound(&cursor, rbtree_cursor_key(&cursor)) &&
+        rbtree_cursor_prev(&cursor)) {
+        print_key_val(rbtree_cursor_key(&cursor), rbtree_cursor_value(&cursor));
+    }
+    rbtree_cursor_release(&cursor);
+    rbtree_destroy(rb_root);
+
+    // key 由树拷贝持有时，游标保存自己的副本：删除当前节点后仍可以用它重新定位
+    rb_root = rbtree_init(str_arg);
+    for (i = 0; i < 5; i++) {
+        snprintf(str_key, sizeof(str_key), "k%ld", i);
+        rbtree_insert(rb_root, str_key, (void *)i, true, false);
+    }
+    rbtree_cursor_init(&cursor, rb_root, RBTREE_CURSOR_LOCK_STEP);
+    rbtree_cursor_seek(&cursor, "k2");
+    rbtree_delete(rb_root, "k2");
+    if (!rbtree_cursor_next(&cursor) && rbtree_cursor_invalidated(&cursor) &&
+        rbtree_cursor_upper_bound(&cursor, rbtree_cursor_key(&cursor))) {
+        LOG_INFO("deleted key k2, re-seek to: %s", (char *)rbtree_cursor_key(&cursor));
+    }
+    rbtree_cursor_release(&cursor);
+    rbtree_destroy(rb_root);
+}
+
+// FNV-1a，字符串 key 的分片哈希
+static uint64_t test5_hash_key(void *key)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    const unsigned char *p = key;
+
+    while (*p) {
+        h = (h ^ *p++) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+void test5(void)
+{
+    long i = 0;
+    struct rbtree_shard *shard = NULL;
+    struct rbtree_shard_iter iter;
+    bool ok = false;
+    struct rbtree_arg arg = {
+        .is_thread_safe = true,
+    };
+    struct rbtree_arg str_arg = {
+        .is_thread_safe = true,
+        .cmp_key = test2_cmp_key,
+        .hash_key = test5_hash_key,
+        .copy_key = test2_copy_key,
+        .free_key = test2_free_key,
+    };
+    char str_key[8];
+
+    shard = rbtree_shard_init(arg, 8);
+    for (i = 0; i < 40; i += 3) {
+        rbtree_shard_insert(shard, (void *)i, (void *)(i * 10), false, false);
+    }
+    rbtree_shard_delete(shard, (void *)9L);
+    LOG_INFO("shards: %u, search key[12]: %ld", rbtree_shard_count(shard),
+             (long)rbtree_shard_search(shard, (void *)12L));
+
+    // 跨分片按 key 有序遍历 [10, +inf)
+    rbtree_shard_iter_init(&iter, shard, RBTREE_CURSOR_LOCK_BATCH);
+    for (ok = rbtree_shard_iter_seek(&iter, (void *)10L); ok; ok = rbtree_shard_iter_next(&iter)) {
+        print_key_val(rbtree_shard_iter_key(&iter), rbtree_shard_iter_value(&iter));
+    }
+    rbtree_shard_iter_release(&iter);
+
+    // STEP 模式下边遍历边删除：删掉当前 key 和之后的部分 key，未被删除的 key 仍按序各返回一次。
+    // 被删除的 key 若已是其分片游标的快照（如 6、24），仍可能返回一次
+    rbtree_shard_iter_init(&iter, shard, RBTREE_CURSOR_LOCK_STEP);
+    for (ok = rbtree_shard_iter_first(&iter); ok; ok = rbtree_shard_iter_next(&iter)) {
+        i = (long)rbtree_shard_iter_key(&iter);
+        print_key_val(rbtree_shard_iter_key(&iter), rbtree_shard_iter_value(&iter));
+        if (i % 2 == 0) {
+            rbtree_shard_delete(shard, (void *)i);
+            rbtree_shard_delete(shard, (void *)(i + 6));
+        }
+    }
+    rbtree_shard_iter_release(&iter);
+    LOG_INFO("key[12] exist: %d, key[15] exist: %d", rbtree_shard_is_exist(shard, (void *)12L),
+             rbtree_shard_is_exist(shard, (void *)15L));
+
+    rbtree_shard_destroy(shard);
+
+    // 树持有 key 时删除当前 key 会释放它，分片游标用自己的副本比较和重新定位
+    shard = rbtree_shard_init(str_arg, 4);
+    for (i = 0; i < 10; i++) {
+        snprintf(str_key, sizeof(str_key), "k%ld", i);
+        rbtree_shard_insert(shard, str_key, (void *)i, true, false);
+    }
+    rbtree_shard_iter_init(&iter, shard, RBTREE_CURSOR_LOCK_STEP);
+    for (ok = rbtree_shard_iter_first(&iter); ok; ok = rbtree_shard_iter_next(&iter)) {
+        LOG_INFO("key: %s, val: %ld", (char *)rbtree_shard_iter_key(&iter),
+                 (long)rbtree_shard_iter_value(&iter));
+        rbtree_shard_delete(shard, rbtree_shard_iter_key(&iter));
+    }
+    rbtree_shard_iter_release(&iter);
+    LOG_INFO("string keys left: %d", rbtree_shard_is_exist(shard, "k0") +
+                                         rbtree_shard_is_exist(shard, "k9"));
+    rbtree_shard_destroy(shard);
+}
+
+struct test6_ctx {
+    struct rbtree_root *root;
+    long nr_keys;
+    long nr_miss;
+    volatile int stop;
+};
+
+static void *test6_reader(void *arg)
+{
+    struct test6_ctx *ctx = arg;
+    long i = 0;
+    long miss = 0;
+    while (!ctx->stop) {
+        // 偶数 key 一直在树中，并发写入期间也必须能查到
+        for (i = 0; i < ctx->nr_keys; i += 2) {
+            if ((long)rbtree_search(ctx->root, (void *)i) != i * 10) {
+                miss++;
+            }
+        }
+    }
+    __atomic_fetch_add(&ctx->nr_miss, miss, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+void test6(void)
+{
+    long i = 0;
+    int round = 0;
+    pthread_t readers[4];
+    struct test6_ctx ctx = {
+        .nr_keys = 1000,
+    };
+    struct rbtree_arg arg = {
+        .is_thread_safe = true,
+        .use_node_pool = true,
+        .optimistic_read = true,
+    };
+
+    ctx.root = rbtree_init(arg);
+    for (i = 0; i < ctx.nr_keys; i += 2) {
+        rbtree_insert(ctx.root, (void *)i, (void *)(i * 10), false, false);
+    }
+    for (i = 0; i < (long)ARRAY_SIZE(readers); i++) {
+        pthread_create(&readers[i], NULL, test6_reader, &ctx);
+    }
+    // 奇数 key 反复插入删除，不断触发旋转和节点回收
+    for (round = 0; round < 200; round++) {
+        for (i = 1; i < ctx.nr_keys; i += 2) {
+            rbtree_insert(ctx.root, (void *)i, (void *)(i * 10), false, false);
+        }
+        for (i = 1; i < ctx.nr_keys; i += 2) {
+            rbtree_delete(ctx.root, (void *)i);
+        }
+    }
+    ctx.stop = 1;
+    for (i = 0; i < (long)ARRAY_SIZE(readers); i++) {
+        pthread_join(readers[i], NULL);
+    }
+    LOG_INFO("optimistic read miss: %ld", ctx.nr_miss);
+    rbtree_destroy(ctx.root);
+}
+
+void test7(void)
+{
+    long i = 0;
+    void *keys[15];
+    void *vals[15];
+    struct rbtree_root *rb_root = NULL;
+    struct rbtree_arg arg = {
+        .is_thread_safe = false,
+    };
+
+    for (i = 0; i < (long)ARRAY_SIZE(keys); i++) {
+        keys[i] = (void *)(i * 10);
+        vals[i] = (void *)(i * 100);
+    }
+    rb_root = rbtree_init(arg);
+    rbtree_build_sorted(rb_root, keys, vals, ARRAY_SIZE(keys));
+    print_rbtree(rb_root);
+    rbtree_delete(rb_root, (void *)70L);
+    rbtree_insert(rb_root, (void *)75L, (void *)750L, false, false);
+    rbtree_inorder(rb_root, print_key_val);
+    rbtree_destroy(rb_root);
+}
+
+void test8(void)
+{
+    long i = 0;
+    void *keys[100];
+    void *vals[100];
+    size_t found = 0;
+    struct rbtree_root *rb_root = NULL;
+    struct rbtree_arg arg = {
+        .is_thread_safe = true,
+    };
+
+    rb_root = rbtree_init(arg);
+    for (i = 0; i < 1000; i += 3) {
+        rbtree_insert(rb_root, (void *)i, (void *)(i * 10), false, false);
+    }
+    for (i = 0; i < (long)ARRAY_SIZE(keys); i++) {
+        keys[i] = (void *)(i * 7);
+    }
+    found = rbtree_search_batch(rb_root, keys, ARRAY_SIZE(keys), vals);
+    for (i = 0; i < (long)ARRAY_SIZE(keys); i++) {
+        if (vals[i] != rbtree_search(rb_root, keys[i])) {
+            LOG_INFO("batch search mismatch, key: %ld", (long)keys[i]);
+        }
+    }
+    LOG_INFO("batch search found: %zu", found);
+    rbtree_destroy(rb_root);
+}
+
+RBTREE_DEFINE(test9_map, uint64_t, long, RBTREE_CMP_NUM)
+
+void test9(void)
+{
+    uint64_t key[] = {10, 40, 30, 60, 90, 70, 20, 50, 80};
+    size_t i = 0;
+    long val = 0;
+    struct test9_map map;
+    struct test9_map_node *node = NULL;
+
+    test9_map_init(&map);
+    for (i = 0; i < ARRAY_SIZE(key); i++) {
+        test9_map_insert(&map, key[i], (long)key[i] * 10);
+    }
+    test9_map_erase(&map, 40, &val);
+    LOG_INFO("erase key[40]: %ld, size: %zu", val, test9_map_size(&map));
+    for (node = test9_map_lower_bound(&map, 35); node; node = test9_map_next(node)) {
+        printf("key: %lu, val: %ld\n", (unsigned long)node->key, node->value);
+    }
+    test9_map_destroy(&map);
+}
+
+void test10(void)
+{
+    long i = 0;
+    size_t rank = 0;
+    void *key = NULL;
+    struct rbtree_root *rb_root = NULL;
+    struct rbtree_arg arg = {
+        .is_thread_safe = true,
+        .order_stat = true,
+    };
+
+    rb_root = rbtree_init(arg);
+    for (i = 0; i < 100; i++) {
+        rbtree_insert(rb_root, (void *)(i * 10), (void *)i, false, false);
+    }
+    for (i = 0; i < 100; i += 3) {
+        rbtree_delete(rb_root, (void *)(i * 10));
+    }
+    // 排名和第 k 小
+    rbtree_rank(rb_root, (void *)500L, &rank);
+    rbtree_select(rb_root, rank, &key, NULL);
+    LOG_INFO("rank of key[500]: %zu, select(%zu): %ld", rank, rank, (long)key);
+    rbtree_destroy(rb_root);
+}
+
+void print_interval(uint64_t start, uint64_t end, void *value, void *ctx)
+{
+    (void)ctx;
+    printf("[%lu, %lu): %ld\n", (unsigned long)start, (unsigned long)end, (long)value);
+}
+
+void test11(void)
+{
+    uint64_t range[][2] = {{5, 20}, {10, 30}, {12, 15}, {15, 20}, {17, 19}, {30, 40}, {6, 10}};
+    size_t i = 0;
+    struct rbtree_interval *tree = NULL;
+    struct rbtree_arg arg = {
+        .is_thread_safe = true,
+    };
+
+    tree = rbtree_interval_init(arg);
+    for (i = 0; i < ARRAY_SIZE(range); i++) {
+        rbtree_interval_insert(tree, range[i][0], range[i][1], (void *)(long)i, false);
+    }
+    rbtree_interval_delete(tree, 15, 20);
+    LOG_INFO("overlap [14, 18)");
+    rbtree_interval_overlap(tree, 14, 18, print_interval, NULL);
+    LOG_INFO("stab 10: %zu, stab 30: %zu", rbtree_interval_stab(tree, 10, NULL, NULL),
+             rbtree_interval_stab(tree, 30, NULL, NULL));
+    rbtree_interval_destroy(tree);
+}
+
+void test12(void)
+{
+    long i = 0;
+    struct rbtree_root *t1 = NULL;
+    struct rbtree_root *t2 = NULL;
+    struct rbtree_arg arg = {
+        .is_thread_safe = true,
+    };
+
+    t1 = rbtree_init(arg);
+    t2 = rbtree_init(arg);
+    for (i = 0; i < 20; i += 2) {
+        rbtree_insert(t1, (void *)i, (void *)i, false, false);
+    }
+    for (i = 0; i < 20; i += 3) {
+        rbtree_insert(t2, (void *)i, (void *)i, false, false);
+    }
+    rbtree_difference(t1, t2, 2);
+    LOG_INFO("difference");
+    rbtree_inorder(t1, print_key_val);
+    rbtree_union(t1, t2, 2);
+    rbtree_split(t1, (void *)10, t2);
+    LOG_INFO("union, split at 10");
+    rbtree_inorder(t1, print_key_val);
+    rbtree_join(t1, t2);
+    rbtree_destroy(t1);
+    rbtree_destroy(t2);
+}
+
+void test13(void)
+{
+    long i = 0;
+    struct rbtree_persist *tree = NULL;
+    struct rbtree_snapshot *snap = NULL;
+    struct rbtree_arg arg = {
+        .is_thread_safe = true,
+    };
+
+    tree = rbtree_persist_init(arg);
+    for (i = 0; i < 10; i++) {
+        rbtree_persist_insert(tree, (void *)i, (void *)(i * 10), false, false);
+    }
+    snap = rbtree_snapshot(tree);
+    // 快照之后的修改对快照不可见
+    for (i = 0; i < 10; i += 2) {
+        rbtree_persist_delete(tree, (void *)i);
+    }
+    rbtree_persist_insert(tree, (void *)1L, (void *)100L, false, false);
+    LOG_INFO("tree size: %zu, snapshot size: %zu, key[1]: %ld / %ld", rbtree_persist_size(tree),
+             rbtree_snapshot_size(snap), (long)rbtree_persist_search(tree, (void *)1L),
+             (long)rbtree_snapshot_search(snap, (void *)1L));
+    rbtree_snapshot_inorder(snap, print_key_val);
+    rbtree_persist_destroy(tree);
+    rbtree_snapshot_release(snap);
+}
+
+void test14(void)
+{
+    long i = 0;
+    const char *path = "/tmp/test_rb_image.img";
+    struct rbtree_root *root = NULL;
+    struct rbtree_image *image = NULL;
+    struct rbtree_arg arg = {
+        .is_thread_safe = true,
+    };
+
+    root = rbtree_init(arg);
+    for (i = 0; i < 10; i++) {
+        rbtree_insert(root, (void *)i, (void *)(i * 10), false, false);
+    }
+    if (rbtree_save_image(root, path) != 0) {
+        LOG_ERROR("save image failed");
+        rbtree_destroy(root);
+        return;
+    }
+    rbtree_destroy(root);
+
+    image = rbtree_open_mmap(path, arg);
+    if (!image) {
+        LOG_ERROR("open image failed");
+        remove(path);
+        return;
+    }
+    LOG_INFO("image size: %zu, key[3]: %ld", rbtree_image_size(image),
+             (long)rbtree_image_search(image, (void *)3L));
+    rbtree_image_inorder(image, print_key_val);
+    rbtree_image_close(image);
+    remove(path);
+}
+
+// 删除 rbtree_wal 的目录
+static void test15_remove_dir(const char *dir)
+{
+    char path[512];
+    struct dirent *ent;
+    DIR *dirp = opendir(dir);
+
+    if (!dirp) {
+        return;
+    }
+    while ((ent = readdir(dirp)) != NULL) {
+        if (ent->d_name[0] != '.') {
+            snprintf(path, sizeof(path), "%.255s/%.255s", dir, ent->d_name);
+            unlink(path);
+        }
+    }
+    closedir(dirp);
+    rmdir(dir);
+}
+
+void test15(void)
+{
+    long i = 0;
+    const char *dir = "/tmp/test_rb_wal";
+    struct rbtree_wal *wal = NULL;
+    struct rbtree_arg arg = {
+        .is_thread_safe = true,
+    };
+    struct rbtree_wal_arg wal_arg = {
+        .sync_interval_us = 1000,
+    };
+
+    test15_remove_dir(dir);
+    wal = rbtree_wal_open(dir, arg, wal_arg);
+    if (!wal) {
+        LOG_ERROR("open wal failed");
+        return;
+    }
+    for (i = 0; i < 10; i++) {
+        rbtree_wal_insert(wal, (void *)i, (void *)(i * 10), false, false);
+    }
+    rbtree_wal_checkpoint(wal);
+    // 检查点之后的修改只在日志中
+    for (i = 0; i < 10; i += 2) {
+        rbtree_wal_delete(wal, (void *)i);
+    }
+    rbtree_wal_insert(wal, (void *)1L, (void *)100L, false, false);
+    rbtree_wal_sync(wal);
+    rbtree_wal_close(wal);
+
+    // 重新打开，由检查点和日志恢复
+    wal = rbtree_wal_open(dir, arg, wal_arg);
+    if (!wal) {
+        LOG_ERROR("reopen wal failed");
+        test15_remove_dir(dir);
+        return;
+    }
+    LOG_INFO("recovered key[1]: %ld", (long)rbtree_search(rbtree_wal_tree(wal), (void *)1L));
+    rbtree_inorder(rbtree_wal_tree(wal), print_key_val);
+    rbtree_wal_close(wal);
+    test15_remove_dir(dir);
+}
+
+static void *test16_init(void *ctx)
+{
+    (void)ctx;
+    return calloc(1, sizeof(long));
+}
+
+static void test16_map(void *partial, void *key, void *value, void *ctx)
+{
+    (void)key;
+    (void)ctx;
+    *(long *)partial += (long)value;
+}
+
+static void test16_reduce(void *result, void *partial, void *ctx)
+{
+    (void)ctx;
+    *(long *)result += *(long *)partial;
+    free(partial);
+}
+
+static void test16_range(int part, struct rbtree_cursor *cursor, size_t n, void *ctx)
+{
+    (void)ctx;
+    if (n > 0) {
+        LOG_INFO("part %d: %zu nodes from key %ld", part, n, (long)rbtree_cursor_key(cursor));
+    }
+}
+
+void test16(void)
+{
+    long i = 0;
+    long sum = 0;
+    struct rbtree_root *root = NULL;
+    struct rbtree_arg arg = {
+        .is_thread_safe = true,
+    };
+
+    root = rbtree_init(arg);
+    for (i = 0; i < 10000; i++) {
+        rbtree_insert(root, (void *)i, (void *)i, false, false);
+    }
+    rbtree_parallel_reduce(root, 4, test16_init, test16_map, test16_reduce, &sum, NULL);
+    LOG_INFO("sum: %ld", sum);
+    rbtree_parallel_ranges(root, 4, test16_range, NULL);
+    rbtree_destroy(root);
+}
+
+void test17(void)
+{
+    long i = 0;
+    struct rbtree_root *root = NULL;
+    struct rbtree_cursor hint;
+    struct rbtree_arg arg = {
+        .is_thread_safe = true,
+    };
+
+    root = rbtree_init(arg);
+    rbtree_cursor_init(&hint, root, RBTREE_CURSOR_LOCK_STEP);
+    // 近似有序的时间戳，每次插入的位置都在上一次附近
+    for (i = 0; i < 10; i++) {
+        rbtree_insert_hint(root, &hint, (void *)(i * 10 - (i % 3 == 2 ? 15 : 0)), (void *)i, false,
+                           false);
+    }
+    rbtree_cursor_release(&hint);
+    rbtree_inorder(root, print_key_val);
+    rbtree_destroy(root);
+}
+
+void test18(void)
+{
+    long i = 0;
+    uint64_t hits = 0, misses = 0;
+    struct rbtree_root *root = NULL;
+    struct rbtree_arg arg = {
+        .is_thread_safe = true,
+        .cache_size = 64,
+    };
+
+    root = rbtree_init(arg);
+    for (i = 0; i < 1000; i++) {
+        rbtree_insert(root, (void *)i, (void *)(i * 10), false, false);
+    }
+    // 少数热点 key 被反复查找
+    for (i = 0; i < 100; i++) {
+        rbtree_search(root, (void *)(i % 4 * 100));
+    }
+    rbtree_delete(root, (void *)100L);
+    LOG_INFO("key[100] exist: %d, key[200]: %ld", rbtree_is_exist(root, (void *)100L),
+             (long)rbtree_search(root, (void *)200L));
+    rbtree_cache_stats(root, &hits, &misses);
+    LOG_INFO("cache hits: %lu, misses: %lu", (unsigned long)hits, (unsigned long)misses);
+    rbtree_destroy(root);
+}
+
+void test19(void)
+{
+    long i = 0;
+    int policy = 0;
+    struct rbtree_root *root = NULL;
+    struct rbtree_arg arg = {
+        .is_thread_safe = true,
+    };
+
+    for (policy = RBTREE_LOCK_RWLOCK; policy <= RBTREE_LOCK_QUEUED; policy++) {
+        arg.lock_policy = policy;
+        root = rbtree_init(arg);
+        for (i = 0; i < 10; i++) {
+            rbtree_insert(root, (void *)i, (void *)(i * 10), false, false);
+        }
+        rbtree_delete(root, (void *)5L);
+        LOG_INFO("lock policy %d, key[3]: %ld, key[5] exist: %d", policy,
+                 (long)rbtree_search(root, (void *)3L), rbtree_is_exist(root, (void *)5L));
+        rbtree_destroy(root);
+    }
+}
+
+static size_t test20_size(void *key, void *value)
+{
+    (void)key;
+    (void)value;
+    return 2 * sizeof(long);
+}
+
+void test20(void)
+{
+    long i = 0;
+    struct rbtree_stats stats;
+    struct rbtree_root *root = NULL;
+    struct rbtree_root *right = NULL;
+    struct rbtree_arg arg = {
+        .is_thread_safe = true,
+    };
+
+    root = rbtree_init(arg);
+    right = rbtree_init(arg);
+    for (i = 0; i < 1000; i++) {
+        rbtree_insert(root, (void *)i, (void *)i, false, false);
+    }
+    rbtree_delete(root, (void *)10L);
+    rbtree_stats(root, test20_size, &stats);
+    LOG_INFO("size: %zu, node bytes: %zu, data bytes: %zu, max depth: %zu, avg depth: %.2f, "
+             "black height: %zu",
+             rbtree_size(root), stats.node_bytes, stats.data_bytes, stats.max_depth,
+             stats.avg_depth, stats.black_height);
+    rbtree_split(root, (void *)600L, right);
+    LOG_INFO("after split: %zu + %zu", rbtree_size(root), rbtree_size(right));
+    rbtree_destroy(right);
+    rbtree_destroy(root);
+}
+
 int main(int argc, char *argv[])
 {
     (void)argc;
     LOG_INFO("start: [%s]", argv[0]);
     // test1();
     test2();
+    test3();
+    test4();
+    test5();
+    test6();
+    test7();
+    test8();
+    test9();
+    test10();
+    test11();
+    test12();
+    test13();
+    test14();
+    test15();
+    test16();
+    test17();
+    test18();
+    test19();
+    test20();
     return 0;
 }
\ No newline at end of file
@@ -1,3 +1,8 @@
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <string>
 #include <vector>
 #include "common/log/log.h"
 #include "rb_tree_cpp.hpp"
@@ -21,5 +26,96 @@ int main(int argc, char *argv[])
         LOG_INFO("delete node[%d] data[%s]", vecData[i], strRm.c_str());
         tree.Print(true);
     }
+
+    std::vector<int> vecKey = {10, 20, 30, 40, 50, 60, 70, 80, 90, 100};
+    std::vector<std::string> vecVal;
+    for (int key : vecKey) {
+        vecVal.push_back(std::to_string(key));
+    }
+    tree::CRBTree<int, std::string> treeSorted;
+    treeSorted.BuildFromSorted(vecKey.data(), vecVal.data(), vecKey.size());
+    treeSorted.Insert(35, "35");
+    treeSorted.Remove(60, vecVal[0]);
+    treeSorted.Print(true);
+    LOG_INFO("size: %zu, rank(55): %zu, select(3): %d", treeSorted.Size(), treeSorted.Rank(55),
+             treeSorted.Select(3)->key);
+
+    tree::CRBTree<int, std::string> treeHint;
+    tree::SRBTreeNode<int, std::string> *hint = nullptr;
+    for (int key = 0; key < 10; key++) {
+        hint = treeHint.InsertHint(hint, key, std::to_string(key));
+    }
+    treeHint.Print(true);
+
+    // value 只能移动，Insert/Emplace/TryEmplace/Remove 都不应复制
+    tree::CRBTree<std::string, std::unique_ptr<int>> treeMove;
+    for (int key = 0; key < 10; key++) {
+        std::string strKey = "key" + std::to_string(key);
+        treeMove.Insert(std::move(strKey), std::make_unique<int>(key));
+    }
+    treeMove.Emplace(std::string("key10"), std::make_unique<int>(10));
+    treeMove.Emplace(std::piecewise_construct, std::forward_as_tuple(5, 'k'),
+                     std::forward_as_tuple(new int(11)));
+    auto pairOld = treeMove.TryEmplace("key3", std::make_unique<int>(-1));
+    std::string strNew = "key11";
+    auto pairNew = treeMove.TryEmplace(std::move(strNew), std::make_unique<int>(12));
+    // 左值 key 被拷贝，右值 value 被移动
+    const std::string strKey12 = "key12";
+    treeMove.Insert(strKey12, std::make_unique<int>(13));
+    treeMove.InsertHint(treeMove.Search(strKey12), "key13", std::make_unique<int>(14));
+    std::unique_ptr<int> pRm;
+    treeMove.Remove("key7", pRm);
+    LOG_INFO("size: %zu, key3 inserted: %d value: %d, key11 inserted: %d value: %d, "
+             "removed key7 value: %d, kkkkk value: %d",
+             treeMove.Size(), pairOld.second, *pairOld.first->data, pairNew.second,
+             *pairNew.first->data, *pRm, *treeMove.Search("kkkkk")->data);
+    treeMove.Print(false);
+
+    // 节点来自单次请求的内存：节点池以 monotonic_buffer_resource 为上游，请求结束时一次释放
+    char arrBuffer[4096];
+    std::pmr::monotonic_buffer_resource arena(arrBuffer, sizeof(arrBuffer));
+    {
+        tree::CRBTreeNodePool<int, std::string> pool(&arena);
+        tree::pmr::CRBTree<int, std::string> treeArena(&pool);
+        for (int key = 0; key < 100; key++) {
+            treeArena.Insert(key, std::to_string(key));
+        }
+        std::string strRm;
+        for (int key = 0; key < 100; key += 2) {
+            treeArena.Remove(key, strRm);
+        }
+        for (int key = 100; key < 150; key++) {
+            treeArena.Emplace(key, std::to_string(key));
+        }
+        LOG_INFO("arena tree size: %zu, min: %d, max: %d, same pool: %d", treeArena.Size(),
+                 treeArena.Min()->key, treeArena.Max()->key,
+                 treeArena.GetAllocator().resource() == &pool);
+    }
+
+    // 迭代器按 key 升序遍历，不分配内存，解引用只能看到 key（只读）和 data
+    tree::CRBTree<int, std::string> treeIter;
+    for (int key : {50, 10, 40, 20, 30, 20, 60}) {
+        treeIter.Insert(key, std::to_string(key));
+    }
+    std::string strKeys;
+    for (auto &entry : treeIter) {
+        strKeys += entry.data + " ";
+    }
+    LOG_INFO("inorder: %s", strKeys.c_str());
+    strKeys.clear();
+    for (auto it = treeIter.rbegin(); it != treeIter.rend(); ++it) {
+        strKeys += it->data + " ";
+    }
+    LOG_INFO("reverse: %s", strKeys.c_str());
+    auto range = treeIter.equal_range(20);
+    const auto &treeConst = treeIter;
+    LOG_INFO("lower_bound(25): %d, upper_bound(50): %d, equal_range(20): %ld, last: %d, "
+             "upper_bound(60) is end: %d, count > 25: %ld, Inorder size: %zu",
+             treeIter.lower_bound(25)->key, treeIter.upper_bound(50)->key,
+             (long)std::distance(range.first, range.second), std::prev(treeConst.end())->key,
+             treeConst.upper_bound(60) == treeConst.cend(),
+             (long)std::count_if(treeConst.begin(), treeConst.end(),
+                                 [](const auto &entry) { return entry.key > 25; }),
+             treeIter.Inorder(false).size());
     return 0;
 }
\ No newline at end of file